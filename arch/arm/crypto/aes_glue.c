@@ -0,0 +1,71 @@
+/*
+ * Glue Code for the asm optimized version of the AES Cipher Algorithm
+ *
+ * The key schedule is the one of crypto/aes_generic.c.  The block modes
+ * (cbc, xts, ...) are the generic templates, which pick this cipher up
+ * through its higher priority; the crypto manager runs the ecb(aes),
+ * cbc(aes) and xts(aes) vectors of crypto/testmgr.c against it when they
+ * are instantiated.
+ *
+ * This is a single block cipher only.  dm-crypt's XTS and CBC decryption
+ * run from the kcryptd workqueue and could process eight blocks at once
+ * with a bit-sliced NEON implementation; there is none yet.
+ */
+
+#include <linux/module.h>
+#include <crypto/aes.h>
+
+asmlinkage void __aes_arm_encrypt(struct crypto_aes_ctx *ctx, u8 *out,
+				  const u8 *in);
+asmlinkage void __aes_arm_decrypt(struct crypto_aes_ctx *ctx, u8 *out,
+				  const u8 *in);
+
+static void aes_encrypt(struct crypto_tfm *tfm, u8 *dst, const u8 *src)
+{
+	__aes_arm_encrypt(crypto_tfm_ctx(tfm), dst, src);
+}
+
+static void aes_decrypt(struct crypto_tfm *tfm, u8 *dst, const u8 *src)
+{
+	__aes_arm_decrypt(crypto_tfm_ctx(tfm), dst, src);
+}
+
+static struct crypto_alg aes_alg = {
+	.cra_name		= "aes",
+	.cra_driver_name	= "aes-asm",
+	.cra_priority		= 200,
+	.cra_flags		= CRYPTO_ALG_TYPE_CIPHER,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct crypto_aes_ctx),
+	/* The block is moved with ldm/stm */
+	.cra_alignmask		= 3,
+	.cra_module		= THIS_MODULE,
+	.cra_list		= LIST_HEAD_INIT(aes_alg.cra_list),
+	.cra_u	= {
+		.cipher	= {
+			.cia_min_keysize	= AES_MIN_KEY_SIZE,
+			.cia_max_keysize	= AES_MAX_KEY_SIZE,
+			.cia_setkey		= crypto_aes_set_key,
+			.cia_encrypt		= aes_encrypt,
+			.cia_decrypt		= aes_decrypt
+		}
+	}
+};
+
+static int __init aes_init(void)
+{
+	return crypto_register_alg(&aes_alg);
+}
+
+static void __exit aes_fini(void)
+{
+	crypto_unregister_alg(&aes_alg);
+}
+
+module_init(aes_init);
+module_exit(aes_fini);
+
+MODULE_DESCRIPTION("Rijndael (AES) Cipher Algorithm, asm optimized");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS("aes");
+MODULE_ALIAS("aes-asm");
@@ -0,0 +1,169 @@
+/*
+ * Cryptographic API.
+ *
+ * Glue code for the SHA1 Secure Hash Algorithm assembler implementation
+ *
+ * The update and final steps are those of crypto/sha1_generic.c, except
+ * that all complete blocks of an update go to the assembler in one call.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+#include <crypto/internal/hash.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/cryptohash.h>
+#include <linux/types.h>
+#include <crypto/sha.h>
+#include <asm/byteorder.h>
+
+asmlinkage void sha1_arm_blocks(u32 *state, const u8 *data,
+				unsigned int blocks, u32 *W);
+
+static void sha1_blocks(struct sha1_state *sctx, const u8 *data,
+			unsigned int blocks, u32 *temp)
+{
+#if __LINUX_ARM_ARCH__ >= 6
+	/* The assembler uses ldr, which would trap on unaligned data */
+	if (!IS_ALIGNED((unsigned long)data, 4)) {
+		for (; blocks; blocks--, data += SHA1_BLOCK_SIZE) {
+			memcpy(sctx->buffer, data, SHA1_BLOCK_SIZE);
+			sha1_arm_blocks(sctx->state, sctx->buffer, 1, temp);
+		}
+		return;
+	}
+#endif
+	sha1_arm_blocks(sctx->state, data, blocks, temp);
+}
+
+static int sha1_init(struct shash_desc *desc)
+{
+	struct sha1_state *sctx = shash_desc_ctx(desc);
+
+	*sctx = (struct sha1_state){
+		.state = { SHA1_H0, SHA1_H1, SHA1_H2, SHA1_H3, SHA1_H4 },
+	};
+
+	return 0;
+}
+
+static int sha1_update(struct shash_desc *desc, const u8 *data,
+			unsigned int len)
+{
+	struct sha1_state *sctx = shash_desc_ctx(desc);
+	unsigned int partial = sctx->count & 0x3f;
+	u32 temp[SHA_WORKSPACE_WORDS];
+
+	sctx->count += len;
+
+	if (partial + len < SHA1_BLOCK_SIZE) {
+		memcpy(sctx->buffer + partial, data, len);
+		return 0;
+	}
+
+	if (partial) {
+		unsigned int fill = SHA1_BLOCK_SIZE - partial;
+
+		memcpy(sctx->buffer + partial, data, fill);
+		sha1_arm_blocks(sctx->state, sctx->buffer, 1, temp);
+		data += fill;
+		len -= fill;
+	}
+
+	if (len >= SHA1_BLOCK_SIZE) {
+		sha1_blocks(sctx, data, len / SHA1_BLOCK_SIZE, temp);
+		data += len & ~(SHA1_BLOCK_SIZE - 1);
+		len &= SHA1_BLOCK_SIZE - 1;
+	}
+
+	memcpy(sctx->buffer, data, len);
+	memset(temp, 0, sizeof(temp));
+
+	return 0;
+}
+
+
+/* Add padding and return the message digest. */
+static int sha1_final(struct shash_desc *desc, u8 *out)
+{
+	struct sha1_state *sctx = shash_desc_ctx(desc);
+	__be32 *dst = (__be32 *)out;
+	u32 i, index, padlen;
+	__be64 bits;
+	static const u8 padding[64] = { 0x80, };
+
+	bits = cpu_to_be64(sctx->count << 3);
+
+	/* Pad out to 56 mod 64 */
+	index = sctx->count & 0x3f;
+	padlen = (index < 56) ? (56 - index) : ((64+56) - index);
+	sha1_update(desc, padding, padlen);
+
+	/* Append length */
+	sha1_update(desc, (const u8 *)&bits, sizeof(bits));
+
+	/* Store state in digest */
+	for (i = 0; i < 5; i++)
+		dst[i] = cpu_to_be32(sctx->state[i]);
+
+	/* Wipe context */
+	memset(sctx, 0, sizeof *sctx);
+
+	return 0;
+}
+
+static int sha1_export(struct shash_desc *desc, void *out)
+{
+	struct sha1_state *sctx = shash_desc_ctx(desc);
+
+	memcpy(out, sctx, sizeof(*sctx));
+	return 0;
+}
+
+static int sha1_import(struct shash_desc *desc, const void *in)
+{
+	struct sha1_state *sctx = shash_desc_ctx(desc);
+
+	memcpy(sctx, in, sizeof(*sctx));
+	return 0;
+}
+
+static struct shash_alg alg = {
+	.digestsize	=	SHA1_DIGEST_SIZE,
+	.init		=	sha1_init,
+	.update		=	sha1_update,
+	.final		=	sha1_final,
+	.export		=	sha1_export,
+	.import		=	sha1_import,
+	.descsize	=	sizeof(struct sha1_state),
+	.statesize	=	sizeof(struct sha1_state),
+	.base		=	{
+		.cra_name	=	"sha1",
+		.cra_driver_name=	"sha1-asm",
+		.cra_priority	=	150,
+		.cra_flags	=	CRYPTO_ALG_TYPE_SHASH,
+		.cra_blocksize	=	SHA1_BLOCK_SIZE,
+		.cra_module	=	THIS_MODULE,
+	}
+};
+
+static int __init sha1_mod_init(void)
+{
+	return crypto_register_shash(&alg);
+}
+
+static void __exit sha1_mod_fini(void)
+{
+	crypto_unregister_shash(&alg);
+}
+
+module_init(sha1_mod_init);
+module_exit(sha1_mod_fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("SHA1 Secure Hash Algorithm (ARM)");
+MODULE_ALIAS("sha1");
+MODULE_ALIAS("sha1-asm");
@@ -0,0 +1,41 @@
+/*
+ * arch/arm/include/asm/neon.h
+ *
+ * Kernel-mode NEON support.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_NEON_H
+#define __ASM_ARM_NEON_H
+
+#include <linux/hardirq.h>
+#include <linux/irqflags.h>
+#include <asm/hwcap.h>
+
+#define cpu_has_neon()		(!!(elf_hwcap & HWCAP_NEON))
+
+#ifdef CONFIG_NEON
+/*
+ * Bracket kernel code using NEON registers.  The VFP/NEON state of the
+ * task owning the unit is saved first and reloaded lazily on its next
+ * VFP instruction.  Preemption is disabled in between, so the code must
+ * not sleep; neither call may be made from interrupt context.
+ */
+extern void kernel_neon_begin(void);
+extern void kernel_neon_end(void);
+
+/*
+ * Whether the NEON unit may be claimed here.  Besides interrupt context
+ * this rules out code running with interrupts disabled: the suspend and
+ * power collapse paths, where coprocessor access may not have been
+ * restored yet.
+ */
+static inline int may_use_neon(void)
+{
+	return !in_interrupt() && !irqs_disabled();
+}
+#endif
+
+#endif /* __ASM_ARM_NEON_H */
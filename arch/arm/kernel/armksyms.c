@@ -47,6 +47,8 @@ extern void __aeabi_uidiv(void);
 extern void __aeabi_uidivmod(void);
 extern void __aeabi_ulcmp(void);
 
+extern void crc32_sliceby8_arch(void);
+
 extern void fpundefinstr(void);
 
 
@@ -110,6 +112,9 @@ EXPORT_SYMBOL(__put_user_8);
 
 	/* crypto hash */
 EXPORT_SYMBOL(sha_transform);
+#if defined(CONFIG_HAVE_ARCH_CRC32_SLICEBY8) && defined(CONFIG_CRC32_SLICEBY8)
+EXPORT_SYMBOL(crc32_sliceby8_arch);
+#endif
 
 	/* gcc lib functions */
 EXPORT_SYMBOL(__ashldi3);
@@ -0,0 +1,207 @@
+/*
+ *  linux/arch/arm/lib/csum-neon-test.c
+ *
+ *  Checks csum_partial and csum_partial_copy_from_user, ARM and NEON
+ *  versions, against a reference sum computed the way lib/checksum.c
+ *  does, over a range of lengths, alignments and incoming sums, plus the
+ *  fault path of the copy.  Then reports the speed of each version in
+ *  cycles per byte, derived from the current cpufreq speed.
+ *
+ *  Load the module to run the tests; the results go to the kernel log
+ *  and loading always fails with -EAGAIN so it can be run again.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/random.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/cpufreq.h>
+#include <linux/smp.h>
+#include <asm/checksum.h>
+#include <asm/neon.h>
+#include <asm/uaccess.h>
+
+#define TEST_BUF_SIZE	(64 * 1024)
+#define TEST_MAX_LEN	4200
+#define BENCH_BYTES	(4 * 1024 * 1024)
+
+extern __wsum __csum_partial_arm(const void *, int, __wsum);
+extern __wsum __csum_partial_copy_from_user_arm(const void __user *, void *,
+						int, __wsum, int *);
+extern __wsum csum_partial_neon(const void *, int, __wsum);
+extern __wsum csum_partial_copy_from_user_neon(const void __user *, void *,
+					       int, __wsum, int *);
+extern unsigned int csum_neon_min;
+
+/* Byte-wise version of do_csum() in lib/checksum.c, plus the sum */
+static __sum16 ref_csum(const u8 *buf, int len, __wsum sum)
+{
+	u64 acc = (__force u32)sum;
+	int i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		acc += buf[i] | (buf[i + 1] << 8);
+	if (len & 1)
+		acc += buf[len - 1];
+
+	while (acc >> 32)
+		acc = (acc & 0xffffffff) + (acc >> 32);
+	return csum_fold((__force __wsum)(u32)acc);
+}
+
+typedef __wsum (*csum_fn_t)(const void *, int, __wsum);
+typedef __wsum (*csum_copy_fn_t)(const void __user *, void *, int, __wsum, int *);
+
+static const struct {
+	const char *name;
+	csum_fn_t csum;
+	csum_copy_fn_t copy;
+} variants[] = {
+	{ "arm", __csum_partial_arm, __csum_partial_copy_from_user_arm },
+	{ "neon", csum_partial_neon, csum_partial_copy_from_user_neon },
+};
+
+static int __init check_one(int v, u8 *src, u8 *dst, int len, __wsum sum)
+{
+	__sum16 ref = ref_csum(src, len, sum);
+	mm_segment_t old_fs;
+	__wsum res;
+	int err = 0;
+
+	res = variants[v].csum(src, len, sum);
+	if (csum_fold(res) != ref) {
+		printk(KERN_ERR "csum_neon_test: %s csum_partial len %d align %lu: "
+		       "%04x, expected %04x\n", variants[v].name, len,
+		       (unsigned long)src & 7, csum_fold(res), ref);
+		return -EINVAL;
+	}
+
+	/* src is kernel memory */
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	res = variants[v].copy((const void __user *)src, dst, len, sum, &err);
+	set_fs(old_fs);
+
+	if (err || csum_fold(res) != ref || memcmp(src, dst, len)) {
+		printk(KERN_ERR "csum_neon_test: %s csum_partial_copy_from_user "
+		       "len %d align %lu/%lu: %04x err %d, expected %04x\n",
+		       variants[v].name, len, (unsigned long)src & 7,
+		       (unsigned long)dst & 7, csum_fold(res), err, ref);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* A faulting copy must report -EFAULT and zero the whole buffer */
+static int __init check_fault(int v, u8 *dst)
+{
+	int err = 0, i;
+
+	memset(dst, 0xa5, 1024);
+	variants[v].copy(NULL, dst, 1024, 0, &err);
+	for (i = 0; i < 1024 && !dst[i]; i++)
+		;
+	if (err != -EFAULT || i < 1024) {
+		printk(KERN_ERR "csum_neon_test: %s csum_partial_copy_from_user "
+		       "fault: err %d, byte %d not zeroed\n", variants[v].name,
+		       err, i);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* Prints cycles per byte, in hundredths */
+static void __init bench_one(int v, u8 *src, u8 *dst, int len, unsigned int khz)
+{
+	unsigned int iters = BENCH_BYTES / len, i;
+	mm_segment_t old_fs;
+	ktime_t start;
+	s64 ns_csum, ns_copy;
+	int err = 0;
+
+	start = ktime_get();
+	for (i = 0; i < iters; i++)
+		variants[v].csum(src, len, 0);
+	ns_csum = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	start = ktime_get();
+	for (i = 0; i < iters; i++)
+		variants[v].copy((const void __user *)src, dst, len, 0, &err);
+	ns_copy = ktime_to_ns(ktime_sub(ktime_get(), start));
+	set_fs(old_fs);
+
+	/* cycles = ns * kHz / 10^6; per byte, times 100 */
+	printk(KERN_INFO "csum_neon_test: %-4s %6d %3llu.%02llu %3llu.%02llu\n",
+	       variants[v].name, len,
+	       div_u64((u64)ns_csum * khz, (u64)iters * len * 10000) / 100,
+	       div_u64((u64)ns_csum * khz, (u64)iters * len * 10000) % 100,
+	       div_u64((u64)ns_copy * khz, (u64)iters * len * 10000) / 100,
+	       div_u64((u64)ns_copy * khz, (u64)iters * len * 10000) % 100);
+}
+
+static int __init csum_neon_test_init(void)
+{
+	static const int bench_lens[] = { 64, 256, 576, 1500, 4096, 16384 };
+	unsigned int khz;
+	u8 *src, *dst;
+	int v, i, len, ret = 0;
+
+	if (!cpu_has_neon()) {
+		printk(KERN_INFO "csum_neon_test: no NEON unit\n");
+		return -ENODEV;
+	}
+
+	src = kmalloc(TEST_BUF_SIZE + 8, GFP_KERNEL);
+	dst = kmalloc(TEST_BUF_SIZE + 8, GFP_KERNEL);
+	if (!src || !dst) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	get_random_bytes(src, TEST_BUF_SIZE + 8);
+
+	for (v = 0; v < ARRAY_SIZE(variants) && !ret; v++) {
+		for (len = 0; len <= TEST_MAX_LEN && !ret; len += len < 300 ? 1 : 37) {
+			for (i = 0; i < 8 && !ret; i++) {
+				__wsum sum = (__force __wsum)random32();
+
+				ret = check_one(v, src + i, dst + (7 - i), len, sum);
+			}
+		}
+		if (!ret)
+			ret = check_fault(v, dst);
+	}
+	if (ret)
+		goto out;
+	printk(KERN_INFO "csum_neon_test: all results match (NEON from %u bytes)\n",
+	       csum_neon_min);
+
+	khz = cpufreq_quick_get(raw_smp_processor_id());
+	if (!khz) {
+		printk(KERN_INFO "csum_neon_test: no cpufreq, cannot report cycles\n");
+		goto out;
+	}
+	printk(KERN_INFO "csum_neon_test: at %u MHz, cycles/byte for\n", khz / 1000);
+	printk(KERN_INFO "csum_neon_test:      len   csum   copy\n");
+	for (v = 0; v < ARRAY_SIZE(variants); v++)
+		for (i = 0; i < ARRAY_SIZE(bench_lens); i++)
+			bench_one(v, src, dst, bench_lens[i], khz);
+
+out:
+	kfree(src);
+	kfree(dst);
+	/* Never stay loaded */
+	return ret ? ret : -EAGAIN;
+}
+
+module_init(csum_neon_test_init);
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("NEON checksum test and benchmark");
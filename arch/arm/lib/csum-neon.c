@@ -0,0 +1,90 @@
+/*
+ *  linux/arch/arm/lib/csum-neon.c
+ *
+ *  NEON csum_partial and csum_partial_copy_from_user for ARMv7 cores.
+ *
+ *  Both assembler entry points pass buffers of csum_neon_min bytes or
+ *  more here.  Calls that may not use NEON, such as the receive path in
+ *  softirq context, go back to the ARM code.  The limit is set at boot on
+ *  NEON-capable CPUs and can be changed through
+ *  /sys/module/csum_neon/parameters/csum_neon_min.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/string.h>
+#include <asm/checksum.h>
+#include <asm/neon.h>
+#include <asm/uaccess.h>
+
+#define CSUM_NEON_MIN_SIZE	256	/* Smallest buffer handed to NEON */
+
+extern __wsum __csum_partial_arm(const void *, int, __wsum);
+extern __wsum __csum_partial_copy_from_user_arm(const void __user *, void *,
+						int, __wsum, int *);
+extern __wsum __csum_partial_neon(const void *, int, __wsum);
+
+/* Checked by the assembler entry points; ~0 keeps them on the ARM code */
+unsigned int csum_neon_min __read_mostly = ~0U;
+module_param(csum_neon_min, uint, 0644);
+
+__wsum csum_partial_neon(const void *buf, int len, __wsum sum)
+{
+	int done = len & ~15;
+
+	if (len < CSUM_NEON_MIN_SIZE || !may_use_neon())
+		return __csum_partial_arm(buf, len, sum);
+
+	kernel_neon_begin();
+	sum = __csum_partial_neon(buf, done, sum);
+	kernel_neon_end();
+
+	/* The tail starts at an even offset, so the words still pair up */
+	return __csum_partial_arm(buf + done, len - done, sum);
+}
+
+__wsum csum_partial_copy_from_user_neon(const void __user *src, void *dst,
+					int len, __wsum sum, int *err_ptr)
+{
+	if (len < CSUM_NEON_MIN_SIZE || !may_use_neon())
+		return __csum_partial_copy_from_user_arm(src, dst, len, sum,
+							 err_ptr);
+
+	/*
+	 * Copy first and sum the copy while it is still in the cache;
+	 * loading user memory into NEON registers would need fault fixups
+	 * of its own.
+	 */
+	if (unlikely(__copy_from_user(dst, src, len))) {
+		/* As the assembler version: zero the buffer, return no sum */
+		memset(dst, 0, len);
+		*err_ptr = -EFAULT;
+		return 0;
+	}
+
+	return csum_partial_neon(dst, len, sum);
+}
+
+/* For csum-neon-test */
+EXPORT_SYMBOL_GPL(csum_neon_min);
+EXPORT_SYMBOL_GPL(csum_partial_neon);
+EXPORT_SYMBOL_GPL(csum_partial_copy_from_user_neon);
+EXPORT_SYMBOL_GPL(__csum_partial_arm);
+EXPORT_SYMBOL_GPL(__csum_partial_copy_from_user_arm);
+
+static int __init csum_neon_init(void)
+{
+#ifndef CONFIG_CPU_BIG_ENDIAN
+	/* The NEON loop pairs bytes little-endian */
+	if (cpu_has_neon())
+		csum_neon_min = CSUM_NEON_MIN_SIZE;
+#endif
+	return 0;
+}
+
+/* After vfp_init() has found the NEON unit */
+late_initcall_sync(csum_neon_init);
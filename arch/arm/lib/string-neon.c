@@ -0,0 +1,253 @@
+/*
+ *  linux/arch/arm/lib/string-neon.c
+ *
+ *  NEON versions of memcpy, memset and copy_page for ARMv7 cores.
+ *
+ *  memcpy, memset, __memzero and copy_page hand large requests over to
+ *  the functions below once the boot benchmark has found NEON to be
+ *  faster on this CPU.  The benchmark times the ARM routines against
+ *  each NEON variant over a range of sizes and alignments, including the
+ *  cost of claiming the NEON unit, and sets the size from which NEON
+ *  wins.  The results are logged; the thresholds can be changed later
+ *  through /sys/module/string_neon/parameters/, and "string_neon.bench=0"
+ *  skips the benchmark and keeps everything on the ARM code.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <asm/neon.h>
+
+#define NEON_BENCH_BUF		(64 * 1024)
+#define NEON_BENCH_BYTES	(256 * 1024)	/* Copied per measurement */
+#define NEON_MIN_SIZE		256		/* Smallest size handed to NEON */
+
+extern void *__memcpy_arm(void *, const void *, size_t);
+extern void *__memset_arm(void *, int, size_t);
+extern void __copy_page_arm(void *, const void *);
+extern void *__memcpy_neon_pld128(void *, const void *, size_t);
+extern void *__memcpy_neon_pld320(void *, const void *, size_t);
+extern void *__memset_neon(void *, int, size_t);
+
+typedef void *(*memcpy_fn_t)(void *, const void *, size_t);
+
+static const struct {
+	const char *name;
+	memcpy_fn_t fn;
+} memcpy_variants[] = {
+	{ "neon-pld128", __memcpy_neon_pld128 },
+	{ "neon-pld320", __memcpy_neon_pld320 },
+};
+
+/* Checked by the assembler entry points; ~0 keeps them on the ARM code */
+unsigned int memcpy_neon_min __read_mostly = ~0U;
+unsigned int memset_neon_min __read_mostly = ~0U;
+int copy_page_use_neon __read_mostly;
+
+module_param(memcpy_neon_min, uint, 0644);
+module_param(memset_neon_min, uint, 0644);
+module_param(copy_page_use_neon, int, 0644);
+
+static int bench = 1;
+module_param(bench, int, 0444);
+
+static memcpy_fn_t memcpy_neon_fn __read_mostly = __memcpy_neon_pld128;
+
+void *memcpy_neon(void *dest, const void *src, size_t n)
+{
+	if (n < NEON_MIN_SIZE || !may_use_neon())
+		return __memcpy_arm(dest, src, n);
+
+	kernel_neon_begin();
+	memcpy_neon_fn(dest, src, n);
+	kernel_neon_end();
+	return dest;
+}
+
+void *memset_neon(void *s, int c, size_t n)
+{
+	if (n < NEON_MIN_SIZE || !may_use_neon())
+		return __memset_arm(s, c, n);
+
+	kernel_neon_begin();
+	__memset_neon(s, c, n);
+	kernel_neon_end();
+	return s;
+}
+
+void copy_page_neon(void *to, const void *from)
+{
+	if (!may_use_neon()) {
+		__copy_page_arm(to, from);
+		return;
+	}
+
+	kernel_neon_begin();
+	memcpy_neon_fn(to, from, PAGE_SIZE);
+	kernel_neon_end();
+}
+
+/* Benchmark */
+
+static const unsigned int bench_sizes[] = { 256, 1024, 4096, 16384, 65536 };
+#define NR_SIZES	ARRAY_SIZE(bench_sizes)
+
+/* Destination and source misalignment pairs */
+static const unsigned int bench_align[][2] = { { 0, 0 }, { 0, 3 }, { 5, 0 }, { 7, 13 } };
+
+enum { BENCH_MEMCPY, BENCH_MEMSET, BENCH_COPY_PAGE };
+
+/* variant < 0 is the ARM code, otherwise an index into memcpy_variants[] */
+static void bench_call(int op, int variant, void *dst, void *src, size_t n)
+{
+	if (variant < 0) {
+		switch (op) {
+		case BENCH_MEMCPY:
+			__memcpy_arm(dst, src, n);
+			break;
+		case BENCH_MEMSET:
+			__memset_arm(dst, 0x5a, n);
+			break;
+		default:
+			__copy_page_arm(dst, src);
+			break;
+		}
+		return;
+	}
+
+	/* Include claiming the unit, which every real call pays as well */
+	kernel_neon_begin();
+	if (op == BENCH_MEMSET)
+		__memset_neon(dst, 0x5a, n);
+	else
+		memcpy_variants[variant].fn(dst, src, n);
+	kernel_neon_end();
+}
+
+/* Returns MB/s for one size, summed over all alignments */
+static unsigned int bench_one(int op, int variant, u8 *dst, u8 *src, size_t n)
+{
+	unsigned int iters = max_t(unsigned int, NEON_BENCH_BYTES / n, 1);
+	unsigned int a, i, nalign = op == BENCH_COPY_PAGE ? 1 : ARRAY_SIZE(bench_align);
+	ktime_t start;
+	s64 ns;
+
+	start = ktime_get();
+	for (a = 0; a < nalign; a++) {
+		/* copy_page needs page aligned buffers */
+		u8 *d = dst, *s = src;
+
+		if (op != BENCH_COPY_PAGE) {
+			d += bench_align[a][0];
+			s += bench_align[a][1];
+		}
+		for (i = 0; i < iters; i++)
+			bench_call(op, variant, d, s, n);
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	/* bytes per microsecond is MB/s */
+	return ns > 0 ? div64_u64((u64)iters * nalign * n * NSEC_PER_USEC, ns) : 0;
+}
+
+/*
+ * Smallest benchmarked size from which @neon beats @arm at every larger
+ * size as well, or ~0 if it never does.
+ */
+static unsigned int bench_crossover(const unsigned int *arm, const unsigned int *neon)
+{
+	unsigned int min = ~0U;
+	int i;
+
+	for (i = NR_SIZES - 1; i >= 0 && neon[i] > arm[i]; i--)
+		min = max_t(unsigned int, bench_sizes[i], NEON_MIN_SIZE);
+	return min;
+}
+
+static void bench_print(const char *op, const char *variant, const unsigned int *mbs)
+{
+	int i;
+
+	printk(KERN_INFO "string_neon: %-9s %-12s", op, variant);
+	for (i = 0; i < NR_SIZES; i++)
+		printk(KERN_CONT " %6u", mbs[i]);
+	printk(KERN_CONT " MB/s\n");
+}
+
+static void __init string_neon_bench(u8 *dst, u8 *src)
+{
+	unsigned int arm[NR_SIZES], neon[ARRAY_SIZE(memcpy_variants)][NR_SIZES];
+	unsigned int set_arm[NR_SIZES], set_neon[NR_SIZES];
+	unsigned int page_arm, page_neon, best = 0, v, i;
+
+	printk(KERN_INFO "string_neon: size      %-12s", "");
+	for (i = 0; i < NR_SIZES; i++)
+		printk(KERN_CONT " %6u", bench_sizes[i]);
+	printk(KERN_CONT "\n");
+
+	for (i = 0; i < NR_SIZES; i++)
+		arm[i] = bench_one(BENCH_MEMCPY, -1, dst, src, bench_sizes[i]);
+	bench_print("memcpy", "arm", arm);
+
+	for (v = 0; v < ARRAY_SIZE(memcpy_variants); v++) {
+		for (i = 0; i < NR_SIZES; i++)
+			neon[v][i] = bench_one(BENCH_MEMCPY, v, dst, src,
+					       bench_sizes[i]);
+		bench_print("memcpy", memcpy_variants[v].name, neon[v]);
+
+		/* Rank the preload variants on the large copies */
+		if (neon[v][NR_SIZES - 1] + neon[v][NR_SIZES - 2] >
+		    neon[best][NR_SIZES - 1] + neon[best][NR_SIZES - 2])
+			best = v;
+	}
+
+	for (i = 0; i < NR_SIZES; i++) {
+		set_arm[i] = bench_one(BENCH_MEMSET, -1, dst, src, bench_sizes[i]);
+		set_neon[i] = bench_one(BENCH_MEMSET, 0, dst, src, bench_sizes[i]);
+	}
+	bench_print("memset", "arm", set_arm);
+	bench_print("memset", "neon", set_neon);
+
+	page_arm = bench_one(BENCH_COPY_PAGE, -1, dst, src, PAGE_SIZE);
+	page_neon = bench_one(BENCH_COPY_PAGE, best, dst, src, PAGE_SIZE);
+	printk(KERN_INFO "string_neon: copy_page arm %u neon %u MB/s\n",
+	       page_arm, page_neon);
+
+	memcpy_neon_fn = memcpy_variants[best].fn;
+	smp_wmb();
+	memcpy_neon_min = bench_crossover(arm, neon[best]);
+	memset_neon_min = bench_crossover(set_arm, set_neon);
+	copy_page_use_neon = page_neon > page_arm;
+
+	printk(KERN_INFO "string_neon: memcpy %s from %d, memset neon from %d, "
+	       "copy_page %s\n", memcpy_variants[best].name, (int)memcpy_neon_min,
+	       (int)memset_neon_min, copy_page_use_neon ? "neon" : "arm");
+}
+
+static int __init string_neon_init(void)
+{
+	unsigned int order = get_order(2 * NEON_BENCH_BUF + PAGE_SIZE);
+	u8 *buf;
+
+	if (!cpu_has_neon() || !bench)
+		return 0;
+
+	buf = (u8 *)__get_free_pages(GFP_KERNEL, order);
+	if (!buf)
+		return -ENOMEM;
+
+	memset(buf, 0xa5, PAGE_SIZE << order);
+	string_neon_bench(buf, buf + NEON_BENCH_BUF + PAGE_SIZE);
+	free_pages((unsigned long)buf, order);
+	return 0;
+}
+
+/* After vfp_init() has found the NEON unit */
+late_initcall_sync(string_neon_init);
@@ -29,9 +29,16 @@
 #include <linux/io.h>
 #include <linux/sort.h>
 #include <linux/remote_spinlock.h>
+#include <linux/module.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <mach/board.h>
 #include <mach/msm_iomap.h>
 #include <asm/mach-types.h>
+#include <asm/div64.h>
 #include <mach/socinfo.h>
 
 #include "proc_comm.h"
@@ -74,6 +81,20 @@ static const struct pll {
 	[ACPU_PLL_4] = {PLL4_MODE, 0x3ff},
 };
 
+/* Transition latency histogram: bucket n counts switches < 2^(n+4) us. */
+#define SWITCH_HIST_BUCKETS	10
+
+struct clock_stats {
+	unsigned long			pll_requests;
+	unsigned long			pll_requests_cached;
+	unsigned long			vdd_switches;
+	unsigned long			vdd_switches_skipped;
+	unsigned long			switches;
+	uint64_t			switch_time_total_us;
+	uint32_t			switch_time_max_us;
+	unsigned long			switch_hist[SWITCH_HIST_BUCKETS + 1];
+};
+
 struct clock_state {
 	struct clkctl_acpu_speed	*current_speed;
 	struct mutex			lock;
@@ -83,8 +104,22 @@ struct clock_state {
 	unsigned long			max_axi_khz;
 	unsigned long			wait_for_irq_khz;
 	struct clk			*ebi1_clk;
+	/* PLLs the application processor currently votes for. */
+	unsigned int			pll_votes;
+	struct clock_stats		stats;
 };
 
+/*
+ * After a cpufreq switch, PLL votes no longer needed and a VDD drop are
+ * held back this long, so a quick switch back up costs neither a PLL
+ * request nor a VDD ramp.  Zero releases them right away.
+ */
+static unsigned int pll_release_delay_ms = 100;
+module_param(pll_release_delay_ms, uint, S_IRUGO | S_IWUSR);
+
+static void acpuclk_release_work(struct work_struct *work);
+static DECLARE_DELAYED_WORK(release_work, acpuclk_release_work);
+
 #define PLL_BASE	7
 
 struct shared_pll_control {
@@ -376,13 +411,21 @@ static int pc_pll_request(unsigned id, unsigned on)
 	int res = 0;
 	on = !!on;
 
+	if (id >= ACPU_PLL_END)
+		return -EINVAL;
+
+	/* Our vote is already in place, no need to bother the modem. */
+	if (!!(drv_state.pll_votes & (1 << id)) == on) {
+		drv_state.stats.pll_requests_cached++;
+		return 0;
+	}
+
 	if (on)
 		dprintk("Enabling PLL %d\n", id);
 	else
 		dprintk("Disabling PLL %d\n", id);
 
-	if (id >= ACPU_PLL_END)
-		return -EINVAL;
+	drv_state.stats.pll_requests++;
 
 	if (pll_control) {
 		remote_spin_lock(&pll_lock);
@@ -409,10 +452,13 @@ static int pc_pll_request(unsigned id, unsigned on)
 			return -EINVAL;
 	}
 
-	if (on)
+	if (on) {
+		drv_state.pll_votes |= 1 << id;
 		dprintk("PLL enabled\n");
-	else
+	} else {
+		drv_state.pll_votes &= ~(1 << id);
 		dprintk("PLL disabled\n");
+	}
 
 	return res;
 }
@@ -451,9 +497,14 @@ static int acpuclk_set_vdd_level(int vdd)
 		return 0;
 
 	current_vdd = readl_relaxed(A11S_VDD_SVS_PLEVEL_ADDR) & 0x07;
+	if (current_vdd == vdd) {
+		drv_state.stats.vdd_switches_skipped++;
+		return 0;
+	}
 
 	dprintk("Switching VDD from %u mV -> %d mV\n",
 	       current_vdd, vdd);
+	drv_state.stats.vdd_switches++;
 
 	writel_relaxed((1 << 7) | (vdd << 3), A11S_VDD_SVS_PLEVEL_ADDR);
 	dsb();
@@ -468,6 +519,77 @@ static int acpuclk_set_vdd_level(int vdd)
 	return 0;
 }
 
+/*
+ * Raise VDD to at least the given level.  A level left over from a
+ * deferred drop, or one already restored by the modem, is good enough.
+ */
+static int acpuclk_raise_vdd_level(int vdd)
+{
+	uint32_t current_vdd;
+
+	current_vdd = readl_relaxed(A11S_VDD_SVS_PLEVEL_ADDR) & 0x07;
+	if (current_vdd >= vdd) {
+		drv_state.stats.vdd_switches_skipped++;
+		return 0;
+	}
+
+	return acpuclk_set_vdd_level(vdd);
+}
+
+/*
+ * Drop PLL votes and VDD that the current speed does not need.  Must be
+ * called with drv_state.lock held.
+ */
+static void acpuclk_release_unused(void)
+{
+	struct clkctl_acpu_speed *cur_s = drv_state.current_speed;
+	uint32_t current_vdd;
+	unsigned int pll;
+	int res;
+
+	for (pll = ACPU_PLL_0; pll < ACPU_PLL_END; pll++) {
+		if (pll == cur_s->pll || !(drv_state.pll_votes & (1 << pll)))
+			continue;
+		res = pc_pll_request(pll, 0);
+		if (res < 0)
+			pr_warning("PLL%d disable failed (%d)\n", pll, res);
+	}
+
+	current_vdd = readl_relaxed(A11S_VDD_SVS_PLEVEL_ADDR) & 0x07;
+	if (cur_s->vdd < current_vdd) {
+		res = acpuclk_set_vdd_level(cur_s->vdd);
+		if (res < 0)
+			pr_warning("Unable to drop ACPU vdd (%d)\n", res);
+	}
+}
+
+static void acpuclk_release_work(struct work_struct *work)
+{
+	mutex_lock(&drv_state.lock);
+	if (drv_state.current_speed)
+		acpuclk_release_unused();
+	mutex_unlock(&drv_state.lock);
+}
+
+static void acpuclk_account_switch(ktime_t start)
+{
+	struct clock_stats *st = &drv_state.stats;
+	uint32_t us;
+	int bucket;
+
+	us = ktime_to_us(ktime_sub(ktime_get(), start));
+
+	st->switches++;
+	st->switch_time_total_us += us;
+	if (us > st->switch_time_max_us)
+		st->switch_time_max_us = us;
+
+	bucket = us < 16 ? 0 : ilog2(us) - 3;
+	if (bucket > SWITCH_HIST_BUCKETS)
+		bucket = SWITCH_HIST_BUCKETS;
+	st->switch_hist[bucket]++;
+}
+
 /* Set proper dividers for the given clock speed. */
 static void acpuclk_set_div(const struct clkctl_acpu_speed *hunt_s)
 {
@@ -518,9 +640,12 @@ int acpuclk_set_rate(int cpu, unsigned long rate, enum setrate_reason reason)
 	struct clkctl_acpu_speed *cur_s, *tgt_s, *strt_s;
 	int res, rc = 0;
 	unsigned int plls_enabled = 0, pll;
+	ktime_t start = ktime_set(0, 0);
 
-	if (reason == SETRATE_CPUFREQ)
+	if (reason == SETRATE_CPUFREQ) {
 		mutex_lock(&drv_state.lock);
+		start = ktime_get();
+	}
 
 	strt_s = cur_s = drv_state.current_speed;
 
@@ -570,7 +695,7 @@ int acpuclk_set_rate(int cpu, unsigned long rate, enum setrate_reason reason)
 	if (reason == SETRATE_CPUFREQ || reason == SETRATE_PC) {
 		/* Increase VDD if needed. */
 		if (tgt_s->vdd > cur_s->vdd) {
-			rc = acpuclk_set_vdd_level(tgt_s->vdd);
+			rc = acpuclk_raise_vdd_level(tgt_s->vdd);
 			if (rc < 0) {
 				pr_err("Unable to switch ACPU vdd (%d)\n", rc);
 				goto out;
@@ -663,32 +788,41 @@ int acpuclk_set_rate(int cpu, unsigned long rate, enum setrate_reason reason)
 	if (reason == SETRATE_PC && !cpu_is_msm7x27())
 		goto out;
 
-	/* Disable PLLs we are not using anymore. */
-	if (tgt_s->pll != ACPU_PLL_TCXO)
-		plls_enabled &= ~(1 << tgt_s->pll);
-	for (pll = ACPU_PLL_0; pll < ACPU_PLL_END; pll++)
-		if (plls_enabled & (1 << pll)) {
-			res = pc_pll_request(pll, 0);
-			if (res < 0)
-				pr_warning("PLL%d disable failed (%d)\n",
-						pll, res);
-		}
+	/*
+	 * Disable PLLs we are not using anymore.  Going into power
+	 * collapse this includes votes still held back from earlier
+	 * cpufreq switches.
+	 */
+	if (reason == SETRATE_PC) {
+		plls_enabled |= drv_state.pll_votes;
+		if (tgt_s->pll != ACPU_PLL_TCXO)
+			plls_enabled &= ~(1 << tgt_s->pll);
+		for (pll = ACPU_PLL_0; pll < ACPU_PLL_END; pll++)
+			if (plls_enabled & (1 << pll)) {
+				res = pc_pll_request(pll, 0);
+				if (res < 0)
+					pr_warning("PLL%d disable failed "
+						   "(%d)\n", pll, res);
+			}
 
-	/* Nothing else to do for power collapse. */
-	if (reason == SETRATE_PC)
+		/* Nothing else to do for power collapse. */
 		goto out;
-
-	/* Drop VDD level if we can. */
-	if (tgt_s->vdd < strt_s->vdd) {
-		res = acpuclk_set_vdd_level(tgt_s->vdd);
-		if (res < 0)
-			pr_warning("Unable to drop ACPU vdd (%d)\n", res);
 	}
 
+	/* Release PLLs and drop VDD level once the new speed has stuck. */
+	if (pll_release_delay_ms)
+		schedule_delayed_work(&release_work,
+				      msecs_to_jiffies(pll_release_delay_ms));
+	else
+		acpuclk_release_unused();
+
 	dprintk("ACPU speed change complete\n");
 out:
-	if (reason == SETRATE_CPUFREQ)
+	if (reason == SETRATE_CPUFREQ) {
+		if (!rc && strt_s != drv_state.current_speed)
+			acpuclk_account_switch(start);
 		mutex_unlock(&drv_state.lock);
+	}
 	return rc;
 }
 
@@ -1031,3 +1165,56 @@ void __init msm_acpu_clock_init(struct msm_acpu_clock_platform_data *clkdata)
 	cpufreq_frequency_table_get_attr(freq_table, smp_processor_id());
 #endif
 }
+
+#ifdef CONFIG_DEBUG_FS
+static int acpuclk_stats_show(struct seq_file *m, void *unused)
+{
+	struct clock_stats *st = &drv_state.stats;
+	uint64_t avg;
+	int i;
+
+	mutex_lock(&drv_state.lock);
+
+	avg = st->switch_time_total_us;
+	if (st->switches)
+		do_div(avg, st->switches);
+
+	seq_printf(m, "pll_votes: 0x%x\n", drv_state.pll_votes);
+	seq_printf(m, "pll_requests: %lu (%lu cached)\n",
+		   st->pll_requests, st->pll_requests_cached);
+	seq_printf(m, "vdd_switches: %lu (%lu skipped)\n",
+		   st->vdd_switches, st->vdd_switches_skipped);
+	seq_printf(m, "switches: %lu avg_us: %llu max_us: %u\n",
+		   st->switches, (unsigned long long)avg,
+		   st->switch_time_max_us);
+
+	for (i = 0; i < SWITCH_HIST_BUCKETS; i++)
+		seq_printf(m, "  < %5u us: %lu\n", 1 << (i + 4),
+			   st->switch_hist[i]);
+	seq_printf(m, "  >=%5u us: %lu\n", 1 << (SWITCH_HIST_BUCKETS + 3),
+		   st->switch_hist[SWITCH_HIST_BUCKETS]);
+
+	mutex_unlock(&drv_state.lock);
+	return 0;
+}
+
+static int acpuclk_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, acpuclk_stats_show, inode->i_private);
+}
+
+static const struct file_operations acpuclk_stats_fops = {
+	.open		= acpuclk_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init acpuclk_debug_init(void)
+{
+	debugfs_create_file("acpuclk_stats", S_IRUGO, NULL, NULL,
+			    &acpuclk_stats_fops);
+	return 0;
+}
+late_initcall(acpuclk_debug_init);
+#endif
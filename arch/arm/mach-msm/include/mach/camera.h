@@ -337,6 +337,23 @@ struct msm_device_queue {
 	const char *name;
 };
 
+#define MSM_PMEM_HASH_BITS 4
+#define MSM_PMEM_HASH_SIZE (1 << MSM_PMEM_HASH_BITS)
+
+#define MSM_FRAME_LATENCY_BUCKETS 6
+
+/* Delivery statistics for preview frames, from VFE frame done until the
+ * frame thread picks the frame up in MSM_CAM_IOCTL_GETFRAME.
+ */
+struct msm_frame_stats {
+	uint32_t frames;
+	uint32_t ptov_misses;
+	uint32_t vtop_misses;
+	uint64_t total_us;
+	uint32_t max_us;
+	uint32_t hist[MSM_FRAME_LATENCY_BUCKETS];
+};
+
 struct msm_sync {
 	/* These two queues are accessed from a process context only
 	 * They contain pmem descriptors for the preview frames and the stats
@@ -345,6 +362,15 @@ struct msm_sync {
 	struct hlist_head pmem_frames;
 	struct hlist_head pmem_stats;
 
+	/* pmem_frames hashed by the physical address of the Y plane (what
+	 * the VFE reports on frame done) and by the user virtual address
+	 * (what userspace hands back on release), so that the per-frame
+	 * lookups do not walk every registered buffer.  Protected by
+	 * pmem_frame_spinlock.
+	 */
+	struct hlist_head pmem_frames_phash[MSM_PMEM_HASH_SIZE];
+	struct hlist_head pmem_frames_vhash[MSM_PMEM_HASH_SIZE];
+
 	/* The message queue is used by the control thread to send commands
 	 * to the config thread, and also by the DSP to send messages to the
 	 * config thread.  Thus it is the only queue that is accessed from
@@ -406,10 +432,24 @@ struct msm_sync {
 	spinlock_t pmem_frame_spinlock;
 	spinlock_t pmem_stats_spinlock;
 	spinlock_t abort_pict_lock;
+	spinlock_t frame_stats_lock;
 	int snap_count;
 	int thumb_count;
 	void *st_quality_ind;
 	int st_quality_ind_len;
+
+	struct msm_frame_stats frame_stats;
+	struct dentry *debugfs_dir;
+
+	/* Optional frame ring shared with the frame thread, see
+	 * MSM_CAM_IOCTL_FRAME_RING_SETUP.  frame_ring_work moves frames from
+	 * frame_q into the ring and returns released buffers to the VFE.
+	 */
+	struct msm_frame_ring *frame_ring;
+	dma_addr_t frame_ring_dma;
+	struct eventfd_ctx *frame_ring_evt;
+	struct work_struct frame_ring_work;
+	struct mutex frame_ring_lock;
 };
 
 #define MSM_APPS_ID_V4L2 "msm_v4l2"
@@ -446,6 +486,9 @@ struct register_address_value_pair {
 
 struct msm_pmem_region {
 	struct hlist_node list;
+	/* frame regions only: links into pmem_frames_phash/vhash */
+	struct hlist_node pnode;
+	struct hlist_node vnode;
 	unsigned long paddr;
 	unsigned long len;
 	struct file *file;
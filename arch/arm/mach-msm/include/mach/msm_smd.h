@@ -109,6 +109,15 @@ void smd_enable_read_intr(smd_channel_t *ch);
  */
 void smd_disable_read_intr(smd_channel_t *ch);
 
+/* Deliver SMD_EVENT_DATA and SMD_EVENT_STATUS for this channel from a
+ * per-channel work item instead of the smd interrupt handler, so a busy
+ * channel does not extend the irq-off time of the others.  notify() is
+ * then called in process context without smd internal locks held, so
+ * smd_read_from_cb() must not be used from it.  Open and close events are
+ * still delivered from the interrupt handler.
+ */
+void smd_enable_deferred_notify(smd_channel_t *ch);
+
 /* cleanup smd ports required during modem restart */
 void smd_channel_reset(void);
 
@@ -155,4 +164,33 @@ int smd_write_segment(smd_channel_t *ch, void *data, int len, int user_buf);
  */
 int smd_write_end(smd_channel_t *ch);
 
+/* Zero-copy access to the receive fifo.  The pointers returned point
+ * directly into shared memory and are only valid until the matching
+ * commit call.  Readers must serialize their own access, as with
+ * smd_read().
+ */
+
+/* Returns the length of the contiguous readable chunk starting @offset
+ * bytes past the read pointer and points @ptr at it.  On packet channels
+ * the chunk never crosses the end of the current packet.  A packet may
+ * wrap around the end of the fifo, so callers walk it by advancing
+ * @offset, and consume it with a single smd_read_commit() once done.
+ *
+ * Returns:
+ *      number of bytes available at @offset (0 at the end)
+ *      -ENODEV - invalid smd channel
+ *      -EINVAL - @offset past the readable data
+ */
+int smd_read_peek(smd_channel_t *ch, int offset, void **ptr);
+
+/* Consumes @len bytes from the read pointer, which may span several
+ * chunks returned by smd_read_peek().
+ *
+ * Returns:
+ *      number of bytes consumed
+ *      -ENODEV - invalid smd channel
+ *      -EINVAL - @len larger than the readable data
+ */
+int smd_read_commit(smd_channel_t *ch, int len);
+
 #endif
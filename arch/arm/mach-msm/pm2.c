@@ -639,6 +639,161 @@ void msm_pm_set_max_sleep_time(int64_t max_sleep_time_ns)
 EXPORT_SYMBOL(msm_pm_set_max_sleep_time);
 
 
+/******************************************************************************
+ * Idle Length Prediction
+ *****************************************************************************/
+
+/*
+ * The next timer event only bounds how long the CPU will stay idle;
+ * interrupts from touch, network or the modem often end it much sooner.
+ * As in the cpuidle menu governor, the timer estimate is scaled by a
+ * correction factor learnt per range of timer lengths, and a repeating
+ * pattern in the most recent idle periods overrides it.  The prediction
+ * is only used to pick the sleep mode; the modem is still told about the
+ * real next timer.
+ */
+static int msm_pm_idle_predict = 1;
+module_param_named(
+	idle_predict, msm_pm_idle_predict,
+	int, S_IRUGO | S_IWUSR | S_IWGRP
+);
+
+#define MSM_PM_PRED_BUCKETS		6
+#define MSM_PM_PRED_INTERVALS		8
+#define MSM_PM_PRED_RESOLUTION		1024
+#define MSM_PM_PRED_DECAY		8
+#define MSM_PM_PRED_UNITY		(MSM_PM_PRED_RESOLUTION * MSM_PM_PRED_DECAY)
+/* keeps the variance arithmetic in 64 bits */
+#define MSM_PM_PRED_MAX_US		(1U << 26)
+
+static struct msm_pm_predictor {
+	uint32_t correction[MSM_PM_PRED_BUCKETS];
+	uint32_t intervals[MSM_PM_PRED_INTERVALS];
+	int interval_ptr;
+	int interval_cnt;
+	int bucket;
+	uint32_t expected_us;
+} msm_pm_pred = {
+	.correction = {
+		[0 ... MSM_PM_PRED_BUCKETS - 1] = MSM_PM_PRED_UNITY,
+	},
+};
+
+static int msm_pm_pred_bucket(uint32_t us)
+{
+	int bucket = 0;
+
+	while (bucket < MSM_PM_PRED_BUCKETS - 1 && us >= 10) {
+		us /= 10;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+/*
+ * Return the average of the recent idle periods if they are close enough
+ * to each other to be taken as a pattern, otherwise UINT_MAX.  Until the
+ * history is full there is no pattern to find.
+ */
+static uint32_t msm_pm_pred_typical_interval(void)
+{
+	uint64_t avg = 0, variance = 0;
+	int64_t diff;
+	int i;
+
+	if (msm_pm_pred.interval_cnt < MSM_PM_PRED_INTERVALS)
+		return UINT_MAX;
+
+	for (i = 0; i < MSM_PM_PRED_INTERVALS; i++)
+		avg += msm_pm_pred.intervals[i];
+	do_div(avg, MSM_PM_PRED_INTERVALS);
+
+	for (i = 0; i < MSM_PM_PRED_INTERVALS; i++) {
+		diff = (int64_t)msm_pm_pred.intervals[i] - (int64_t)avg;
+		variance += diff * diff;
+	}
+	do_div(variance, MSM_PM_PRED_INTERVALS);
+
+	/* stddev within 20us, or within a sixth of the average */
+	if (variance <= 400 || avg * avg > 36 * variance)
+		return (uint32_t)avg;
+
+	return UINT_MAX;
+}
+
+/*
+ * Predict how long the coming idle period will last, in nanoseconds,
+ * given the time until the next timer event.
+ */
+static int64_t msm_pm_predict_idle(int64_t timer_expiration)
+{
+	uint64_t predicted;
+	uint32_t typical;
+	int64_t expected = timer_expiration;
+
+	do_div(expected, NSEC_PER_USEC);
+	if (expected > UINT_MAX)
+		expected = UINT_MAX;
+	msm_pm_pred.expected_us = (uint32_t)expected;
+	msm_pm_pred.bucket = msm_pm_pred_bucket(msm_pm_pred.expected_us);
+
+	if (!msm_pm_idle_predict)
+		return timer_expiration;
+
+	predicted = (uint64_t)msm_pm_pred.expected_us *
+		msm_pm_pred.correction[msm_pm_pred.bucket];
+	do_div(predicted, MSM_PM_PRED_UNITY);
+
+	typical = msm_pm_pred_typical_interval();
+	if (typical < predicted)
+		predicted = typical;
+
+	return (int64_t)predicted * NSEC_PER_USEC;
+}
+
+/*
+ * Feed the length of the idle period that just ended back into the
+ * predictor.
+ */
+static void msm_pm_predict_update(int64_t idle_ns)
+{
+	struct msm_pm_predictor *pred = &msm_pm_pred;
+	uint32_t measured_us;
+	uint64_t factor;
+
+	do_div(idle_ns, NSEC_PER_USEC);
+	measured_us = idle_ns > UINT_MAX ? UINT_MAX : (uint32_t)idle_ns;
+
+	/* The timer bounds the idle period; overshoot is exit latency. */
+	if (measured_us > pred->expected_us)
+		measured_us = pred->expected_us;
+
+	factor = pred->correction[pred->bucket];
+	factor -= factor / MSM_PM_PRED_DECAY;
+	if (pred->expected_us > 0) {
+		uint64_t ratio = (uint64_t)MSM_PM_PRED_RESOLUTION * measured_us;
+
+		do_div(ratio, pred->expected_us);
+		factor += ratio;
+	} else {
+		factor += MSM_PM_PRED_RESOLUTION;
+	}
+
+	/* Never let the factor reach zero, the bucket would be stuck. */
+	if (factor == 0)
+		factor = 1;
+	pred->correction[pred->bucket] = (uint32_t)factor;
+
+	pred->intervals[pred->interval_ptr++] =
+		min(measured_us, MSM_PM_PRED_MAX_US);
+	if (pred->interval_ptr >= MSM_PM_PRED_INTERVALS)
+		pred->interval_ptr = 0;
+	if (pred->interval_cnt < MSM_PM_PRED_INTERVALS)
+		pred->interval_cnt++;
+}
+
+
 /******************************************************************************
  * CONFIG_MSM_IDLE_STATS
  *****************************************************************************/
@@ -657,6 +812,8 @@ enum msm_pm_time_stats_id {
 	MSM_PM_STAT_SUSPEND,
 	MSM_PM_STAT_FAILED_SUSPEND,
 	MSM_PM_STAT_NOT_IDLE,
+	MSM_PM_STAT_IDLE_TOO_DEEP,
+	MSM_PM_STAT_IDLE_TOO_SHALLOW,
 	MSM_PM_STAT_COUNT
 };
 
@@ -719,6 +876,16 @@ static struct msm_pm_time_stats {
 	[MSM_PM_STAT_NOT_IDLE].name = "not-idle",
 	[MSM_PM_STAT_NOT_IDLE].first_bucket_time =
 		CONFIG_MSM_IDLE_STATS_FIRST_BUCKET,
+
+	/* power collapse entered, but woken before its residency */
+	[MSM_PM_STAT_IDLE_TOO_DEEP].name = "idle-mispredict-too-deep",
+	[MSM_PM_STAT_IDLE_TOO_DEEP].first_bucket_time =
+		CONFIG_MSM_IDLE_STATS_FIRST_BUCKET,
+
+	/* power collapse ruled out by the prediction, but idle long enough */
+	[MSM_PM_STAT_IDLE_TOO_SHALLOW].name = "idle-mispredict-too-shallow",
+	[MSM_PM_STAT_IDLE_TOO_SHALLOW].first_bucket_time =
+		CONFIG_MSM_IDLE_STATS_FIRST_BUCKET,
 };
 
 static uint32_t msm_pm_sleep_limit = SLEEP_LIMIT_NONE;
@@ -1390,6 +1557,9 @@ void arch_idle(void)
 
 	int latency_qos;
 	int64_t timer_expiration;
+	int64_t predicted;
+	int64_t idle_start, idle_time;
+	struct msm_pm_platform_data *pc_mode;
 
 	int low_power;
 	int ret;
@@ -1399,6 +1569,7 @@ void arch_idle(void)
 	int64_t t1;
 	static int64_t t2;
 	int exit_stat;
+	bool pc_deferred = false;
 #endif /* CONFIG_MSM_IDLE_STATS */
 
 	if (!atomic_read(&msm_pm_init_done))
@@ -1406,6 +1577,9 @@ void arch_idle(void)
 
 	latency_qos = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
 	timer_expiration = msm_timer_enter_idle();
+	predicted = msm_pm_predict_idle(timer_expiration);
+	idle_start = ktime_to_ns(ktime_get());
+	pc_mode = &msm_pm_modes[MSM_PM_SLEEP_MODE_POWER_COLLAPSE];
 
 #ifdef CONFIG_MSM_IDLE_STATS
 	t1 = ktime_to_ns(ktime_get());
@@ -1444,7 +1618,26 @@ void arch_idle(void)
 		goto arch_idle_exit;
 	}
 
-	if ((timer_expiration < msm_pm_idle_sleep_min_time) ||
+#ifdef CONFIG_MSM_IDLE_STATS
+	/*
+	 * Remember whether power collapse is ruled out by the prediction
+	 * alone, so a prediction that turns out too short can be counted.
+	 */
+	pc_deferred = predicted < timer_expiration &&
+		allow[MSM_PM_SLEEP_MODE_POWER_COLLAPSE] &&
+		pc_mode->supported && pc_mode->idle_enabled &&
+		pc_mode->latency < latency_qos &&
+		timer_expiration >= msm_pm_idle_sleep_min_time &&
+		pc_mode->residency * 1000ULL < timer_expiration &&
+		(predicted < msm_pm_idle_sleep_min_time ||
+		 pc_mode->residency * 1000ULL >= predicted) &&
+#ifdef CONFIG_HAS_WAKELOCK
+		!has_wake_lock(WAKE_LOCK_IDLE) &&
+#endif
+		msm_irq_idle_sleep_allowed();
+#endif /* CONFIG_MSM_IDLE_STATS */
+
+	if ((predicted < msm_pm_idle_sleep_min_time) ||
 #ifdef CONFIG_HAS_WAKELOCK
 		has_wake_lock(WAKE_LOCK_IDLE) ||
 #endif
@@ -1458,7 +1651,7 @@ void arch_idle(void)
 		struct msm_pm_platform_data *mode = &msm_pm_modes[i];
 		if (!mode->supported || !mode->idle_enabled ||
 			mode->latency >= latency_qos ||
-			mode->residency * 1000ULL >= timer_expiration)
+			mode->residency * 1000ULL >= predicted)
 			allow[i] = false;
 	}
 
@@ -1572,9 +1765,19 @@ void arch_idle(void)
 arch_idle_exit:
 	msm_timer_exit_idle(low_power);
 
+	idle_time = ktime_to_ns(ktime_get()) - idle_start;
+	msm_pm_predict_update(idle_time);
+
 #ifdef CONFIG_MSM_IDLE_STATS
 	t2 = ktime_to_ns(ktime_get());
 	msm_pm_add_stat(exit_stat, t2 - t1);
+
+	if ((exit_stat == MSM_PM_STAT_IDLE_POWER_COLLAPSE ||
+	     exit_stat == MSM_PM_STAT_IDLE_STANDALONE_POWER_COLLAPSE) &&
+	    idle_time < pc_mode->residency * 1000LL)
+		msm_pm_add_stat(MSM_PM_STAT_IDLE_TOO_DEEP, idle_time);
+	else if (pc_deferred && idle_time >= pc_mode->residency * 1000LL)
+		msm_pm_add_stat(MSM_PM_STAT_IDLE_TOO_SHALLOW, idle_time);
 #endif /* CONFIG_MSM_IDLE_STATS */
 }
 
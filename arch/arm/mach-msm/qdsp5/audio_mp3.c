@@ -30,6 +30,7 @@
 #include <linux/list.h>
 #include <linux/android_pmem.h>
 #include <linux/slab.h>
+#include <linux/workqueue.h>
 #include <asm/atomic.h>
 #include <asm/ioctls.h>
 #include <mach/msm_adsp.h>
@@ -56,6 +57,12 @@
 #define DMASZ_MAX (BUFSZ_MAX * 2)
 #define DMASZ_MIN (BUFSZ_MIN * 2)
 
+/* Offload mode: AUDIO_SET_CONFIG with a buffer_size above BUFSZ_MAX.
+ * Writes are staged until a whole buffer is full, so the DSP asks for
+ * data (and wakes the writer) once per buffer rather than once per write.
+ */
+#define BUFSZ_OFFLOAD_MAX 131072
+
 #define AUDPLAY_INVALID_READ_PTR_OFFSET	0xFFFF
 #define AUDDEC_DEC_MP3 2
 
@@ -242,6 +249,21 @@ struct audio {
 	int eq_needs_commit;
 	audpp_cmd_cfg_object_params_eqalizer eq;
 	audpp_cmd_cfg_object_params_volume vol_pan;
+
+	int offload;
+	unsigned out_fill; /* bytes staged in out[out_head], offload mode */
+	struct work_struct offload_work;
+	uint8_t track_end; /* mask of out[] buffers that end a track */
+	unsigned track_cookie[2];
+
+	/* wakeup accounting, see audmp3_debug_read() */
+	unsigned dsp_events;
+	unsigned data_requests;
+	unsigned writes;
+	unsigned write_sleeps;
+	unsigned starved;
+	unsigned long play_start;
+	unsigned long play_jiffies;
 };
 
 static int auddec_dsp_config(struct audio *audio, int enable);
@@ -457,9 +479,11 @@ static void audplay_dsp_event(void *data, unsigned id, size_t len,
 	getevent(msg, sizeof(msg));
 
 	MM_DBG("msg_id=%x\n", id);
+	audio->dsp_events++;
 
 	switch (id) {
 	case AUDPLAY_MSG_DEC_NEEDS_DATA:
+		audio->data_requests++;
 		audio->drv_ops.send_data(audio, 1);
 		break;
 
@@ -481,6 +505,7 @@ static void audio_dsp_event(void *private, unsigned id, uint16_t *msg)
 {
 	struct audio *audio = private;
 
+	audio->dsp_events++;
 	switch (id) {
 	case AUDPP_MSG_STATUS_MSG:{
 			unsigned status = msg[1];
@@ -537,6 +562,7 @@ static void audio_dsp_event(void *private, unsigned id, uint16_t *msg)
 			auddec_dsp_config(audio, 1);
 			audio->out_needed = 0;
 			audio->running = 1;
+			audio->play_start = jiffies;
 			audpp_dsp_set_vol_pan(audio->dec_id, &audio->vol_pan);
 			audpp_dsp_set_eq(audio->dec_id, audio->eq_enable,
 								&audio->eq);
@@ -544,6 +570,9 @@ static void audio_dsp_event(void *private, unsigned id, uint16_t *msg)
 		} else if (msg[0] == AUDPP_MSG_ENA_DIS) {
 			MM_DBG("CFG_MSG DISABLE\n");
 			audpp_avsync(audio->dec_id, 0);
+			if (audio->running)
+				audio->play_jiffies +=
+					jiffies - audio->play_start;
 			audio->running = 0;
 		} else {
 			MM_DBG("CFG_MSG %d?\n", msg[0]);
@@ -775,6 +804,20 @@ done:
 	spin_unlock_irqrestore(&audio->dsp_lock, flags);
 }
 
+/* Caller holds dsp_lock */
+static void audmp3_track_done(struct audio *audio, unsigned idx)
+{
+	union msm_audio_event_payload payload;
+
+	if (!(audio->track_end & (1 << idx)))
+		return;
+
+	audio->track_end &= ~(1 << idx);
+	memset(&payload, 0, sizeof(payload));
+	payload.reserved = audio->track_cookie[idx];
+	audmp3_post_event(audio, AUDIO_EVENT_TRACK_DONE, payload);
+}
+
 static void audplay_send_data(struct audio *audio, unsigned needed)
 {
 	struct buffer *frame;
@@ -796,6 +839,7 @@ static void audplay_send_data(struct audio *audio, unsigned needed)
 		if (frame->used == 0xffffffff) {
 			MM_DBG("frame %d free\n", audio->out_tail);
 			frame->used = 0;
+			audmp3_track_done(audio, audio->out_tail);
 			audio->out_tail ^= 1;
 			wake_up(&audio->write_wait);
 		}
@@ -819,6 +863,15 @@ static void audplay_send_data(struct audio *audio, unsigned needed)
 		  audio->out_needed = 0;
 		}
 	}
+
+	if (needed && audio->out_needed) {
+		/* The DSP is starving; in offload mode hand it whatever
+		 * is staged rather than wait for a full buffer.
+		 */
+		audio->starved++;
+		if (audio->offload && audio->out_fill)
+			schedule_work(&audio->offload_work);
+	}
 done:
 	spin_unlock_irqrestore(&audio->dsp_lock, flags);
 }
@@ -850,11 +903,50 @@ static void audio_flush(struct audio *audio)
 	audio->out[1].used = 0;
 	audio->out_head = 0;
 	audio->out_tail = 0;
+	audio->out_fill = 0;
+	audio->track_end = 0;
 	audio->reserved = 0;
 	audio->out_needed = 0;
 	atomic_set(&audio->out_bytes, 0);
 }
 
+/* Hand the data staged in out[out_head] to the DSP.  An odd trailing
+ * byte is held back for the next buffer, as audio_write() does.
+ * Caller holds write_lock.
+ */
+static void audmp3_offload_commit(struct audio *audio)
+{
+	struct buffer *frame = audio->out + audio->out_head;
+	unsigned len = audio->out_fill;
+
+	if (!len)
+		return;
+
+	if (len & 1) {
+		audio->rsv_byte = ((char *) frame->data)[len - 1];
+		audio->reserved = 1;
+		len--;
+	}
+	audio->out_fill = 0;
+	if (!len)
+		return;
+
+	frame->mfield_sz = 0;
+	audio->out_head ^= 1;
+	frame->used = len;
+	audio->drv_ops.send_data(audio, 0);
+}
+
+static void audmp3_offload_work(struct work_struct *work)
+{
+	struct audio *audio = container_of(work, struct audio, offload_work);
+
+	mutex_lock(&audio->write_lock);
+	if (audio->out_needed)
+		audmp3_offload_commit(audio);
+	mutex_unlock(&audio->write_lock);
+}
+
 static void audmp3_async_flush_pcm_buf(struct audio *audio)
 {
 	struct audmp3_buffer_node *buf_node;
@@ -1252,6 +1344,83 @@ static int audio_enable_eq(struct audio *audio, int enable)
 	return 0;
 }
 
+/* must be called with audio->lock held */
+static int audmp3_set_offload(struct audio *audio, unsigned size)
+{
+	unsigned pmem_sz;
+	int32_t phys = 0;
+	char *data = NULL;
+
+	if (audio->drv_status & ADRV_STATUS_AIO_INTF)
+		return -EINVAL;
+	if (audio->enabled)
+		return -EBUSY;
+
+	size = roundup_pow_of_two(min_t(unsigned, size, BUFSZ_OFFLOAD_MAX));
+	for (pmem_sz = size * 2; pmem_sz > audio->out_dma_sz; pmem_sz >>= 1) {
+		phys = pmem_kalloc(pmem_sz, PMEM_MEMTYPE_EBI1|
+					PMEM_ALIGNMENT_4K);
+		if (IS_ERR((void *)phys))
+			continue;
+		data = ioremap(phys, pmem_sz);
+		if (data)
+			break;
+		pmem_kfree(phys);
+	}
+	if (!data) {
+		MM_ERR("no memory for %d byte offload buffers\n", size);
+		return audio->offload ? 0 : -ENOMEM;
+	}
+
+	mutex_lock(&audio->write_lock);
+	iounmap(audio->data);
+	pmem_kfree(audio->phys);
+	audio->data = data;
+	audio->phys = phys;
+	audio->out_dma_sz = pmem_sz;
+
+	audio->out[0].data = audio->data + 0;
+	audio->out[0].addr = audio->phys + 0;
+	audio->out[0].size = (audio->out_dma_sz >> 1);
+
+	audio->out[1].data = audio->data + audio->out[0].size;
+	audio->out[1].addr = audio->phys + audio->out[0].size;
+	audio->out[1].size = audio->out[0].size;
+
+	audio->offload = 1;
+	audio->drv_ops.out_flush(audio);
+	mutex_unlock(&audio->write_lock);
+
+	MM_DBG("offload buffers %d bytes\n", audio->out_dma_sz);
+	return 0;
+}
+
+/* must be called with audio->lock held */
+static int audmp3_track_end(struct audio *audio, unsigned cookie)
+{
+	unsigned long flags;
+	unsigned idx;
+
+	if (audio->drv_status & ADRV_STATUS_AIO_INTF)
+		return -EPERM;
+
+	mutex_lock(&audio->write_lock);
+	audmp3_offload_commit(audio);
+
+	spin_lock_irqsave(&audio->dsp_lock, flags);
+	/* the last buffer queued carries the end of the track */
+	idx = audio->out_head ^ 1;
+	audmp3_track_done(audio, idx);
+	audio->track_end |= 1 << idx;
+	audio->track_cookie[idx] = cookie;
+	if (!audio->out[idx].used)
+		audmp3_track_done(audio, idx);
+	spin_unlock_irqrestore(&audio->dsp_lock, flags);
+
+	mutex_unlock(&audio->write_lock);
+	return 0;
+}
+
 static long audio_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct audio *audio = file->private_data;
@@ -1396,6 +1565,17 @@ static long audio_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			rc = -EINVAL;
 			break;
 		}
+		if (config.meta_field && (audio->offload ||
+				config.buffer_size > BUFSZ_MAX)) {
+			/* offload mode stages writes without meta fields */
+			rc = -EINVAL;
+			break;
+		}
+		if (config.buffer_size > BUFSZ_MAX) {
+			rc = audmp3_set_offload(audio, config.buffer_size);
+			if (rc)
+				break;
+		}
 		audio->mfield = config.meta_field;
 		audio->out_sample_rate = config.sample_rate;
 		audio->out_channel_mode = config.channel_count;
@@ -1514,6 +1694,10 @@ static long audio_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			}
 			break;
 		}
+	case AUDIO_TRACK_END:
+		rc = audmp3_track_end(audio, arg);
+		break;
+
 	case AUDIO_PAUSE:
 		MM_DBG("AUDIO_PAUSE %ld\n", arg);
 		rc = audpp_pause(audio->dec_id, (int) arg);
@@ -1602,6 +1786,7 @@ int audmp3_sync_fsync(struct audio *audio)
 	MM_DBG("\n"); /* Macro prints the file name and function */
 
 	mutex_lock(&audio->write_lock);
+	audmp3_offload_commit(audio);
 
 	rc = wait_event_interruptible(audio->write_wait,
 		(!audio->out[0].used &&
@@ -1803,6 +1988,61 @@ done:
 	return rc;
 }
 
+/* Caller holds write_lock */
+static ssize_t audmp3_offload_write(struct audio *audio,
+		const char __user *buf, size_t count)
+{
+	const char __user *start = buf;
+	struct buffer *frame;
+	size_t xfer;
+	int rc = 0;
+
+	while (count > 0) {
+		frame = audio->out + audio->out_head;
+		if (frame->used && !audio->stopped && !audio->wflush)
+			audio->write_sleeps++;
+		rc = wait_event_interruptible(audio->write_wait,
+					      (frame->used == 0)
+					      || (audio->stopped)
+					      || (audio->wflush));
+		if (rc < 0)
+			break;
+		if (audio->stopped || audio->wflush) {
+			rc = -EBUSY;
+			break;
+		}
+
+		if (audio->reserved && !audio->out_fill) {
+			((char *) frame->data)[0] = audio->rsv_byte;
+			audio->out_fill = 1;
+			audio->reserved = 0;
+		}
+
+		xfer = min_t(size_t, count, frame->size - audio->out_fill);
+		if (copy_from_user((char *) frame->data + audio->out_fill,
+				   buf, xfer)) {
+			rc = -EFAULT;
+			break;
+		}
+		audio->out_fill += xfer;
+		count -= xfer;
+		buf += xfer;
+
+		if (audio->out_fill == frame->size)
+			audmp3_offload_commit(audio);
+	}
+
+	/* don't keep a waiting DSP until the staged buffer fills up */
+	if (audio->out_needed)
+		audmp3_offload_commit(audio);
+
+	if (!rc) {
+		if (buf > start)
+			return buf - start;
+	}
+	return rc;
+}
+
 static ssize_t audio_write(struct file *file, const char __user *buf,
 			   size_t count, loff_t *pos)
 {
@@ -1821,10 +2061,18 @@ static ssize_t audio_write(struct file *file, const char __user *buf,
 	MM_DBG("cnt=%d\n", count);
 
 	mutex_lock(&audio->write_lock);
+	audio->writes++;
+	if (audio->offload) {
+		rc = audmp3_offload_write(audio, buf, count);
+		mutex_unlock(&audio->write_lock);
+		return rc;
+	}
 	while (count > 0) {
 		frame = audio->out + audio->out_head;
 		cpy_ptr = frame->data;
 		dsize = 0;
+		if (frame->used && !audio->stopped && !audio->wflush)
+			audio->write_sleeps++;
 		rc = wait_event_interruptible(audio->write_wait,
 					      (frame->used == 0)
 					      || (audio->stopped)
@@ -1942,6 +2190,7 @@ static int audio_release(struct inode *inode, struct file *file)
 	MM_INFO("audio instance 0x%08x freeing\n", (int)audio);
 	mutex_lock(&audio->lock);
 	audio_disable(audio);
+	cancel_work_sync(&audio->offload_work);
 	if (audio->rmt_resource_released == 0)
 		rmt_put_resource(audio);
 	audio->drv_ops.out_flush(audio);
@@ -2040,6 +2289,8 @@ static ssize_t audmp3_debug_read(struct file *file, char __user *buf,
 	static char buffer[4096];
 	int n = 0, i;
 	struct audio *audio = file->private_data;
+	unsigned long play;
+	unsigned play_ms;
 
 	mutex_lock(&audio->lock);
 	n = scnprintf(buffer, debug_bufmax, "opened %d\n", audio->opened);
@@ -2061,7 +2312,32 @@ static ssize_t audmp3_debug_read(struct file *file, char __user *buf,
 				   "sample rate %d \n", audio->out_sample_rate);
 	n += scnprintf(buffer + n, debug_bufmax - n,
 		"channel mode %d \n", audio->out_channel_mode);
+	n += scnprintf(buffer + n, debug_bufmax - n,
+				   "offload %d\n", audio->offload);
 	mutex_unlock(&audio->lock);
+	/* Wakeups during playback: DSP messages each interrupt the apps
+	 * processor and every write_sleep is a writer woken for more data.
+	 */
+	play = audio->play_jiffies;
+	if (audio->running)
+		play += jiffies - audio->play_start;
+	play_ms = jiffies_to_msecs(play);
+	n += scnprintf(buffer + n, debug_bufmax - n,
+				   "dsp_events %u\n", audio->dsp_events);
+	n += scnprintf(buffer + n, debug_bufmax - n,
+				   "data_requests %u\n", audio->data_requests);
+	n += scnprintf(buffer + n, debug_bufmax - n,
+				   "writes %u\n", audio->writes);
+	n += scnprintf(buffer + n, debug_bufmax - n,
+				   "write_sleeps %u\n", audio->write_sleeps);
+	n += scnprintf(buffer + n, debug_bufmax - n,
+				   "starved %u\n", audio->starved);
+	n += scnprintf(buffer + n, debug_bufmax - n,
+				   "play_ms %u\n", play_ms);
+	n += scnprintf(buffer + n, debug_bufmax - n,
+		"wakeups_per_min %llu\n", play_ms ?
+		div_u64((u64)(audio->dsp_events + audio->write_sleeps) *
+			60000, play_ms) : 0);
 	/* Following variables are only useful for debugging when
 	 * when playback halts unexpectedly. Thus, no mutual exclusion
 	 * enforced
@@ -2259,6 +2535,7 @@ static int audio_open(struct inode *inode, struct file *file)
 	init_waitqueue_head(&audio->wait);
 	init_waitqueue_head(&audio->event_wait);
 	spin_lock_init(&audio->event_queue_lock);
+	INIT_WORK(&audio->offload_work, audmp3_offload_work);
 
 	audio->out_sample_rate = 44100;
 	audio->out_channel_mode = AUDPP_CMD_PCM_INTF_STEREO_V;
@@ -26,6 +26,8 @@
 #include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/wakelock.h>
+#include <linux/poll.h>
+#include <linux/workqueue.h>
 
 #include <linux/msm_audio.h>
 
@@ -93,7 +95,9 @@ module_init(_pcm_log_init);
 
 
 #define BUFSZ (960 * 5)
-#define DMASZ (BUFSZ * 2)
+#define BUFSZ_MIN 512
+#define BUFSZ_MAX 32768
+#define BUFCNT_MAX 16
 
 #define COMMON_OBJ_ID 6
 
@@ -105,13 +109,25 @@ struct buffer {
 };
 
 struct audio {
-	struct buffer out[2];
+	/* ring of out_count periods filled by write() or through mmap */
+	struct buffer out[BUFCNT_MAX];
+
+	/* The dsp only knows two buffers, whose addresses are fixed when
+	 * the pcm interface is enabled.  With two periods these are out[0]
+	 * and out[1] themselves; with more, refill_work copies periods into
+	 * them as the dsp frees them.
+	 */
+	struct buffer slot[2];
+	struct work_struct refill_work;
 
 	spinlock_t dsp_lock;
 
 	uint8_t out_head;
 	uint8_t out_tail;
+	uint8_t out_slot; /* next dsp buffer to fill */
 	uint8_t out_needed; /* number of buffers the dsp is waiting for */
+	uint8_t out_primed; /* periods loaded by audio_prime_slots() */
+	unsigned out_count;
 
 	atomic_t out_bytes;
 
@@ -130,6 +146,8 @@ struct audio {
 	/* data allocated for various buffers */
 	char *data;
 	dma_addr_t phys;
+	size_t dma_size;
+	int mapped;
 
 	int teos; /* valid only if tunnel mode & no data left for decoder */
 	int opened;
@@ -141,6 +159,16 @@ struct audio {
 	struct wake_lock idlelock;
 
 	audpp_cmd_cfg_object_params_volume vol_pan;
+
+	/* per-stream statistics, reset on open */
+	uint32_t dsp_events;	/* buffer done interrupts */
+	uint32_t underruns;	/* both dsp buffers found empty */
+	uint32_t dsp_missed;	/* PCMDMAMISSED from the dsp */
+	uint32_t write_waits;	/* writer blocked on a full ring */
+
+#ifdef CONFIG_DEBUG_FS
+	struct dentry *dentry;
+#endif
 };
 
 struct audio_copp {
@@ -191,6 +219,62 @@ static int audio_dsp_send_buffer(struct audio *audio, unsigned id, unsigned len)
 
 static void audio_dsp_event(void *private, unsigned id, uint16_t *msg);
 
+/* Load the periods queued from out_tail into the dsp buffers before
+ * enabling, or put them back if enabling failed.  With more than two
+ * periods only the ones filled in order are taken, and a dsp buffer
+ * left without one plays a period of silence, so that a stream started
+ * before (or while) userspace commits keeps its order.
+ */
+static void audio_prime_slots(struct audio *audio, int undo)
+{
+	struct buffer *frame, *slot;
+	int i;
+
+	if (audio->out_count <= 2) {
+		/* the dsp buffers are out[0] and out[1] themselves */
+		for (i = 0; i < 2; i++)
+			audio->slot[i].used = undo ? 0 : audio->out[i].used;
+		audio->out_tail = 0;
+		audio->out_slot = 0;
+		audio->out_needed = 0;
+		return;
+	}
+
+	if (undo) {
+		for (i = audio->out_primed - 1; i >= 0; i--) {
+			audio->out_tail = (audio->out_tail +
+					   audio->out_count - 1) %
+					  audio->out_count;
+			audio->out[audio->out_tail].used =
+				audio->slot[i].used;
+		}
+		audio->slot[0].used = 0;
+		audio->slot[1].used = 0;
+		audio->out_primed = 0;
+	} else {
+		audio->out_primed = 0;
+		for (i = 0; i < 2; i++) {
+			frame = audio->out + audio->out_tail;
+			slot = audio->slot + i;
+			if (audio->out_primed == i && frame->used) {
+				memcpy(slot->data, frame->data, frame->used);
+				slot->used = frame->used;
+				frame->used = 0;
+				audio->out_tail = (audio->out_tail + 1) %
+						  audio->out_count;
+				audio->out_primed++;
+			} else {
+				memset(slot->data, 0, slot->size);
+				slot->used = slot->size;
+			}
+		}
+	}
+	/* the dsp hands back buffer 0 first */
+	audio->out_slot = 0;
+	audio->out_needed = 0;
+	wake_up(&audio->wait);
+}
+
 /* must be called with audio->lock held */
 static int audio_enable(struct audio *audio)
 {
@@ -202,15 +286,17 @@ static int audio_enable(struct audio *audio)
 	if (audio->enabled)
 		return 0;	
 
-	/* refuse to start if we're not ready */
-	if (!audio->out[0].used || !audio->out[1].used)
+	/* refuse to start if we're not ready; with more periods the
+	 * missing ones are primed with silence
+	 */
+	if (audio->out_count <= 2 &&
+	    (!audio->out[0].used || !audio->out[1].used))
 		return -EIO;
 
 	/* we start buffers 0 and 1, so buffer 0 will be the
 	 * next one the dsp will want
 	 */
-	audio->out_tail = 0;
-	audio->out_needed = 0;
+	audio_prime_slots(audio, 0);
 
 	cfg.tx_rate = RPC_AUD_DEF_SAMPLE_RATE_NONE;
 	cfg.rx_rate = RPC_AUD_DEF_SAMPLE_RATE_48000;
@@ -221,6 +307,7 @@ static int audio_enable(struct audio *audio)
 	audio_prevent_sleep(audio);	
 	rc = audmgr_enable(&audio->audmgr, &cfg);
 	if (rc < 0) {
+		audio_prime_slots(audio, 1);
 		audio_allow_sleep(audio);
 		return rc;
 	}
@@ -228,6 +315,7 @@ static int audio_enable(struct audio *audio)
 	if (audpp_enable(-1, audio_dsp_event, audio)) {
 		MM_ERR("audpp_enable() failed\n");
 		audmgr_disable(&audio->audmgr);
+		audio_prime_slots(audio, 1);
 		audio_allow_sleep(audio);
 		return -ENODEV;
 	}
@@ -246,6 +334,7 @@ static int audio_disable(struct audio *audio)
 		audio_dsp_out_enable(audio, 0);
 
 		audpp_disable(-1, audio);
+		cancel_work_sync(&audio->refill_work);
 
 		wake_up(&audio->wait);
 		audmgr_disable(&audio->audmgr);
@@ -282,10 +371,79 @@ void audio_commit_pending_pp_params(void *priv, unsigned id, uint16_t *msg)
 EXPORT_SYMBOL(audio_commit_pending_pp_params);
 
 /* ------------------- dsp --------------------- */
+
+/* Two periods: out[] are the dsp buffers themselves, so just tell the dsp
+ * about the ones that are full.  Must be called with dsp_lock held.
+ */
+static void audio_feed_dsp(struct audio *audio)
+{
+	struct buffer *frame;
+
+	while (audio->out_needed) {
+		frame = audio->out + audio->out_tail;
+		if (!frame->used)
+			break;
+		audio->slot[audio->out_tail].used = frame->used;
+		audio_dsp_send_buffer(audio, audio->out_tail, frame->used);
+		audio->out_tail ^= 1;
+		audio->out_slot = audio->out_tail;
+		audio->out_needed--;
+	}
+}
+
+/* More than two periods: copy the next full periods into the dsp buffers
+ * it has handed back.  Runs from a work item so that large periods are
+ * not copied in interrupt context; only this function consumes periods
+ * and dsp buffers in that mode.
+ */
+static void audio_refill_work(struct work_struct *work)
+{
+	struct audio *audio = container_of(work, struct audio, refill_work);
+	struct buffer *frame, *slot;
+	unsigned long flags;
+
+	spin_lock_irqsave(&audio->dsp_lock, flags);
+	while (audio->running && audio->out_needed) {
+		frame = audio->out + audio->out_tail;
+		if (!frame->used)
+			break;
+		slot = audio->slot + audio->out_slot;
+
+		spin_unlock_irqrestore(&audio->dsp_lock, flags);
+		memcpy(slot->data, frame->data, frame->used);
+		spin_lock_irqsave(&audio->dsp_lock, flags);
+		if (!audio->running)
+			break;
+
+		slot->used = frame->used;
+		audio_dsp_send_buffer(audio, audio->out_slot, frame->used);
+		frame->used = 0;
+		audio->out_slot ^= 1;
+		audio->out_tail = (audio->out_tail + 1) % audio->out_count;
+		audio->out_needed--;
+		wake_up(&audio->wait);
+	}
+	spin_unlock_irqrestore(&audio->dsp_lock, flags);
+}
+
+/* A period was filled; pass it on if the dsp is waiting for data. */
+static void audio_kick(struct audio *audio)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&audio->dsp_lock, flags);
+	if (audio->out_needed) {
+		if (audio->out_count > 2)
+			schedule_work(&audio->refill_work);
+		else
+			audio_feed_dsp(audio);
+	}
+	spin_unlock_irqrestore(&audio->dsp_lock, flags);
+}
+
 static void audio_dsp_event(void *private, unsigned id, uint16_t *msg)
 {
 	struct audio *audio = private;
-	struct buffer *frame;
 	unsigned long flags;
 
 	LOG(EV_DSP_EVENT, id);
@@ -306,17 +464,19 @@ static void audio_dsp_event(void *private, unsigned id, uint16_t *msg)
 
 		spin_lock_irqsave(&audio->dsp_lock, flags);
 		if (audio->running) {
-			atomic_add(audio->out[idx].used, &audio->out_bytes);
-			audio->out[idx].used = 0;
+			audio->dsp_events++;
+			atomic_add(audio->slot[idx].used, &audio->out_bytes);
+			audio->slot[idx].used = 0;
+			audio->out_needed++;
 
-			frame = audio->out + audio->out_tail;
-			if (frame->used) {
-				audio_dsp_send_buffer(
-					audio, audio->out_tail, frame->used);
-				audio->out_tail ^= 1;
+			if (audio->out_count > 2) {
+				schedule_work(&audio->refill_work);
 			} else {
-				audio->out_needed++;
+				audio->out[idx].used = 0;
+				audio_feed_dsp(audio);
 			}
+			if (audio->out_needed == 2)
+				audio->underruns++;
 			wake_up(&audio->wait);
 		}
 		spin_unlock_irqrestore(&audio->dsp_lock, flags);
@@ -324,6 +484,7 @@ static void audio_dsp_event(void *private, unsigned id, uint16_t *msg)
 	}
 	case AUDPP_MSG_PCMDMAMISSED:
 		MM_INFO("PCMDMAMISSED %d\n", msg[0]);
+		audio->dsp_missed++;
 		audio->teos = 1;
 		wake_up(&audio->wait);
 		break;
@@ -359,18 +520,18 @@ static int audio_dsp_out_enable(struct audio *audio, int yes)
 	cmd.intf_type	= AUDPP_CMD_PCM_INTF_RX_ENA_ARMTODSP_V;
 
 	if (yes) {
-		cmd.write_buf1LSW	= audio->out[0].addr;
-		cmd.write_buf1MSW	= audio->out[0].addr >> 16;
-		if (audio->out[0].used)
-			cmd.write_buf1_len	= audio->out[0].used;
+		cmd.write_buf1LSW	= audio->slot[0].addr;
+		cmd.write_buf1MSW	= audio->slot[0].addr >> 16;
+		if (audio->slot[0].used)
+			cmd.write_buf1_len	= audio->slot[0].used;
 		else
-			cmd.write_buf1_len	= audio->out[0].size;
-		cmd.write_buf2LSW	= audio->out[1].addr;
-		cmd.write_buf2MSW	= audio->out[1].addr >> 16;
-		if (audio->out[1].used)
-			cmd.write_buf2_len	= audio->out[1].used;
+			cmd.write_buf1_len	= audio->slot[0].size;
+		cmd.write_buf2LSW	= audio->slot[1].addr;
+		cmd.write_buf2MSW	= audio->slot[1].addr >> 16;
+		if (audio->slot[1].used)
+			cmd.write_buf2_len	= audio->slot[1].used;
 		else
-			cmd.write_buf2_len	= audio->out[1].size;
+			cmd.write_buf2_len	= audio->slot[1].size;
 		cmd.arm_to_rx_flag	= AUDPP_CMD_PCM_INTF_ENA_V;
 		cmd.weight_decoder_to_rx = audio->out_weight;
 		cmd.weight_arm_to_rx	= 1;
@@ -472,13 +633,116 @@ static int audio_enable_qconcert_plus(struct audio_copp *audio_copp, int enable)
 
 static void audio_flush(struct audio *audio)
 {
-	audio->out[0].used = 0;
-	audio->out[1].used = 0;
+	int i;
+
+	for (i = 0; i < audio->out_count; i++)
+		audio->out[i].used = 0;
+	audio->slot[0].used = 0;
+	audio->slot[1].used = 0;
 	audio->out_head = 0;
 	audio->out_tail = 0;
+	audio->out_slot = 0;
 	audio->stopped = 0;
 }
 
+/* must be called with audio->lock and audio->write_lock held, while
+ * the stream is disabled
+ */
+static int audio_alloc_buffers(struct audio *audio, unsigned size,
+			       unsigned count)
+{
+	size_t ring = PAGE_ALIGN(size * count);
+	size_t total = ring + (count > 2 ? 2 * size : 0);
+	dma_addr_t phys;
+	char *data;
+	int i;
+
+	if (audio->data && audio->out_buffer_size == size &&
+	    audio->out_count == count)
+		return 0;
+	if (audio->mapped)
+		return -EBUSY;
+
+	data = dma_alloc_coherent(NULL, total, &phys, GFP_KERNEL);
+	if (!data) {
+		MM_ERR("could not allocate DMA buffers\n");
+		return -ENOMEM;
+	}
+	if (audio->data)
+		dma_free_coherent(NULL, audio->dma_size, audio->data,
+				  audio->phys);
+	audio->data = data;
+	audio->phys = phys;
+	audio->dma_size = total;
+	audio->out_buffer_size = size;
+	audio->out_count = count;
+
+	for (i = 0; i < count; i++) {
+		audio->out[i].data = audio->data + i * size;
+		audio->out[i].addr = audio->phys + i * size;
+		audio->out[i].size = size;
+	}
+	for (i = 0; i < 2; i++) {
+		if (count > 2) {
+			audio->slot[i].data = audio->data + ring + i * size;
+			audio->slot[i].addr = audio->phys + ring + i * size;
+		} else {
+			audio->slot[i].data = audio->out[i].data;
+			audio->slot[i].addr = audio->out[i].addr;
+		}
+		audio->slot[i].size = size;
+	}
+
+	audio_flush(audio);
+	return 0;
+}
+
+static int audio_drained(struct audio *audio)
+{
+	int i;
+
+	for (i = 0; i < audio->out_count; i++)
+		if (audio->out[i].used)
+			return 0;
+	return !audio->slot[0].used && !audio->slot[1].used;
+}
+
+/* mmap mode: userspace has written len bytes into the ring starting at
+ * period out_head.  Must be called with audio->write_lock held.
+ */
+static int audio_commit(struct audio *audio, unsigned long len)
+{
+	struct buffer *frame;
+	unsigned xfer;
+	int i, free = 0;
+
+	if (audio->stopped)
+		return -EBUSY;
+	if (len > audio->out_buffer_size * audio->out_count)
+		return -EINVAL;
+
+	/* all or nothing: every period the data spans must be free */
+	for (i = 0; i < DIV_ROUND_UP(len, audio->out_buffer_size); i++)
+		if (audio->out[(audio->out_head + i) %
+			       audio->out_count].used)
+			return -ENOSPC;
+
+	while (len > 0) {
+		frame = audio->out + audio->out_head;
+		xfer = len > frame->size ? frame->size : len;
+		frame->used = xfer;
+		LOG(EV_FILL_BUFFER, audio->out_head);
+		audio->out_head = (audio->out_head + 1) % audio->out_count;
+		len -= xfer;
+		audio_kick(audio);
+	}
+
+	for (i = 0; i < audio->out_count; i++)
+		if (!audio->out[i].used)
+			free++;
+	return free;
+}
+
 static long audio_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct audio *audio = file->private_data;
@@ -547,15 +811,46 @@ static long audio_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			rc = -EINVAL;
 			break;
 		}
+
+		/* a zero size or count keeps the current one; small periods
+		 * give low latency, many large ones few wakeups
+		 */
+		if (!config.buffer_size)
+			config.buffer_size = audio->out_buffer_size;
+		if (!config.buffer_count)
+			config.buffer_count = audio->out_count;
+		config.buffer_size = clamp_t(uint32_t, config.buffer_size,
+					     BUFSZ_MIN, BUFSZ_MAX) & ~31;
+		config.buffer_count = clamp_t(uint32_t, config.buffer_count,
+					      2, BUFCNT_MAX);
+		if (config.buffer_size != audio->out_buffer_size ||
+		    config.buffer_count != audio->out_count) {
+			if (audio->enabled) {
+				rc = -EBUSY;
+				break;
+			}
+			mutex_lock(&audio->write_lock);
+			rc = audio_alloc_buffers(audio, config.buffer_size,
+						 config.buffer_count);
+			mutex_unlock(&audio->write_lock);
+			if (rc)
+				break;
+		}
+
 		audio->out_sample_rate = config.sample_rate;
 		audio->out_channel_mode = config.channel_count;
 		rc = 0;
 		break;
 	}
+	case AUDIO_OUT_COMMIT:
+		mutex_lock(&audio->write_lock);
+		rc = audio_commit(audio, arg);
+		mutex_unlock(&audio->write_lock);
+		break;
 	case AUDIO_GET_CONFIG: {
 		struct msm_audio_config config;
-		config.buffer_size = BUFSZ;
-		config.buffer_count = 2;
+		config.buffer_size = audio->out_buffer_size;
+		config.buffer_count = audio->out_count;
 		config.sample_rate = audio->out_sample_rate;
 		if (audio->out_channel_mode == AUDPP_CMD_PCM_INTF_MONO_V) {
 			config.channel_count = 1;
@@ -590,9 +885,7 @@ static int audio_fsync(struct file *file,	int datasync)
 
 	mutex_lock(&audio->write_lock);
 
-	rc = wait_event_interruptible(audio->wait,
-		(!audio->out[0].used &&
-		!audio->out[1].used));
+	rc = wait_event_interruptible(audio->wait, audio_drained(audio));
 
 	if (rc < 0)
 		goto done;
@@ -633,7 +926,6 @@ static ssize_t audio_write(struct file *file, const char __user *buf,
 {
 	struct sched_param s = { .sched_priority = 1 };
 	struct audio *audio = file->private_data;
-	unsigned long flags;
 	const char __user *start = buf;
 	struct buffer *frame;
 	size_t xfer;
@@ -656,6 +948,8 @@ static ssize_t audio_write(struct file *file, const char __user *buf,
 	mutex_lock(&audio->write_lock);
 	while (count > 0) {
 		frame = audio->out + audio->out_head;
+		if (frame->used)
+			audio->write_waits++;
 
 		LOG(EV_WAIT_EVENT, 0);
 		rc = wait_event_interruptible(audio->wait,
@@ -674,19 +968,12 @@ static ssize_t audio_write(struct file *file, const char __user *buf,
 			break;
 		}
 		frame->used = xfer;
-		audio->out_head ^= 1;
+		LOG(EV_FILL_BUFFER, audio->out_head);
+		audio->out_head = (audio->out_head + 1) % audio->out_count;
 		count -= xfer;
 		buf += xfer;
 
-		spin_lock_irqsave(&audio->dsp_lock, flags);
-		LOG(EV_FILL_BUFFER, audio->out_head ^ 1);
-		frame = audio->out + audio->out_tail;
-		if (frame->used && audio->out_needed) {
-			audio_dsp_send_buffer(audio, audio->out_tail, frame->used);
-			audio->out_tail ^= 1;
-			audio->out_needed--;
-		}
-		spin_unlock_irqrestore(&audio->dsp_lock, flags);
+		audio_kick(audio);
 	}
 
 	mutex_unlock(&audio->write_lock);
@@ -717,6 +1004,7 @@ static int audio_release(struct inode *inode, struct file *file)
 	mutex_lock(&audio->lock);
 	audio_disable(audio);
 	audio_flush(audio);
+	audio->mapped = 0;
 	audio->opened = 0;
 	mutex_unlock(&audio->lock);
 	htc_pwrsink_set(PWRSINK_AUDIO, 0);
@@ -738,32 +1026,23 @@ static int audio_open(struct inode *inode, struct file *file)
 		goto done;
 	}
 
-	if (!audio->data) {
-		audio->data = dma_alloc_coherent(NULL, DMASZ, 
-						 &audio->phys, GFP_KERNEL);
-		if (!audio->data) {
-			MM_ERR("could not allocate DMA buffers\n");
-			rc = -ENOMEM;
-			goto done;
-		}
-	}
+	/* every stream starts out with the classic two periods */
+	rc = audio_alloc_buffers(audio, BUFSZ, 2);
+	if (rc)
+		goto done;
 
 	rc = audmgr_open(&audio->audmgr);
 	if (rc)
 		goto done;
 
-	audio->out_buffer_size = BUFSZ;
 	audio->out_sample_rate = 44100;
 	audio->out_channel_mode = AUDPP_CMD_PCM_INTF_STEREO_V;
 	audio->out_weight = 100;
 
-	audio->out[0].data = audio->data + 0;
-	audio->out[0].addr = audio->phys + 0;
-	audio->out[0].size = BUFSZ;
-	
-	audio->out[1].data = audio->data + BUFSZ;
-	audio->out[1].addr = audio->phys + BUFSZ;
-	audio->out[1].size = BUFSZ;
+	audio->dsp_events = 0;
+	audio->underruns = 0;
+	audio->dsp_missed = 0;
+	audio->write_waits = 0;
 
 	audio->vol_pan.volume = 0x2000;
 	audio->vol_pan.pan = 0x0;
@@ -976,6 +1255,84 @@ static int audpp_release(struct inode *inode, struct file *file)
 	return 0;
 }
 
+static unsigned int audio_poll(struct file *file,
+			       struct poll_table_struct *wait)
+{
+	struct audio *audio = file->private_data;
+	unsigned int mask = 0;
+
+	poll_wait(file, &audio->wait, wait);
+	if (audio->stopped || !audio->out[audio->out_head].used)
+		mask |= POLLOUT | POLLWRNORM;
+	return mask;
+}
+
+static int audio_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct audio *audio = file->private_data;
+	unsigned long len = vma->vm_end - vma->vm_start;
+	int rc = -EINVAL;
+
+	mutex_lock(&audio->lock);
+	if (!vma->vm_pgoff &&
+	    len <= PAGE_ALIGN(audio->out_buffer_size * audio->out_count)) {
+		rc = dma_mmap_coherent(NULL, vma, audio->data, audio->phys,
+				       len);
+		if (!rc)
+			audio->mapped = 1;
+	}
+	mutex_unlock(&audio->lock);
+	return rc;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int audio_debug_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+static ssize_t audio_debug_read(struct file *file, char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	struct audio *audio = file->private_data;
+	char buffer[512];
+	unsigned bytes_per_sec, queued = 0;
+	unsigned period_us = 0;
+	int n, i;
+
+	mutex_lock(&audio->lock);
+	bytes_per_sec = audio->out_sample_rate * 2 *
+		(audio->out_channel_mode == AUDPP_CMD_PCM_INTF_MONO_V ? 1 : 2);
+	if (bytes_per_sec)
+		period_us = div_u64((u64)audio->out_buffer_size * USEC_PER_SEC,
+				    bytes_per_sec);
+	for (i = 0; i < audio->out_count; i++)
+		queued += audio->out[i].used;
+	if (audio->out_count > 2)
+		queued += audio->slot[0].used + audio->slot[1].used;
+
+	n = scnprintf(buffer, sizeof(buffer),
+		"opened %d\nrunning %d\nbuffer_size %u\nbuffer_count %u\n"
+		"period_us %u\nbuffer_latency_us %u\nqueued_bytes %u\n"
+		"dsp_events %u\nunderruns %u\ndsp_missed %u\n"
+		"write_waits %u\n",
+		audio->opened, audio->running, audio->out_buffer_size,
+		audio->out_count, period_us,
+		period_us * (audio->out_count + (audio->out_count > 2 ? 2 : 0)),
+		queued, audio->dsp_events, audio->underruns,
+		audio->dsp_missed, audio->write_waits);
+	mutex_unlock(&audio->lock);
+
+	return simple_read_from_buffer(buf, count, ppos, buffer, n);
+}
+
+static const struct file_operations audio_debug_fops = {
+	.read = audio_debug_read,
+	.open = audio_debug_open,
+};
+#endif
+
 static struct file_operations audio_fops = {
 	.owner		= THIS_MODULE,
 	.open		= audio_open,
@@ -984,6 +1341,8 @@ static struct file_operations audio_fops = {
 	.write		= audio_write,
 	.unlocked_ioctl	= audio_ioctl,
 	.fsync		= audio_fsync,
+	.poll		= audio_poll,
+	.mmap		= audio_mmap,
 };
 
 static struct file_operations audpp_fops = {
@@ -1012,6 +1371,13 @@ static int __init audio_init(void)
 	mutex_init(&the_audio_copp.lock);
 	spin_lock_init(&the_audio.dsp_lock);
 	init_waitqueue_head(&the_audio.wait);
+	INIT_WORK(&the_audio.refill_work, audio_refill_work);
+#ifdef CONFIG_DEBUG_FS
+	the_audio.dentry = debugfs_create_file("msm_pcm_out", S_IFREG | S_IRUGO,
+			NULL, (void *) &the_audio, &audio_debug_fops);
+	if (IS_ERR(the_audio.dentry))
+		MM_DBG("debugfs_create_file failed\n");
+#endif
 	wake_lock_init(&the_audio.wakelock, WAKE_LOCK_SUSPEND, "audio_pcm");
 	wake_lock_init(&the_audio.idlelock, WAKE_LOCK_IDLE, "audio_pcm_idle");
 	return (misc_register(&audio_misc) || misc_register(&audpp_misc));
@@ -31,6 +31,9 @@
 #include <linux/ctype.h>
 #include <linux/remote_spinlock.h>
 #include <linux/uaccess.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
 #include <mach/msm_smd.h>
 #include <mach/msm_iomap.h>
 #include <mach/system.h>
@@ -361,8 +364,23 @@ struct smd_channel {
 	int pending_pkt_sz;
 
 	char is_pkt_ch;
+
+	/* events queued for delivery from notify_work, see
+	 * smd_enable_deferred_notify()
+	 */
+	int deferred_notify;
+	unsigned long pending;
+	struct work_struct notify_work;
 };
 
+/* bits in smd_channel.pending */
+#define SMD_PENDING_DATA	0
+#define SMD_PENDING_STATUS	1
+
+static struct workqueue_struct *smd_notify_wq;
+
+unsigned smd_irq_latency_hist[SMD_IRQ_LATENCY_BUCKETS];
+
 static struct platform_device loopback_tty_pdev = {.name = "LOOPBACK_TTY"};
 
 static LIST_HEAD(smd_ch_closed_list);
@@ -554,7 +572,7 @@ static unsigned ch_read_buffer(struct smd_channel *ch, void **ptr)
 {
 	unsigned head = ch->recv->head;
 	unsigned tail = ch->recv->tail;
-	*ptr = (void *) (ch->recv_data + tail);
+	*ptr = ch->recv_data + tail;
 
 	if (tail <= head)
 		return head - tail;
@@ -757,6 +775,44 @@ static void handle_smd_irq_closing_list(void)
 	spin_unlock_irqrestore(&smd_lock, flags);
 }
 
+static void smd_notify_worker(struct work_struct *work)
+{
+	struct smd_channel *ch =
+		container_of(work, struct smd_channel, notify_work);
+
+	if (test_and_clear_bit(SMD_PENDING_DATA, &ch->pending))
+		ch->notify(ch->priv, SMD_EVENT_DATA);
+	if (test_and_clear_bit(SMD_PENDING_STATUS, &ch->pending))
+		ch->notify(ch->priv, SMD_EVENT_STATUS);
+}
+
+/* called from the irq path with smd_lock held */
+static void smd_notify_event(struct smd_channel *ch, unsigned event)
+{
+	if (!ch->deferred_notify) {
+		ch->notify(ch->priv, event);
+		return;
+	}
+
+	if (event == SMD_EVENT_DATA)
+		set_bit(SMD_PENDING_DATA, &ch->pending);
+	else
+		set_bit(SMD_PENDING_STATUS, &ch->pending);
+	queue_work(smd_notify_wq, &ch->notify_work);
+}
+
+static void smd_irq_latency_account(ktime_t start)
+{
+	s64 us = ktime_to_us(ktime_sub(ktime_get(), start));
+	int bucket = 0;
+
+	if (us > 1)
+		bucket = ilog2(us);
+	if (bucket >= SMD_IRQ_LATENCY_BUCKETS)
+		bucket = SMD_IRQ_LATENCY_BUCKETS - 1;
+	smd_irq_latency_hist[bucket]++;
+}
+
 static void handle_smd_irq(struct list_head *list, void (*notify)(void))
 {
 	unsigned long flags;
@@ -764,8 +820,10 @@ static void handle_smd_irq(struct list_head *list, void (*notify)(void))
 	unsigned ch_flags;
 	unsigned tmp;
 	unsigned char state_change;
+	ktime_t start;
 
 	spin_lock_irqsave(&smd_lock, flags);
+	start = ktime_get();
 	list_for_each_entry(ch, list, ch_list) {
 		state_change = 0;
 		ch_flags = 0;
@@ -790,11 +848,12 @@ static void handle_smd_irq(struct list_head *list, void (*notify)(void))
 		}
 		if (ch_flags) {
 			ch->update_state(ch);
-			ch->notify(ch->priv, SMD_EVENT_DATA);
+			smd_notify_event(ch, SMD_EVENT_DATA);
 		}
 		if (ch_flags & 0x4 && !state_change)
-			ch->notify(ch->priv, SMD_EVENT_STATUS);
+			smd_notify_event(ch, SMD_EVENT_STATUS);
 	}
+	smd_irq_latency_account(start);
 	spin_unlock_irqrestore(&smd_lock, flags);
 	do_smd_probe();
 }
@@ -912,7 +971,8 @@ static int smd_is_packet(struct smd_alloc_elm *alloc_elm)
 		return 0;
 }
 
-static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
+/* copy into the fifo without interrupting the other side */
+static int ch_write(smd_channel_t *ch, const void *_data, int len,
 				int user_buf)
 {
 	void *ptr;
@@ -921,12 +981,6 @@ static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
 	int orig_len = len;
 	int r = 0;
 
-	SMD_DBG("smd_stream_write() %d -> ch%d\n", len, ch->n);
-	if (len < 0)
-		return -EINVAL;
-	else if (len == 0)
-		return 0;
-
 	while ((xfer = ch_write_buffer(ch, &ptr)) != 0) {
 		if (!ch_is_open(ch))
 			break;
@@ -950,10 +1004,25 @@ static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
 			break;
 	}
 
-	if (orig_len - len)
+	return orig_len - len;
+}
+
+static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
+				int user_buf)
+{
+	int r;
+
+	SMD_DBG("smd_stream_write() %d -> ch%d\n", len, ch->n);
+	if (len < 0)
+		return -EINVAL;
+	else if (len == 0)
+		return 0;
+
+	r = ch_write(ch, _data, len, user_buf);
+	if (r)
 		ch->notify_other_cpu();
 
-	return orig_len - len;
+	return r;
 }
 
 static int smd_packet_write(smd_channel_t *ch, const void *_data, int len,
@@ -974,16 +1043,16 @@ static int smd_packet_write(smd_channel_t *ch, const void *_data, int len,
 	hdr[0] = len;
 	hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
 
-
-	ret = smd_stream_write(ch, hdr, sizeof(hdr), 0);
+	/* header and payload go out with a single interrupt */
+	ret = ch_write(ch, hdr, sizeof(hdr), 0);
 	if (ret < 0 || ret != sizeof(hdr)) {
 		SMD_DBG("%s failed to write pkt header: "
 			"%d returned\n", __func__, ret);
 		return -1;
 	}
 
-
-	ret = smd_stream_write(ch, _data, len, user_buf);
+	ret = ch_write(ch, _data, len, user_buf);
+	ch->notify_other_cpu();
 	if (ret < 0 || ret != len) {
 		SMD_DBG("%s failed to write pkt data: "
 			"%d returned\n", __func__, ret);
@@ -1110,6 +1179,7 @@ static int smd_alloc_channel(struct smd_alloc_elm *alloc_elm)
 		return -1;
 	}
 	ch->n = alloc_elm->cid;
+	INIT_WORK(&ch->notify_work, smd_notify_worker);
 
 	if (smd_alloc_v2(ch) && smd_alloc_v1(ch)) {
 		kfree(ch);
@@ -1193,6 +1263,7 @@ static int smd_alloc_loopback_channel(void)
 		return -1;
 	}
 	ch->n = SMD_LOOPBACK_CID;
+	INIT_WORK(&ch->notify_work, smd_notify_worker);
 
 	ch->send = &smd_loopback_ctl;
 	ch->recv = &smd_loopback_ctl;
@@ -1342,14 +1413,19 @@ EXPORT_SYMBOL(smd_open);
 int smd_close(smd_channel_t *ch)
 {
 	unsigned long flags;
+	int deferred_notify, remote_open;
 
 	if (ch == 0)
 		return -1;
 
 	SMD_INFO("smd_close(%s)\n", ch->name);
 
+	/* the irq path queues notify_work under smd_lock, and only for
+	 * channels still on its list */
 	spin_lock_irqsave(&smd_lock, flags);
 	list_del(&ch->ch_list);
+	deferred_notify = ch->deferred_notify;
+	ch->deferred_notify = 0;
 	if (ch->n == SMD_LOOPBACK_CID) {
 		ch->send->fDSR = 0;
 		ch->send->fCTS = 0;
@@ -1358,11 +1434,18 @@ int smd_close(smd_channel_t *ch)
 	} else
 		ch_set_state(ch, SMD_SS_CLOSED);
 
-	if (ch->recv->state == SMD_SS_OPENED) {
+	remote_open = ch->recv->state == SMD_SS_OPENED;
+	if (remote_open)
 		list_add(&ch->ch_list, &smd_ch_closing_list);
-		spin_unlock_irqrestore(&smd_lock, flags);
-	} else {
-		spin_unlock_irqrestore(&smd_lock, flags);
+	spin_unlock_irqrestore(&smd_lock, flags);
+
+	/* before the channel can be reopened from the closed list */
+	if (deferred_notify) {
+		cancel_work_sync(&ch->notify_work);
+		ch->pending = 0;
+	}
+
+	if (!remote_open) {
 		ch->notify = do_nothing_notify;
 		mutex_lock(&smd_creation_mutex);
 		list_add(&ch->ch_list, &smd_ch_closed_list);
@@ -1373,6 +1456,16 @@ int smd_close(smd_channel_t *ch)
 }
 EXPORT_SYMBOL(smd_close);
 
+void smd_enable_deferred_notify(smd_channel_t *ch)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&smd_lock, flags);
+	ch->deferred_notify = 1;
+	spin_unlock_irqrestore(&smd_lock, flags);
+}
+EXPORT_SYMBOL(smd_enable_deferred_notify);
+
 int smd_write_start(smd_channel_t *ch, int len)
 {
 	int ret;
@@ -1408,7 +1501,8 @@ int smd_write_start(smd_channel_t *ch, int len)
 	hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
 
 
-	ret = smd_stream_write(ch, hdr, sizeof(hdr), 0);
+	/* the first segment will interrupt the other side */
+	ret = ch_write(ch, hdr, sizeof(hdr), 0);
 	if (ret < 0 || ret != sizeof(hdr)) {
 		ch->pending_pkt_sz = 0;
 		pr_err("%s: packet header failed to write\n", __func__);
@@ -1465,6 +1559,63 @@ int smd_write_end(smd_channel_t *ch)
 }
 EXPORT_SYMBOL(smd_write_end);
 
+/* bytes that can be read now; on packet channels, of the current packet */
+static int smd_read_avail_pkt(struct smd_channel *ch)
+{
+	int n = smd_stream_read_avail(ch);
+
+	if (ch->is_pkt_ch && n > ch->current_packet)
+		n = ch->current_packet;
+	return n;
+}
+
+int smd_read_peek(smd_channel_t *ch, int offset, void **ptr)
+{
+	unsigned tail;
+	int avail, n;
+
+	if (!ch)
+		return -ENODEV;
+
+	avail = smd_read_avail_pkt(ch);
+	if (offset < 0 || offset > avail)
+		return -EINVAL;
+
+	tail = (ch->recv->tail + offset) & ch->fifo_mask;
+	*ptr = ch->recv_data + tail;
+	n = ch->fifo_size - tail;
+
+	return n < avail - offset ? n : avail - offset;
+}
+EXPORT_SYMBOL(smd_read_peek);
+
+int smd_read_commit(smd_channel_t *ch, int len)
+{
+	unsigned long flags;
+
+	if (!ch)
+		return -ENODEV;
+	if (len < 0 || len > smd_read_avail_pkt(ch))
+		return -EINVAL;
+	if (len == 0)
+		return 0;
+
+	ch_read_done(ch, len);
+
+	if (ch->is_pkt_ch) {
+		spin_lock_irqsave(&smd_lock, flags);
+		ch->current_packet -= len;
+		update_packet_state(ch);
+		spin_unlock_irqrestore(&smd_lock, flags);
+	}
+
+	if (!read_intr_blocked(ch))
+		ch->notify_other_cpu();
+
+	return len;
+}
+EXPORT_SYMBOL(smd_read_commit);
+
 int smd_read(smd_channel_t *ch, void *data, int len)
 {
 	return ch->read(ch, data, len, 0);
@@ -2250,6 +2401,13 @@ static int __devinit msm_smd_probe(struct platform_device *pdev)
 		return -ENOMEM;
 	}
 
+	smd_notify_wq = alloc_workqueue("smd_notify",
+					WQ_HIGHPRI | WQ_NON_REENTRANT, 0);
+	if (!smd_notify_wq) {
+		pr_err("%s: alloc_workqueue ENOMEM\n", __func__);
+		return -ENOMEM;
+	}
+
 	if (smsm_init()) {
 		pr_err("smsm_init() failed\n");
 		return -1;
@@ -602,6 +602,19 @@ static int debug_read_intr_mux(char *buf, int max)
 	return i;
 }
 
+static int debug_read_irq_latency(char *buf, int max)
+{
+	int n, i = 0;
+
+	for (n = 0; n < SMD_IRQ_LATENCY_BUCKETS - 1; n++)
+		i += scnprintf(buf + i, max - i, "%5u us: %u\n",
+			       n ? 1U << n : 0, smd_irq_latency_hist[n]);
+	i += scnprintf(buf + i, max - i, "%5u+us: %u\n", 1U << n,
+		       smd_irq_latency_hist[n]);
+
+	return i;
+}
+
 #define DEBUG_BUFMAX 4096
 static char debug_buffer[DEBUG_BUFMAX];
 
@@ -648,6 +661,7 @@ static int __init smd_debugfs_init(void)
 	debug_create("modem_err_f3", 0444, dent, debug_modem_err_f3);
 	debug_create("print_diag", 0444, dent, debug_diag);
 	debug_create("print_f3", 0444, dent, debug_f3);
+	debug_create("irq_latency", 0444, dent, debug_read_irq_latency);
 
 	/* NNV: this is google only stuff */
 	debug_create("build", 0444, dent, debug_read_build_id);
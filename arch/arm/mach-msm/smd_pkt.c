@@ -197,6 +197,31 @@ static long smd_pkt_ioctl(struct file *file, unsigned int cmd,
 	return ret;
 }
 
+/*
+ * Copy a packet straight out of the smd fifo.  Nothing is consumed until
+ * all of it reached userspace, so a faulting buffer leaves the packet in
+ * place even when it wraps around the end of the fifo.
+ */
+static int smd_pkt_copy_to_user(struct smd_channel *ch, char __user *buf,
+				int len)
+{
+	void *ptr;
+	int n, copied = 0;
+
+	while (copied < len) {
+		n = smd_read_peek(ch, copied, &ptr);
+		if (n <= 0)
+			break;
+		if (n > len - copied)
+			n = len - copied;
+		if (copy_to_user(buf + copied, ptr, n))
+			return -EFAULT;
+		copied += n;
+	}
+
+	return smd_read_commit(ch, copied);
+}
+
 ssize_t smd_pkt_read(struct file *file,
 		       char __user *buf,
 		       size_t count,
@@ -269,11 +294,13 @@ wait_for_packet:
 		return -EINVAL;
 	}
 
-	if (smd_read_user_buffer(smd_pkt_devp->ch, buf, bytes_read)
-	    != bytes_read) {
+	r = smd_pkt_copy_to_user(smd_pkt_devp->ch, buf, bytes_read);
+	if (r != bytes_read) {
 		mutex_unlock(&smd_pkt_devp->rx_lock);
 		if (smd_pkt_devp->has_reset)
 			return notify_reset(smd_pkt_devp);
+		if (r < 0)
+			return r;
 
 		printk(KERN_ERR "user read: not enough data?!\n");
 		return -EINVAL;
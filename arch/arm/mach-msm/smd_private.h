@@ -135,6 +135,12 @@ struct smd_half_channel {
 
 extern spinlock_t smem_lock;
 
+/* time spent with irqs off in the smd interrupt handler, bucket n counts
+ * passes that took [2^n, 2^(n+1)) usec, the last bucket everything longer
+ */
+#define SMD_IRQ_LATENCY_BUCKETS	12
+extern unsigned smd_irq_latency_hist[SMD_IRQ_LATENCY_BUCKETS];
+
 
 void smd_diag(void);
 
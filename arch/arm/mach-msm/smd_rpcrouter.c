@@ -40,6 +40,9 @@
 #include <linux/platform_device.h>
 #include <linux/uaccess.h>
 #include <linux/debugfs.h>
+#include <linux/hash.h>
+#include <linux/ktime.h>
+#include <asm/div64.h>
 
 #include <asm/byteorder.h>
 
@@ -140,6 +143,34 @@ static LIST_HEAD(remote_endpoints);
 
 static LIST_HEAD(server_list);
 
+/*
+ * Endpoints and servers are additionally hashed so that the per-packet
+ * lookups in the read path do not have to walk the whole list.  The
+ * lists above are kept for ordered iteration (restart, debugfs).
+ */
+#define RPCROUTER_HASH_BITS	5
+#define RPCROUTER_HASH_SIZE	(1 << RPCROUTER_HASH_BITS)
+
+static struct hlist_head local_endpoints_hash[RPCROUTER_HASH_SIZE];
+static struct hlist_head remote_endpoints_hash[RPCROUTER_HASH_SIZE];
+static struct hlist_head server_hash[RPCROUTER_HASH_SIZE];
+
+static inline struct hlist_head *local_ept_bucket(uint32_t cid)
+{
+	return &local_endpoints_hash[hash_32(cid, RPCROUTER_HASH_BITS)];
+}
+
+static inline struct hlist_head *remote_ept_bucket(uint32_t pid, uint32_t cid)
+{
+	return &remote_endpoints_hash[hash_32(pid ^ cid,
+					      RPCROUTER_HASH_BITS)];
+}
+
+static inline struct hlist_head *server_bucket(uint32_t prog, uint32_t ver)
+{
+	return &server_hash[hash_32(prog ^ ver, RPCROUTER_HASH_BITS)];
+}
+
 static wait_queue_head_t newserver_wait;
 static wait_queue_head_t subsystem_restart_wait;
 
@@ -459,6 +490,7 @@ static struct rr_server *rpcrouter_create_server(uint32_t pid,
 
 	spin_lock_irqsave(&server_list_lock, flags);
 	list_add_tail(&server->list, &server_list);
+	hlist_add_head(&server->hash, server_bucket(prog, ver));
 	spin_unlock_irqrestore(&server_list_lock, flags);
 
 	rc = msm_rpcrouter_create_server_cdev(server);
@@ -469,6 +501,7 @@ static struct rr_server *rpcrouter_create_server(uint32_t pid,
 out_fail:
 	spin_lock_irqsave(&server_list_lock, flags);
 	list_del(&server->list);
+	hlist_del(&server->hash);
 	spin_unlock_irqrestore(&server_list_lock, flags);
 	kfree(server);
 	return ERR_PTR(rc);
@@ -480,6 +513,7 @@ static void rpcrouter_destroy_server(struct rr_server *server)
 
 	spin_lock_irqsave(&server_list_lock, flags);
 	list_del(&server->list);
+	hlist_del(&server->hash);
 	spin_unlock_irqrestore(&server_list_lock, flags);
 	device_destroy(msm_rpcrouter_class, server->device_number);
 	kfree(server);
@@ -534,10 +568,11 @@ static void rpcrouter_register_board_dev(struct rr_server *server)
 static struct rr_server *rpcrouter_lookup_server(uint32_t prog, uint32_t ver)
 {
 	struct rr_server *server;
+	struct hlist_node *n;
 	unsigned long flags;
 
 	spin_lock_irqsave(&server_list_lock, flags);
-	list_for_each_entry(server, &server_list, list) {
+	hlist_for_each_entry(server, n, server_bucket(prog, ver), hash) {
 		if (server->prog == prog
 		 && server->vers == ver) {
 			spin_unlock_irqrestore(&server_list_lock, flags);
@@ -613,6 +648,7 @@ struct msm_rpc_endpoint *msm_rpcrouter_create_local_endpoint(dev_t dev)
 
 	spin_lock_irqsave(&local_endpoints_lock, flags);
 	list_add_tail(&ept->list, &local_endpoints);
+	hlist_add_head(&ept->hash, local_ept_bucket(ept->cid));
 	spin_unlock_irqrestore(&local_endpoints_lock, flags);
 	return ept;
 }
@@ -661,6 +697,7 @@ int msm_rpcrouter_destroy_local_endpoint(struct msm_rpc_endpoint *ept)
 	wake_lock_destroy(&ept->reply_q_wake_lock);
 	spin_lock_irqsave(&local_endpoints_lock, flags);
 	list_del(&ept->list);
+	hlist_del(&ept->hash);
 	spin_unlock_irqrestore(&local_endpoints_lock, flags);
 	kfree(ept);
 	return 0;
@@ -683,6 +720,7 @@ static int rpcrouter_create_remote_endpoint(uint32_t pid, uint32_t cid)
 
 	spin_lock_irqsave(&remote_endpoints_lock, flags);
 	list_add_tail(&new_c->list, &remote_endpoints);
+	hlist_add_head(&new_c->hash, remote_ept_bucket(pid, cid));
 	new_c->quota_restart_state = RESTART_NORMAL;
 	spin_unlock_irqrestore(&remote_endpoints_lock, flags);
 	return 0;
@@ -691,10 +729,11 @@ static int rpcrouter_create_remote_endpoint(uint32_t pid, uint32_t cid)
 static struct msm_rpc_endpoint *rpcrouter_lookup_local_endpoint(uint32_t cid)
 {
 	struct msm_rpc_endpoint *ept;
+	struct hlist_node *n;
 	unsigned long flags;
 
 	spin_lock_irqsave(&local_endpoints_lock, flags);
-	list_for_each_entry(ept, &local_endpoints, list) {
+	hlist_for_each_entry(ept, n, local_ept_bucket(cid), hash) {
 		if (ept->cid == cid) {
 			spin_unlock_irqrestore(&local_endpoints_lock, flags);
 			return ept;
@@ -708,10 +747,11 @@ static struct rr_remote_endpoint *rpcrouter_lookup_remote_endpoint(uint32_t pid,
 								   uint32_t cid)
 {
 	struct rr_remote_endpoint *ept;
+	struct hlist_node *n;
 	unsigned long flags;
 
 	spin_lock_irqsave(&remote_endpoints_lock, flags);
-	list_for_each_entry(ept, &remote_endpoints, list) {
+	hlist_for_each_entry(ept, n, remote_ept_bucket(pid, cid), hash) {
 		if ((ept->pid == pid) && (ept->cid == cid)) {
 			spin_unlock_irqrestore(&remote_endpoints_lock, flags);
 			return ept;
@@ -898,6 +938,7 @@ static int process_control_msg(struct rpcrouter_xprt_info *xprt_info,
 		if (r_ept) {
 			spin_lock_irqsave(&remote_endpoints_lock, flags);
 			list_del(&r_ept->list);
+			hlist_del(&r_ept->hash);
 			spin_unlock_irqrestore(&remote_endpoints_lock, flags);
 			kfree(r_ept);
 		}
@@ -1168,6 +1209,9 @@ packet_complete:
 	spin_lock_irqsave(&ept->read_q_lock, flags);
 	D("%s: take read lock on ept %p\n", __func__, ept);
 	wake_lock(&ept->read_q_wake_lock);
+	pkt->arrival = ktime_get();
+	ept->rx_pkts++;
+	ept->rx_bytes += pkt->length;
 	list_add_tail(&pkt->list, &ept->read_q);
 	wake_up(&ept->wait_q);
 	spin_unlock_irqrestore(&ept->read_q_lock, flags);
@@ -1624,6 +1668,10 @@ int msm_rpc_write(struct msm_rpc_endpoint *ept, void *buffer, int count)
 			}
 			IO("Wrote %d bytes First %d Last 1 mid %d\n",
 			   rc, first_pkt, mid);
+			spin_lock_irqsave(&ept->read_q_lock, flags);
+			ept->tx_pkts++;
+			ept->tx_bytes += count;
+			spin_unlock_irqrestore(&ept->read_q_lock, flags);
 			break;
 		}
 		first_pkt = 0;
@@ -1791,6 +1839,7 @@ int __msm_rpc_read(struct msm_rpc_endpoint *ept,
 	struct rpc_request_hdr *rq;
 	struct msm_rpc_reply *reply;
 	unsigned long flags;
+	uint32_t latency_us;
 	int rc;
 
 	rc = wait_for_restart_and_notify(ept);
@@ -1857,6 +1906,10 @@ int __msm_rpc_read(struct msm_rpc_endpoint *ept,
 		return -ETOOSMALL;
 	}
 	list_del(&pkt->list);
+	latency_us = ktime_to_us(ktime_sub(ktime_get(), pkt->arrival));
+	if (latency_us > ept->rx_latency_max_us)
+		ept->rx_latency_max_us = latency_us;
+	ept->rx_latency_total_us += latency_us;
 	spin_unlock_irqrestore(&ept->read_q_lock, flags);
 
 	rc = pkt->length;
@@ -2208,6 +2261,10 @@ static int dump_msm_rpc_endpoint(char *buf, int max)
 			       ept->reply_cnt);
 		i += scnprintf(buf + i, max - i, "restart_state: %i\n",
 			       ept->restart_state);
+		i += scnprintf(buf + i, max - i, "rx: %u pkts %u bytes\n",
+			       ept->rx_pkts, ept->rx_bytes);
+		i += scnprintf(buf + i, max - i, "tx: %u pkts %u bytes\n",
+			       ept->tx_pkts, ept->tx_bytes);
 
 		i += scnprintf(buf + i, max - i, "outstanding xids:\n");
 		spin_lock(&ept->reply_q_lock);
@@ -2232,6 +2289,51 @@ static int dump_msm_rpc_endpoint(char *buf, int max)
 	return i;
 }
 
+static int dump_ept_stats(char *buf, int max)
+{
+	int i = 0;
+	unsigned long flags;
+	struct msm_rpc_endpoint *ept;
+	const char *sym;
+	uint64_t avg;
+
+	i += scnprintf(buf + i, max - i,
+		       "%-8s %-20s %8s %8s %8s %8s %8s\n", "cid", "prog",
+		       "rx_pkts", "tx_pkts", "pending", "avg_us", "max_us");
+
+	spin_lock_irqsave(&local_endpoints_lock, flags);
+	list_for_each_entry(ept, &local_endpoints, list) {
+		struct rr_packet *pkt;
+		unsigned pending = 0;
+
+		spin_lock(&ept->read_q_lock);
+		list_for_each_entry(pkt, &ept->read_q, list)
+			pending++;
+		avg = ept->rx_latency_total_us;
+		if (ept->rx_pkts > pending)
+			do_div(avg, ept->rx_pkts - pending);
+		else
+			avg = 0;
+
+		sym = smd_rpc_get_sym(be32_to_cpu(ept->dst_prog));
+		if (sym)
+			i += scnprintf(buf + i, max - i, "%08x %-20.20s",
+				       ept->cid, sym);
+		else
+			i += scnprintf(buf + i, max - i, "%08x %08x%12s",
+				       ept->cid, be32_to_cpu(ept->dst_prog),
+				       "");
+		i += scnprintf(buf + i, max - i, " %8u %8u %8u %8llu %8u\n",
+			       ept->rx_pkts, ept->tx_pkts, pending,
+			       (unsigned long long)avg,
+			       ept->rx_latency_max_us);
+		spin_unlock(&ept->read_q_lock);
+	}
+	spin_unlock_irqrestore(&local_endpoints_lock, flags);
+
+	return i;
+}
+
 #define DEBUG_BUFMAX 4096
 static char debug_buffer[DEBUG_BUFMAX];
 
@@ -2275,6 +2377,8 @@ static void debugfs_init(void)
 		     dump_remote_endpoints);
 	debug_create("dump_servers", 0444, dent,
 		     dump_servers);
+	debug_create("ept_stats", 0444, dent,
+		     dump_ept_stats);
 
 }
 
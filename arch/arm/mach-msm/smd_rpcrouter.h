@@ -24,6 +24,7 @@
 #include <linux/platform_device.h>
 #include <linux/msm_rpcrouter.h>
 #include <linux/wakelock.h>
+#include <linux/ktime.h>
 
 #include <mach/msm_smd.h>
 #include <mach/msm_rpcrouter.h>
@@ -116,6 +117,7 @@ struct rr_packet {
 	struct rr_header hdr;
 	uint32_t mid;
 	uint32_t length;
+	ktime_t arrival;
 };
 
 #define PACMARK_LAST(n) ((n) & 0x80000000)
@@ -133,6 +135,7 @@ static inline uint32_t PACMARK(uint32_t len, uint32_t mid, uint32_t first,
 
 struct rr_server {
 	struct list_head list;
+	struct hlist_node hash;
 
 	uint32_t pid;
 	uint32_t cid;
@@ -156,6 +159,7 @@ struct rr_remote_endpoint {
 	wait_queue_head_t quota_wait;
 
 	struct list_head list;
+	struct hlist_node hash;
 };
 
 struct msm_rpc_reply {
@@ -169,6 +173,7 @@ struct msm_rpc_reply {
 
 struct msm_rpc_endpoint {
 	struct list_head list;
+	struct hlist_node hash;
 
 	/* incomplete packets waiting for assembly */
 	struct list_head incomplete;
@@ -215,6 +220,15 @@ struct msm_rpc_endpoint {
 
 	/* device node if this endpoint is accessed via userspace */
 	dev_t dev;
+
+	/* statistics, protected by read_q_lock */
+	uint32_t rx_pkts;
+	uint32_t rx_bytes;
+	uint32_t tx_pkts;
+	uint32_t tx_bytes;
+	/* time packets spend on read_q before being picked up */
+	uint32_t rx_latency_max_us;
+	uint64_t rx_latency_total_us;
 };
 
 enum write_data_type {
@@ -11,6 +11,7 @@
 #include <linux/module.h>
 #include <linux/types.h>
 #include <linux/cpu.h>
+#include <linux/hardirq.h>
 #include <linux/kernel.h>
 #include <linux/notifier.h>
 #include <linux/signal.h>
@@ -19,6 +20,7 @@
 #include <linux/init.h>
 
 #include <asm/cputype.h>
+#include <asm/neon.h>
 #include <asm/thread_notify.h>
 #include <asm/vfp.h>
 
@@ -517,6 +519,47 @@ void vfp_flush_hwstate(struct thread_info *thread)
 	put_cpu();
 }
 
+#ifdef CONFIG_NEON
+void kernel_neon_begin(void)
+{
+	u32 fpexc;
+	unsigned int cpu;
+
+	BUG_ON(in_interrupt());
+	cpu = get_cpu();
+
+	fpexc = fmrx(FPEXC);
+	fmxr(FPEXC, fpexc | FPEXC_EN);
+	isb();
+
+#ifdef CONFIG_SMP
+	/* Only live (enabled) state differs from the copy saved on switch */
+	if ((fpexc & FPEXC_EN) && last_VFP_context[cpu]) {
+		vfp_save_state(last_VFP_context[cpu], fpexc);
+		last_VFP_context[cpu]->hard.cpu = cpu;
+	}
+#else
+	/*
+	 * The owner may not be current and has never been saved.  FPEXC
+	 * is restored from the saved copy, so save it enabled as
+	 * vfp_sync_hwstate() does.
+	 */
+	if (last_VFP_context[cpu])
+		vfp_save_state(last_VFP_context[cpu], fpexc | FPEXC_EN);
+#endif
+	/* Force the owner to reload its registers on next use */
+	last_VFP_context[cpu] = NULL;
+}
+EXPORT_SYMBOL(kernel_neon_begin);
+
+void kernel_neon_end(void)
+{
+	fmxr(FPEXC, fmrx(FPEXC) & ~FPEXC_EN);
+	put_cpu();
+}
+EXPORT_SYMBOL(kernel_neon_end);
+#endif /* CONFIG_NEON */
+
 /*
  * VFP hardware can lose all context when a CPU goes offline.
  * Safely clear our held state when a CPU has been killed, and
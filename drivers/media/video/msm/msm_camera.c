@@ -34,6 +34,11 @@
 #include <mach/camera.h>
 #include <linux/syscalls.h>
 #include <linux/hrtimer.h>
+#include <linux/hash.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/eventfd.h>
+#include <linux/dma-mapping.h>
 DEFINE_MUTEX(ctrl_cmd_lock);
 
 #define CAMERA_STOP_VIDEO 58
@@ -145,8 +150,14 @@ static inline void free_qcmd(struct msm_queue_cmd *qcmd)
 
 static void msm_region_init(struct msm_sync *sync)
 {
+	int i;
+
 	INIT_HLIST_HEAD(&sync->pmem_frames);
 	INIT_HLIST_HEAD(&sync->pmem_stats);
+	for (i = 0; i < MSM_PMEM_HASH_SIZE; i++) {
+		INIT_HLIST_HEAD(&sync->pmem_frames_phash[i]);
+		INIT_HLIST_HEAD(&sync->pmem_frames_vhash[i]);
+	}
 	spin_lock_init(&sync->pmem_frame_spinlock);
 	spin_lock_init(&sync->pmem_stats_spinlock);
 }
@@ -178,6 +189,15 @@ static void msm_enqueue(struct msm_device_queue *queue,
 	spin_unlock_irqrestore(&queue->lock, flags);
 }
 
+/* Frames for the frame thread; kick the ring worker if the ring is in use. */
+static void msm_enqueue_frame(struct msm_sync *sync,
+		struct list_head *entry)
+{
+	msm_enqueue(&sync->frame_q, entry);
+	if (sync->frame_ring)
+		schedule_work(&sync->frame_ring_work);
+}
+
 static void msm_enqueue_vpe(struct msm_device_queue *queue,
 		struct list_head *entry)
 {
@@ -248,6 +268,70 @@ static void msm_enqueue_vpe(struct msm_device_queue *queue,
 	spin_unlock_irqrestore(&__q->lock, flags);		\
 } while (0)
 
+static inline struct hlist_head *msm_pmem_phash(struct msm_sync *sync,
+		unsigned long pyaddr)
+{
+	return &sync->pmem_frames_phash[hash_long(pyaddr, MSM_PMEM_HASH_BITS)];
+}
+
+static inline struct hlist_head *msm_pmem_vhash(struct msm_sync *sync,
+		unsigned long vaddr)
+{
+	return &sync->pmem_frames_vhash[hash_long(vaddr, MSM_PMEM_HASH_BITS)];
+}
+
+/* Must be called with pmem_frame_spinlock held. */
+static void msm_pmem_frame_unlink(struct msm_pmem_region *region)
+{
+	hlist_del(&region->list);
+	hlist_del(&region->pnode);
+	hlist_del(&region->vnode);
+}
+
+static void msm_frame_stats_miss(struct msm_sync *sync, int vtop)
+{
+	struct msm_frame_stats *st = &sync->frame_stats;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sync->frame_stats_lock, flags);
+	if (vtop)
+		st->vtop_misses++;
+	else
+		st->ptov_misses++;
+	spin_unlock_irqrestore(&sync->frame_stats_lock, flags);
+}
+
+/* Upper bounds, in microseconds, of all but the last latency bucket. */
+static const uint32_t msm_frame_latency_us[MSM_FRAME_LATENCY_BUCKETS - 1] = {
+	1000, 5000, 10000, 33333, 66666,
+};
+
+static void msm_frame_stats_update(struct msm_sync *sync,
+		struct timespec *done)
+{
+	struct msm_frame_stats *st = &sync->frame_stats;
+	struct timespec now;
+	unsigned long flags;
+	uint32_t us;
+	int i;
+
+	ktime_get_ts(&now);
+	now = timespec_sub(now, *done);
+	us = now.tv_sec * USEC_PER_SEC + now.tv_nsec / NSEC_PER_USEC;
+
+	for (i = 0; i < MSM_FRAME_LATENCY_BUCKETS - 1; i++)
+		if (us < msm_frame_latency_us[i])
+			break;
+
+	spin_lock_irqsave(&sync->frame_stats_lock, flags);
+	st->frames++;
+	st->total_us += us;
+	if (us > st->max_us)
+		st->max_us = us;
+	st->hist[i]++;
+	spin_unlock_irqrestore(&sync->frame_stats_lock, flags);
+}
+
 static int check_overlap(struct hlist_head *ptype,
 			unsigned long paddr,
 			unsigned long len)
@@ -341,6 +425,15 @@ static int msm_pmem_table_add(struct hlist_head *ptype,
 	memcpy(&region->info, info, sizeof(region->info));
 
 	hlist_add_head(&(region->list), ptype);
+	if (ptype == &sync->pmem_frames) {
+		hlist_add_head(&region->pnode,
+			msm_pmem_phash(sync, paddr + info->y_off));
+		hlist_add_head(&region->vnode,
+			msm_pmem_vhash(sync, (unsigned long)info->vaddr));
+	} else {
+		INIT_HLIST_NODE(&region->pnode);
+		INIT_HLIST_NODE(&region->vnode);
+	}
 	spin_unlock_irqrestore(pmem_spinlock, flags);
 	CDBG("%s: type %d, paddr 0x%lx, vaddr 0x%lx\n",
 		__func__, info->type, paddr, (unsigned long)info->vaddr);
@@ -430,7 +523,8 @@ static int msm_pmem_frame_ptov_lookup(struct msm_sync *sync,
 	unsigned long flags = 0;
 
 	spin_lock_irqsave(&sync->pmem_frame_spinlock, flags);
-	hlist_for_each_entry_safe(region, node, n, &sync->pmem_frames, list) {
+	hlist_for_each_entry(region, node, msm_pmem_phash(sync, pyaddr),
+			pnode) {
 		if (pyaddr == (region->paddr + region->info.y_off) &&
 				pcbcraddr == (region->paddr +
 						region->info.cbcr_off) &&
@@ -457,6 +551,7 @@ static int msm_pmem_frame_ptov_lookup(struct msm_sync *sync,
 	}
 
 	spin_unlock_irqrestore(&sync->pmem_frame_spinlock, flags);
+	msm_frame_stats_miss(sync, 0);
 	return -EINVAL;
 }
 
@@ -466,11 +561,12 @@ static int msm_pmem_frame_ptov_lookup2(struct msm_sync *sync,
 		int clear_active)
 {
 	struct msm_pmem_region *region;
-	struct hlist_node *node, *n;
+	struct hlist_node *node;
 	unsigned long flags = 0;
 
 	spin_lock_irqsave(&sync->pmem_frame_spinlock, flags);
-	hlist_for_each_entry_safe(region, node, n, &sync->pmem_frames, list) {
+	hlist_for_each_entry(region, node, msm_pmem_phash(sync, pyaddr),
+			pnode) {
 		if (pyaddr == (region->paddr + region->info.y_off) &&
 				region->info.active) {
 			/* offset since we could pass vaddr inside
@@ -530,8 +626,8 @@ static unsigned long msm_pmem_frame_vtop_lookup(struct msm_sync *sync,
 	unsigned long flags = 0;
 
 	spin_lock_irqsave(&sync->pmem_frame_spinlock, flags);
-	hlist_for_each_entry_safe(region,
-		node, n, &sync->pmem_frames, list) {
+	hlist_for_each_entry(region, node, msm_pmem_vhash(sync, buffer),
+			vnode) {
 		if (((unsigned long)(region->info.vaddr) == buffer) &&
 				(region->info.y_off == yoff) &&
 				(region->info.cbcr_off == cbcroff) &&
@@ -555,6 +651,7 @@ static unsigned long msm_pmem_frame_vtop_lookup(struct msm_sync *sync,
 	}
 
 	spin_unlock_irqrestore(&sync->pmem_frame_spinlock, flags);
+	msm_frame_stats_miss(sync, 1);
 
 	return 0;
 }
@@ -615,7 +712,7 @@ static int __msm_pmem_table_del(struct msm_sync *sync,
 			if (pinfo->type == region->info.type &&
 					pinfo->vaddr == region->info.vaddr &&
 					pinfo->fd == region->info.fd) {
-				hlist_del(node);
+				msm_pmem_frame_unlink(region);
 				put_pmem_file(region->file);
 				kfree(region);
 				CDBG("%s: type %d, vaddr  0x%p\n",
@@ -635,7 +732,7 @@ static int __msm_pmem_table_del(struct msm_sync *sync,
 				(region->info.type == MSM_PMEM_VIDEO_VPE)) &&
 				pinfo->vaddr == region->info.vaddr &&
 				pinfo->fd == region->info.fd) {
-				hlist_del(node);
+				msm_pmem_frame_unlink(region);
 				put_pmem_file(region->file);
 				kfree(region);
 				CDBG("%s: type %d, vaddr  0x%p\n",
@@ -726,6 +823,8 @@ static int __msm_get_frame(struct msm_sync *sync,
 		goto err;
 	}
 
+	msm_frame_stats_update(sync, &qcmd->ts);
+
 	frame->ts = qcmd->ts;
 	frame->buffer = (unsigned long)pmem_info.vaddr;
 	frame->y_off = pmem_info.y_off;
@@ -2079,6 +2178,170 @@ static int msm_put_frame_buffer(struct msm_sync *sync, void __user *arg)
 }
 
 
+/* Hand the buffers userspace released through the ring back to the VFE.
+ * Called with frame_ring_lock held.
+ */
+static void msm_frame_ring_release(struct msm_sync *sync,
+		struct msm_frame_ring *ring)
+{
+	struct msm_frame_ring_entry *e;
+	struct msm_frame frame;
+	uint32_t head = ACCESS_ONCE(ring->rel_head);
+	int n = 0;
+
+	smp_rmb();
+	while (ring->rel_tail != head && n++ < MSM_FRAME_RING_SIZE) {
+		e = &ring->rel[ring->rel_tail % MSM_FRAME_RING_SIZE];
+		memset(&frame, 0, sizeof(frame));
+		frame.buffer = e->buffer;
+		frame.y_off = e->y_off;
+		frame.cbcr_off = e->cbcr_off;
+		frame.fd = e->fd;
+		frame.path = e->path;
+		__msm_put_frame_buf(sync, &frame);
+		ring->rel_tail++;
+	}
+}
+
+/* Move finished frames from frame_q into the ring.  Frames that do not
+ * fit stay queued until userspace catches up.  Called with
+ * frame_ring_lock held; returns the number of frames delivered.
+ */
+static int msm_frame_ring_fill(struct msm_sync *sync,
+		struct msm_frame_ring *ring)
+{
+	struct msm_frame_ring_entry *e;
+	struct msm_frame frame;
+	int n = 0;
+
+	while (ring->done_head - ACCESS_ONCE(ring->done_tail) <
+			MSM_FRAME_RING_SIZE) {
+		if (list_empty_careful(&sync->frame_q.list))
+			break;
+		memset(&frame, 0, sizeof(frame));
+		if (__msm_get_frame(sync, &frame) < 0)
+			continue;
+
+		e = &ring->done[ring->done_head % MSM_FRAME_RING_SIZE];
+		e->ts = frame.ts;
+		e->buffer = frame.buffer;
+		e->y_off = frame.y_off;
+		e->cbcr_off = frame.cbcr_off;
+		e->fd = frame.fd;
+		e->path = frame.path;
+		e->frame_id = frame.frame_id;
+		e->error_code = frame.error_code;
+		smp_wmb();
+		ring->done_head++;
+		n++;
+	}
+	return n;
+}
+
+static void msm_frame_ring_sync(struct msm_sync *sync)
+{
+	int n = 0;
+
+	mutex_lock(&sync->frame_ring_lock);
+	if (sync->frame_ring) {
+		msm_frame_ring_release(sync, sync->frame_ring);
+		n = msm_frame_ring_fill(sync, sync->frame_ring);
+		if (n && sync->frame_ring_evt)
+			eventfd_signal(sync->frame_ring_evt, n);
+	}
+	mutex_unlock(&sync->frame_ring_lock);
+
+	if (n)
+		wake_up(&sync->frame_q.wait);
+}
+
+static void msm_frame_ring_work(struct work_struct *work)
+{
+	struct msm_sync *sync =
+		container_of(work, struct msm_sync, frame_ring_work);
+
+	msm_frame_ring_sync(sync);
+}
+
+static int msm_frame_ring_setup(struct msm_sync *sync, void __user *arg)
+{
+	struct msm_frame_ring_cfg cfg;
+	struct eventfd_ctx *evt = NULL;
+	struct msm_frame_ring *ring;
+
+	if (copy_from_user(&cfg, arg, sizeof(cfg))) {
+		ERR_COPY_FROM_USER();
+		return -EFAULT;
+	}
+
+	if (cfg.eventfd >= 0) {
+		evt = eventfd_ctx_fdget(cfg.eventfd);
+		if (IS_ERR(evt))
+			return PTR_ERR(evt);
+	}
+
+	mutex_lock(&sync->frame_ring_lock);
+	if (!sync->frame_ring) {
+		/* uncached on both sides, so no aliasing with the user
+		 * mapping on VIPT caches
+		 */
+		ring = dma_alloc_coherent(NULL, PAGE_SIZE,
+			&sync->frame_ring_dma, GFP_KERNEL);
+		if (!ring) {
+			mutex_unlock(&sync->frame_ring_lock);
+			if (evt)
+				eventfd_ctx_put(evt);
+			return -ENOMEM;
+		}
+		memset(ring, 0, PAGE_SIZE);
+		sync->frame_ring = ring;
+	}
+	if (sync->frame_ring_evt)
+		eventfd_ctx_put(sync->frame_ring_evt);
+	sync->frame_ring_evt = evt;
+	mutex_unlock(&sync->frame_ring_lock);
+
+	/* pick up anything that was queued before the ring existed */
+	schedule_work(&sync->frame_ring_work);
+	return 0;
+}
+
+static void msm_frame_ring_free(struct msm_sync *sync)
+{
+	struct msm_frame_ring *ring;
+
+	mutex_lock(&sync->frame_ring_lock);
+	ring = sync->frame_ring;
+	sync->frame_ring = NULL;
+	if (sync->frame_ring_evt)
+		eventfd_ctx_put(sync->frame_ring_evt);
+	sync->frame_ring_evt = NULL;
+	mutex_unlock(&sync->frame_ring_lock);
+
+	cancel_work_sync(&sync->frame_ring_work);
+	if (ring)
+		dma_free_coherent(NULL, PAGE_SIZE, ring,
+			sync->frame_ring_dma);
+}
+
+static int msm_mmap_frame(struct file *filep, struct vm_area_struct *vma)
+{
+	struct msm_cam_device *pmsm = filep->private_data;
+	struct msm_sync *sync = pmsm->sync;
+	int rc = -EINVAL;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+
+	mutex_lock(&sync->frame_ring_lock);
+	if (sync->frame_ring)
+		rc = dma_mmap_coherent(NULL, vma,
+			sync->frame_ring, sync->frame_ring_dma, PAGE_SIZE);
+	mutex_unlock(&sync->frame_ring_lock);
+
+	return rc;
+}
+
 static int msm_put_pic_buffer(struct msm_sync *sync, void __user *arg)
 {
 	struct msm_frame buf_t;
@@ -2464,7 +2727,7 @@ static int msm_error_config(struct msm_sync *sync, void __user *arg)
 
 	pr_err("%s: Enqueue Fake Frame with error code = %d\n", __func__,
 		qcmd->error_code);
-	msm_enqueue(&sync->frame_q, &qcmd->list_frame);
+	msm_enqueue_frame(sync, &qcmd->list_frame);
 	return 0;
 }
 
@@ -2678,7 +2941,7 @@ static int msm_pp_release(struct msm_sync *sync, void __user *arg)
 
 			if (sync->frame_q.len <= 100 &&
 				sync->event_q.len <= 100) {
-					msm_enqueue(&sync->frame_q,
+					msm_enqueue_frame(sync,
 						&sync->pp_prev->list_frame);
 			} else {
 				pr_err("%s, Error Queue limit exceeded f_q=%d,\
@@ -2929,6 +3192,13 @@ static long msm_ioctl_frame(struct file *filep, unsigned int cmd,
 	case MSM_CAM_IOCTL_UNBLOCK_POLL_FRAME:
 		rc = msm_unblock_poll_frame(pmsm->sync);
 		break;
+	case MSM_CAM_IOCTL_FRAME_RING_SETUP:
+		rc = msm_frame_ring_setup(pmsm->sync, argp);
+		break;
+	case MSM_CAM_IOCTL_FRAME_RING_SYNC:
+		msm_frame_ring_sync(pmsm->sync);
+		rc = 0;
+		break;
 	default:
 		break;
 	}
@@ -3040,7 +3310,7 @@ static int __msm_release(struct msm_sync *sync)
 		CDBG("%s, free frame pmem region\n", __func__);
 		hlist_for_each_entry_safe(region, hnode, n,
 				&sync->pmem_frames, list) {
-			hlist_del(hnode);
+			msm_pmem_frame_unlink(region);
 			put_pmem_file(region->file);
 			kfree(region);
 		}
@@ -3102,6 +3372,7 @@ static int msm_release_frame(struct inode *node, struct file *filep)
 	int rc;
 	struct msm_cam_device *pmsm = filep->private_data;
 	pr_info("%s: %s\n", __func__, filep->f_path.dentry->d_name.name);
+	msm_frame_ring_free(pmsm->sync);
 	rc = __msm_release(pmsm->sync);
 	if (!rc) {
 		msm_queue_drain(&pmsm->sync->frame_q, list_frame);
@@ -3152,11 +3423,23 @@ static unsigned int __msm_poll_frame(struct msm_sync *sync,
 {
 	int rc = 0;
 	unsigned long flags;
+	struct msm_frame_ring *ring;
 
 	poll_wait(filep, &sync->frame_q.wait, pll_table);
 
+	/* a concurrent FRAME_RING_SETUP ioctl on this file may be
+	 * installing the ring; the lock orders its memset before our reads
+	 */
+	mutex_lock(&sync->frame_ring_lock);
+	ring = sync->frame_ring;
+	if (ring && ACCESS_ONCE(ring->rel_head) != ring->rel_tail)
+		schedule_work(&sync->frame_ring_work);
+
 	spin_lock_irqsave(&sync->frame_q.lock, flags);
-	if (!list_empty_careful(&sync->frame_q.list))
+	if (ring) {
+		if (ring->done_head != ACCESS_ONCE(ring->done_tail))
+			rc = POLLIN | POLLRDNORM;
+	} else if (!list_empty_careful(&sync->frame_q.list))
 		/* frame ready */
 		rc = POLLIN | POLLRDNORM;
 	if (sync->unblock_poll_frame) {
@@ -3165,6 +3448,7 @@ static unsigned int __msm_poll_frame(struct msm_sync *sync,
 		sync->unblock_poll_frame = 0;
 	}
 	spin_unlock_irqrestore(&sync->frame_q.lock, flags);
+	mutex_unlock(&sync->frame_ring_lock);
 
 	return rc;
 }
@@ -3345,7 +3629,7 @@ static void msm_vfe_sync(struct msm_vfe_resp *vdata,
 				sync->event_q.len <= 100) {
 				if (atomic_read(&qcmd->on_heap))
 					atomic_add(1, &qcmd->on_heap);
-				msm_enqueue(&sync->frame_q, &qcmd->list_frame);
+				msm_enqueue_frame(sync, &qcmd->list_frame);
 			} else {
 				pr_err("%s, Error Queue limit exceeded "
 					"f_q = %d, e_q = %d\n",	__func__,
@@ -3511,7 +3795,7 @@ static void msm_vfe_sync(struct msm_vfe_resp *vdata,
 				}
 				if (sync->frame_q.len <= 100 &&
 					sync->event_q.len <= 100) {
-						msm_enqueue(&sync->frame_q,
+						msm_enqueue_frame(sync,
 							&qcmd->list_frame);
 				} else {
 					pr_err("%s, Error Queue limit exceeded\
@@ -3527,7 +3811,7 @@ static void msm_vfe_sync(struct msm_vfe_resp *vdata,
 			CDBG("%s: msm_enqueue video frame_q\n",	__func__);
 			if (sync->frame_q.len <= 100 &&
 				sync->event_q.len <= 100) {
-				msm_enqueue(&sync->frame_q, &qcmd->list_frame);
+				msm_enqueue_frame(sync, &qcmd->list_frame);
 			} else {
 				pr_err("%s, Error Queue limit exceeded\
 					f_q = %d, e_q = %d\n",
@@ -3617,7 +3901,7 @@ static void msm_vpe_sync(struct msm_vpe_resp *vdata,
 		}
 		if (sync->frame_q.len <= 100 && sync->event_q.len <= 100) {
 			CDBG("%s: enqueue to frame_q from VPE\n", __func__);
-			msm_enqueue(&sync->frame_q, &qcmd->list_frame);
+			msm_enqueue_frame(sync, &qcmd->list_frame);
 		} else {
 			pr_err("%s, Error Queue limit exceeded f_q = %d, "
 				"e_q = %d\n", __func__, sync->frame_q.len,
@@ -3661,7 +3945,7 @@ static void msm_vpe_sync(struct msm_vpe_resp *vdata,
 			if (sync->stereo_state == STEREO_VIDEO_ACTIVE) {
 				CDBG("%s: st frame to frame_q from VPE\n",
 					__func__);
-				msm_enqueue(&sync->frame_q, &qcmd->list_frame);
+				msm_enqueue_frame(sync, &qcmd->list_frame);
 			}
 		}
 		spin_unlock_irqrestore(&pp_stereocam_spinlock, flags);
@@ -3839,6 +4123,7 @@ static const struct file_operations msm_fops_frame = {
 	.unlocked_ioctl = msm_ioctl_frame,
 	.release = msm_release_frame,
 	.poll = msm_poll_frame,
+	.mmap = msm_mmap_frame,
 };
 
 static const struct file_operations msm_fops_pic = {
@@ -3888,6 +4173,85 @@ static int msm_tear_down_cdev(struct msm_cam_device *msm, dev_t devno)
 	return 0;
 }
 
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *msm_debugfs_root;
+
+static int msm_frame_stats_show(struct seq_file *m, void *unused)
+{
+	struct msm_sync *sync = m->private;
+	struct msm_frame_stats st;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&sync->frame_stats_lock, flags);
+	st = sync->frame_stats;
+	spin_unlock_irqrestore(&sync->frame_stats_lock, flags);
+
+	seq_printf(m, "frames %u\n", st.frames);
+	seq_printf(m, "avg_latency_us %llu\n",
+		st.frames ? div_u64(st.total_us, st.frames) : 0);
+	seq_printf(m, "max_latency_us %u\n", st.max_us);
+	seq_printf(m, "ptov_misses %u\n", st.ptov_misses);
+	seq_printf(m, "vtop_misses %u\n", st.vtop_misses);
+	for (i = 0; i < MSM_FRAME_LATENCY_BUCKETS - 1; i++)
+		seq_printf(m, "latency_lt_%uus %u\n",
+			msm_frame_latency_us[i], st.hist[i]);
+	seq_printf(m, "latency_ge_%uus %u\n",
+		msm_frame_latency_us[i - 1], st.hist[i]);
+	return 0;
+}
+
+static int msm_frame_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, msm_frame_stats_show, inode->i_private);
+}
+
+/* Any write clears the statistics. */
+static ssize_t msm_frame_stats_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct msm_sync *sync = m->private;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sync->frame_stats_lock, flags);
+	memset(&sync->frame_stats, 0, sizeof(sync->frame_stats));
+	spin_unlock_irqrestore(&sync->frame_stats_lock, flags);
+
+	return count;
+}
+
+static const struct file_operations msm_frame_stats_fops = {
+	.open = msm_frame_stats_open,
+	.read = seq_read,
+	.write = msm_frame_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void msm_debugfs_init(struct msm_sync *sync)
+{
+	if (!msm_debugfs_root) {
+		msm_debugfs_root = debugfs_create_dir("msm_camera", NULL);
+		if (IS_ERR_OR_NULL(msm_debugfs_root)) {
+			msm_debugfs_root = NULL;
+			return;
+		}
+	}
+
+	sync->debugfs_dir = debugfs_create_dir(sync->sdata->sensor_name,
+		msm_debugfs_root);
+	if (IS_ERR_OR_NULL(sync->debugfs_dir)) {
+		sync->debugfs_dir = NULL;
+		return;
+	}
+	debugfs_create_file("frame_stats", S_IRUGO | S_IWUSR,
+		sync->debugfs_dir, sync, &msm_frame_stats_fops);
+}
+#else
+static inline void msm_debugfs_init(struct msm_sync *sync) { }
+#endif
+
 static int msm_sync_init(struct msm_sync *sync,
 		struct platform_device *pdev,
 		int (*sensor_probe)(const struct msm_camera_sensor_info *,
@@ -3928,6 +4292,10 @@ static int msm_sync_init(struct msm_sync *sync,
 	sync->ignore_qcmd = false;
 	sync->ignore_qcmd_type = -1;
 	mutex_init(&sync->lock);
+	mutex_init(&sync->frame_ring_lock);
+	INIT_WORK(&sync->frame_ring_work, msm_frame_ring_work);
+	spin_lock_init(&sync->frame_stats_lock);
+	msm_debugfs_init(sync);
 	if (sync->sdata->strobe_flash_data) {
 		sync->sdata->strobe_flash_data->state = 0;
 		spin_lock_init(&sync->sdata->strobe_flash_data->spin_lock);
@@ -3938,6 +4306,7 @@ static int msm_sync_init(struct msm_sync *sync,
 
 static int msm_sync_destroy(struct msm_sync *sync)
 {
+	debugfs_remove_recursive(sync->debugfs_dir);
 	wake_lock_destroy(&sync->wake_lock);
 	return 0;
 }
@@ -24,6 +24,8 @@
 #include <linux/android_pmem.h>
 #include <linux/mempolicy.h>
 #include <linux/kobject.h>
+#include <linux/ktime.h>
+#include <linux/smp.h>
 #ifdef CONFIG_MEMORY_HOTPLUG
 #include <linux/memory.h>
 #include <linux/memory_hotplug.h>
@@ -68,6 +70,11 @@
  */
 #define PMEM_FLAGS_SUBMAP 0x1 << 3
 #define PMEM_FLAGS_UNSUBMAP 0x1 << 4
+/* the physical address of the allocation has been handed out (to a kernel
+ * driver, to user space or to a connected file), it must never be moved */
+#define PMEM_FLAGS_PINNED 0x1 << 5
+/* map this file cached even if the region is not (PMEM_SET_CACHED) */
+#define PMEM_FLAGS_CACHED 0x1 << 6
 
 struct pmem_data {
 	/* in alloc mode: an index into the bitmap
@@ -85,6 +92,8 @@ struct pmem_data {
 	struct task_struct *task;
 	/* process id of teh mapping process */
 	pid_t pid;
+	/* number of vmas currently mapping this file */
+	int map_count;
 	/* file descriptor of the master */
 	int master_fd;
 	/* file struct of the master */
@@ -210,7 +219,11 @@ struct pmem_info {
 			struct {
 				short bit;
 				unsigned short quanta;
+				/* alignment of the allocation, in quanta */
+				unsigned short spacing;
 			} *bitm_alloc;
+			/* compact the region when an allocation fails */
+			unsigned auto_compact;
 		} bitmap;
 
 		struct {
@@ -234,6 +247,21 @@ struct pmem_info {
 	 */
 	struct mutex arena_mutex;
 
+	/* allocation and compaction statistics, protected by arena_mutex */
+	struct {
+		unsigned long allocs;
+		unsigned long failures;
+		/* failures although enough quanta were free in total */
+		unsigned long frag_failures;
+		/* of those, the ones that succeeded after compaction */
+		unsigned long rescued;
+		u64 total_ns;
+		u64 max_ns;
+		unsigned long compactions;
+		unsigned long moved;
+		unsigned long moved_bytes;
+	} stats;
+
 	long (*ioctl)(struct file *, unsigned int, unsigned long);
 	int (*release)(struct inode *, struct file *);
 };
@@ -274,6 +302,7 @@ static int pmem_release(struct inode *, struct file *);
 static int pmem_mmap(struct file *, struct vm_area_struct *);
 static int pmem_open(struct inode *, struct file *);
 static long pmem_ioctl(struct file *, unsigned int, unsigned long);
+static int pmem_compact(int id, int wait);
 
 struct file_operations pmem_fops = {
 	.release = pmem_release,
@@ -515,6 +544,80 @@ static ssize_t show_pmem_bits_allocated(int id, char *buf)
 }
 RO_PMEM_ATTR(bits_allocated);
 
+static ssize_t show_pmem_fragmentation(int id, char *buf)
+{
+	const unsigned long *map =
+		(const unsigned long *)pmem[id].allocator.bitmap.bitmap;
+	unsigned int total = pmem[id].num_entries;
+	unsigned int start, end, largest = 0, chunks = 0, free;
+
+	mutex_lock(&pmem[id].arena_mutex);
+	free = pmem[id].allocator.bitmap.bitmap_free;
+	for (start = find_first_zero_bit(map, total); start < total;
+	     start = find_next_zero_bit(map, total, end)) {
+		end = find_next_bit(map, total, start);
+		largest = max(largest, end - start);
+		chunks++;
+	}
+	mutex_unlock(&pmem[id].arena_mutex);
+
+	/* share of the free quanta not usable by the largest allocation */
+	return scnprintf(buf, PAGE_SIZE,
+		"free_quanta %u\nlargest_free_quanta %u\nfree_chunks %u\n"
+		"fragmentation %u%%\n", free, largest, chunks,
+		free ? 100 - largest * 100 / free : 0);
+}
+RO_PMEM_ATTR(fragmentation);
+
+static ssize_t show_pmem_alloc_stats(int id, char *buf)
+{
+	ssize_t ret;
+
+	mutex_lock(&pmem[id].arena_mutex);
+	ret = scnprintf(buf, PAGE_SIZE,
+		"allocations %lu\nfailures %lu\nfragmentation_failures %lu\n"
+		"rescued_by_compaction %lu\navg_latency_us %llu\n"
+		"max_latency_us %llu\ncompactions %lu\nmoved %lu\n"
+		"moved_bytes %lu\n",
+		pmem[id].stats.allocs, pmem[id].stats.failures,
+		pmem[id].stats.frag_failures, pmem[id].stats.rescued,
+		pmem[id].stats.allocs ?
+			div_u64(pmem[id].stats.total_ns,
+				pmem[id].stats.allocs) / NSEC_PER_USEC : 0,
+		div_u64(pmem[id].stats.max_ns, NSEC_PER_USEC),
+		pmem[id].stats.compactions, pmem[id].stats.moved,
+		pmem[id].stats.moved_bytes);
+	mutex_unlock(&pmem[id].arena_mutex);
+	return ret;
+}
+RO_PMEM_ATTR(alloc_stats);
+
+static ssize_t show_pmem_auto_compact(int id, char *buf)
+{
+	return scnprintf(buf, PAGE_SIZE, "%u\n",
+		pmem[id].allocator.bitmap.auto_compact);
+}
+
+static ssize_t store_pmem_auto_compact(int id, const char *buf,
+		const size_t count)
+{
+	unsigned long val;
+
+	if (strict_strtoul(buf, 10, &val))
+		return -EINVAL;
+	pmem[id].allocator.bitmap.auto_compact = !!val;
+	return count;
+}
+RW_PMEM_ATTR(auto_compact);
+
+static ssize_t store_pmem_compact(int id, const char *buf,
+		const size_t count)
+{
+	pmem_compact(id, 1);
+	return count;
+}
+WO_PMEM_ATTR(compact);
+
 static struct attribute *pmem_bitmap_attrs[] = {
 	PMEM_COMMON_SYSFS_ATTRS,
 
@@ -522,6 +625,10 @@ static struct attribute *pmem_bitmap_attrs[] = {
 
 	&pmem_attr_free_quanta.attr,
 	&pmem_attr_bits_allocated.attr,
+	&pmem_attr_fragmentation.attr,
+	&pmem_attr_alloc_stats.attr,
+	&pmem_attr_auto_compact.attr,
+	&pmem_attr_compact.attr,
 
 	NULL
 };
@@ -914,6 +1021,7 @@ static int pmem_open(struct inode *inode, struct file *file)
 	data->task = NULL;
 	data->vma = NULL;
 	data->pid = 0;
+	data->map_count = 0;
 	data->master_file = NULL;
 #if PMEM_DEBUG
 	data->ref = 0;
@@ -1054,61 +1162,34 @@ static void bitmap_bits_set_all(uint32_t *bitp, int bit_start, int bit_end)
 	}
 }
 
-static int
-bitmap_allocate_contiguous(uint32_t *bitp, int num_bits_to_alloc,
-		int total_bits, int spacing)
+/*
+ * Find num_bits free bits starting on a multiple of spacing.  With bestfit
+ * set the smallest free run that can hold them is used, which keeps large
+ * runs intact for large requests; otherwise the lowest one is.
+ */
+static int bitmap_find_free(const uint32_t *bitp, int num_bits,
+		int total_bits, int spacing, int bestfit)
 {
-	int bit_start, last_bit, word_index;
+	const unsigned long *map = (const unsigned long *)bitp;
+	int start, end, aligned, best = -1, best_len = total_bits + 1;
 
-	if (num_bits_to_alloc <= 0)
+	if (num_bits <= 0)
 		return -1;
 
-	for (bit_start = 0; ;
-		bit_start = (last_bit +
-			(word_index << PMEM_32BIT_WORD_ORDER) + spacing - 1)
-			& ~(spacing - 1)) {
-		int bit_end = bit_start + num_bits_to_alloc, total_words;
-
-		if (bit_end > total_bits)
-			return -1; /* out of contiguous memory */
-
-		word_index = bit_start >> PMEM_32BIT_WORD_ORDER;
-		total_words = compute_total_words(bit_end, word_index);
-
-		if (total_words <= 0)
-			return -1;
-
-		if (total_words == 1) {
-			last_bit = fls(bitp[word_index] &
-					(start_mask(bit_start) &
-						end_mask(bit_end)));
-			if (last_bit)
-				continue;
-		} else {
-			int end_word = word_index + (total_words - 1);
-			last_bit =
-				fls(bitp[word_index] & start_mask(bit_start));
-			if (last_bit)
-				continue;
-
-			for (word_index++;
-					word_index < end_word;
-					word_index++) {
-				last_bit = fls(bitp[word_index]);
-				if (last_bit)
-					break;
-			}
-			if (last_bit)
-				continue;
+	for (start = find_first_zero_bit(map, total_bits);
+	     start < total_bits;
+	     start = find_next_zero_bit(map, total_bits, end)) {
+		end = find_next_bit(map, total_bits, start);
+		aligned = ALIGN(start, spacing);
+		if (aligned + num_bits > end || end - start >= best_len)
+			continue;
 
-			last_bit = fls(bitp[word_index] & end_mask(bit_end));
-			if (last_bit)
-				continue;
-		}
-		bitmap_bits_set_all(bitp, bit_start, bit_end);
-		return bit_start;
+		best = aligned;
+		if (!bestfit || end - start == num_bits)
+			break;
+		best_len = end - start;
 	}
-	return -1;
+	return best;
 }
 
 static int reserve_quanta(const unsigned int quanta_needed,
@@ -1141,10 +1222,13 @@ static int reserve_quanta(const unsigned int quanta_needed,
 	spacing = align / pmem[id].quantum;
 	spacing = spacing > 1 ? spacing : 1;
 
-	ret = bitmap_allocate_contiguous(pmem[id].allocator.bitmap.bitmap,
+	ret = bitmap_find_free(pmem[id].allocator.bitmap.bitmap,
 		quanta_needed,
 		(pmem[id].size + pmem[id].quantum - 1) / pmem[id].quantum,
-		spacing);
+		spacing, 1);
+	if (ret >= 0)
+		bitmap_bits_set_all(pmem[id].allocator.bitmap.bitmap,
+			ret, ret + quanta_needed);
 
 #if PMEM_DEBUG
 	if (ret < 0)
@@ -1252,6 +1336,8 @@ static int pmem_allocator_bitmap(const int id,
 	pmem[id].allocator.bitmap.bitmap_free -= quanta_needed;
 	pmem[id].allocator.bitmap.bitm_alloc[i].bit = bitnum;
 	pmem[id].allocator.bitmap.bitm_alloc[i].quanta = quanta_needed;
+	pmem[id].allocator.bitmap.bitm_alloc[i].spacing =
+		max(align / pmem[id].quantum, 1U);
 leave:
 	return bitnum;
 }
@@ -1314,9 +1400,155 @@ static int pmem_allocator_system(const int id,
 	return (int)list;
 }
 
+static int pmem_movable(struct pmem_data *data)
+{
+	/* caller should hold data->sem! */
+	return data->index != -1 && !data->map_count &&
+		!(data->flags & (PMEM_FLAGS_CONNECTED | PMEM_FLAGS_PINNED));
+}
+
+static int pmem_move_bitmap(const int id, struct pmem_data *data)
+{
+	/* caller should hold data->sem and the lock on arena_mutex! */
+	int i, old = data->index, new, quanta;
+	void *from, *to;
+
+	for (i = 0; i < pmem[id].allocator.bitmap.bitmap_allocs; i++)
+		if (pmem[id].allocator.bitmap.bitm_alloc[i].bit == old)
+			break;
+	if (i == pmem[id].allocator.bitmap.bitmap_allocs)
+		return 0;
+
+	quanta = pmem[id].allocator.bitmap.bitm_alloc[i].quanta;
+	new = bitmap_find_free(pmem[id].allocator.bitmap.bitmap, quanta,
+		pmem[id].num_entries,
+		pmem[id].allocator.bitmap.bitm_alloc[i].spacing, 0);
+	if (new < 0 || new > old)
+		return 0;
+
+	bitmap_bits_set_all(pmem[id].allocator.bitmap.bitmap,
+		new, new + quanta);
+
+	from = pmem[id].vbase + old * pmem[id].quantum;
+	to = pmem[id].vbase + new * pmem[id].quantum;
+	memcpy(to, from, quanta * pmem[id].quantum);
+	if (pmem[id].cached) {
+		dmac_flush_range(from, from + quanta * pmem[id].quantum);
+		dmac_flush_range(to, to + quanta * pmem[id].quantum);
+#ifdef CONFIG_OUTER_CACHE
+		outer_flush_range(paddr_from_bit(id, old),
+			paddr_from_bit(id, old + quanta));
+		outer_flush_range(paddr_from_bit(id, new),
+			paddr_from_bit(id, new + quanta));
+#endif
+	}
+
+	bitmap_bits_clear_all(pmem[id].allocator.bitmap.bitmap,
+		old, old + quanta);
+	pmem[id].allocator.bitmap.bitm_alloc[i].bit = new;
+	data->index = new;
+
+	DLOG("moved %d quanta from bit %d to %d\n", quanta, old, new);
+	pmem[id].stats.moved++;
+	pmem[id].stats.moved_bytes += quanta * pmem[id].quantum;
+	return 1;
+}
+
+/*
+ * Slide allocations that nobody can observe the physical address of --
+ * not mapped, not connected to and never handed out -- towards the start
+ * of the region so the free quanta coalesce.  The contents are copied.
+ *
+ * With wait clear every lock is only tried, so this can be called with
+ * the sem of a file that is about to allocate held.
+ */
+static int pmem_compact(int id, int wait)
+{
+	struct pmem_data *data;
+	int moved, total = 0;
+
+	if (pmem[id].allocator_type != PMEM_ALLOCATORTYPE_BITMAP ||
+	    !pmem[id].vbase)
+		return 0;
+
+	if (wait)
+		mutex_lock(&pmem[id].data_list_mutex);
+	else if (!mutex_trylock(&pmem[id].data_list_mutex))
+		return 0;
+
+	/* every move goes to a lower bit, so this terminates */
+	do {
+		moved = 0;
+		list_for_each_entry(data, &pmem[id].data_list, list) {
+			if (!down_write_trylock(&data->sem))
+				continue;
+			if (pmem_movable(data)) {
+				mutex_lock(&pmem[id].arena_mutex);
+				moved += pmem_move_bitmap(id, data);
+				mutex_unlock(&pmem[id].arena_mutex);
+			}
+			up_write(&data->sem);
+		}
+		total += moved;
+	} while (moved);
+
+	mutex_unlock(&pmem[id].data_list_mutex);
+
+	mutex_lock(&pmem[id].arena_mutex);
+	pmem[id].stats.compactions++;
+	mutex_unlock(&pmem[id].arena_mutex);
+
+	DLOG("compacted %s: %d allocations moved\n", pmem[id].name, total);
+	return total;
+}
+
+/* allocate through the region's allocator, keeping statistics and
+ * compacting the region if it is too fragmented to satisfy the request */
+static int pmem_allocate(const int id, const unsigned long len,
+		const unsigned int align)
+{
+	ktime_t start = ktime_get();
+	int index, fragmented = 0;
+	s64 ns;
+
+	mutex_lock(&pmem[id].arena_mutex);
+	index = pmem[id].allocate(id, len, align);
+	if (index == -1 &&
+	    pmem[id].allocator_type == PMEM_ALLOCATORTYPE_BITMAP &&
+	    pmem[id].allocator.bitmap.bitmap_free * pmem[id].quantum >= len) {
+		fragmented = 1;
+		if (pmem[id].allocator.bitmap.auto_compact) {
+			mutex_unlock(&pmem[id].arena_mutex);
+			pmem_compact(id, 0);
+			mutex_lock(&pmem[id].arena_mutex);
+			index = pmem[id].allocate(id, len, align);
+		}
+	}
+
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	pmem[id].stats.total_ns += ns;
+	if (ns > pmem[id].stats.max_ns)
+		pmem[id].stats.max_ns = ns;
+	pmem[id].stats.allocs++;
+	if (fragmented) {
+		pmem[id].stats.frag_failures++;
+		if (index != -1)
+			pmem[id].stats.rescued++;
+	}
+	if (index == -1)
+		pmem[id].stats.failures++;
+	mutex_unlock(&pmem[id].arena_mutex);
+
+	return index;
+}
+
 static pgprot_t pmem_phys_mem_access_prot(struct file *file, pgprot_t vma_prot)
 {
+	struct pmem_data *data = file->private_data;
 	int id = get_id(file);
+
+	if (data->flags & PMEM_FLAGS_CACHED)
+		return vma_prot;
 #ifdef pgprot_writecombine
 	if (pmem[id].cached == 0 || file->f_flags & O_SYNC)
 		/* on ARMv6 and ARMv7 this expands to Normal Noncached */
@@ -1485,11 +1717,12 @@ static void pmem_vma_open(struct vm_area_struct *vma)
 		current->parent->pid, file, file_count(file));
 	/* this should never be called as we don't support copying pmem
 	 * ranges via fork */
-	down_read(&data->sem);
+	down_write(&data->sem);
 	BUG_ON(!has_allocation(file));
 	/* remap the garbage pages, forkers don't get access to the data */
 	pmem_unmap_pfn_range(id, vma, data, 0, vma->vm_start - vma->vm_end);
-	up_read(&data->sem);
+	data->map_count++;
+	up_write(&data->sem);
 }
 
 static void pmem_vma_close(struct vm_area_struct *vma)
@@ -1520,6 +1753,7 @@ static void pmem_vma_close(struct vm_area_struct *vma)
 		       "exist!\n");
 		return;
 	}
+	data->map_count--;
 	if (data->vma == vma) {
 		data->vma = NULL;
 		if ((data->flags & PMEM_FLAGS_CONNECTED) &&
@@ -1574,11 +1808,7 @@ static int pmem_mmap(struct file *file, struct vm_area_struct *vma)
 	}
 	/* if file->private_data == unalloced, alloc*/
 	if (data->index == -1) {
-		mutex_lock(&pmem[id].arena_mutex);
-		index = pmem[id].allocate(id,
-				vma->vm_end - vma->vm_start,
-				SZ_4K);
-		mutex_unlock(&pmem[id].arena_mutex);
+		index = pmem_allocate(id, vma->vm_end - vma->vm_start, SZ_4K);
 		/* either no space was available or an error occured */
 		if (index == -1) {
 			pr_err("pmem: mmap unable to allocate memory"
@@ -1644,6 +1874,7 @@ static int pmem_mmap(struct file *file, struct vm_area_struct *vma)
 		data->pid = current->pid;
 	}
 	vma->vm_ops = &vm_ops;
+	data->map_count++;
 error:
 	up_write(&data->sem);
 	return ret;
@@ -1692,7 +1923,7 @@ int get_pmem_addr(struct file *file, unsigned long *start,
 	if (is_pmem_file(file)) {
 		struct pmem_data *data = file->private_data;
 
-		down_read(&data->sem);
+		down_write(&data->sem);
 		if (has_allocation(file)) {
 			int id = get_id(file);
 
@@ -1700,18 +1931,17 @@ int get_pmem_addr(struct file *file, unsigned long *start,
 			*len = pmem[id].len(id, data);
 			*vstart = (unsigned long)
 				pmem_start_vaddr(id, data);
-			up_read(&data->sem);
+			data->flags |= PMEM_FLAGS_PINNED;
 #if PMEM_DEBUG
-			down_write(&data->sem);
 			data->ref++;
-			up_write(&data->sem);
 #endif
+			up_write(&data->sem);
 			DLOG("returning start %#lx len %lu "
 				"vstart %#lx\n",
 				*start, *len, *vstart);
 			ret = 0;
 		} else {
-			up_read(&data->sem);
+			up_write(&data->sem);
 		}
 	}
 	return ret;
@@ -1794,6 +2024,11 @@ void put_pmem_fd(int fd)
 	}
 }
 
+static void pmem_flush_cache_all(void *unused)
+{
+	flush_cache_all();
+}
+
 void flush_pmem_fd(int fd, unsigned long offset, unsigned long len)
 {
 	int fput_needed;
@@ -1813,6 +2048,7 @@ void flush_pmem_file(struct file *file, unsigned long offset, unsigned long len)
 	struct pmem_region_node *region_node;
 	struct list_head *elt;
 	void *flush_start, *flush_end;
+	unsigned long alloc_len;
 #ifdef CONFIG_OUTER_CACHE
 	unsigned long phy_start, phy_end;
 #endif
@@ -1820,8 +2056,6 @@ void flush_pmem_file(struct file *file, unsigned long offset, unsigned long len)
 		return;
 
 	id = get_id(file);
-	if (!pmem[id].cached)
-		return;
 
 	/* is_pmem_file fails if !file */
 	data = file->private_data;
@@ -1830,6 +2064,27 @@ void flush_pmem_file(struct file *file, unsigned long offset, unsigned long len)
 	if (!has_allocation(file))
 		goto end;
 
+	alloc_len = pmem[id].len(id, data);
+	if (offset >= alloc_len)
+		goto end;
+	len = min(len, alloc_len - offset);
+
+	if (!pmem[id].cached) {
+		/* The kernel alias of an uncached region is uncached, so a
+		 * cached user mapping is the only place lines can live and
+		 * it isn't known here: flush the whole inner cache.  That
+		 * is a set/way operation and only reaches the local CPU,
+		 * so run it on every CPU that may hold lines of it. */
+		if (data->flags & PMEM_FLAGS_CACHED) {
+			on_each_cpu(pmem_flush_cache_all, NULL, 1);
+#ifdef CONFIG_OUTER_CACHE
+			phy_start = pmem[id].start_addr(id, data) + offset;
+			outer_flush_range(phy_start, phy_start + len);
+#endif
+		}
+		goto end;
+	}
+
 	vaddr = pmem_start_vaddr(id, data);
 
 	if (pmem[id].allocator_type == PMEM_ALLOCATORTYPE_SYSTEM) {
@@ -1846,14 +2101,14 @@ void flush_pmem_file(struct file *file, unsigned long offset, unsigned long len)
 #endif
 		goto end;
 	}
-	/* if this isn't a submmapped file, flush the whole thing */
+	/* if this isn't a submmapped file, flush the requested range */
 	if (unlikely(!(data->flags & PMEM_FLAGS_CONNECTED))) {
-		dmac_flush_range(vaddr, vaddr + pmem[id].len(id, data));
+		dmac_flush_range(vaddr + offset, vaddr + offset + len);
 #ifdef CONFIG_OUTER_CACHE
-		phy_start = (unsigned long)vaddr -
+		phy_start = (unsigned long)vaddr + offset -
 				(unsigned long)pmem[id].vbase + pmem[id].base;
 
-		phy_end  =  phy_start + pmem[id].len(id, data);
+		phy_end  =  phy_start + len;
 
 		outer_flush_range(phy_start, phy_end);
 #endif
@@ -1899,13 +2154,14 @@ int pmem_cache_maint(struct file *file, unsigned int cmd,
 	data = file->private_data;
 	id = get_id(file);
 
-	if (!pmem[id].cached)
-		return 0;
-
 	offset = pmem_addr->offset;
 	length = pmem_addr->length;
 
 	down_read(&data->sem);
+	if (!pmem[id].cached && !(data->flags & PMEM_FLAGS_CACHED)) {
+		up_read(&data->sem);
+		return 0;
+	}
 	if (!has_allocation(file)) {
 		up_read(&data->sem);
 		return -EINVAL;
@@ -1920,6 +2176,12 @@ int pmem_cache_maint(struct file *file, unsigned int cmd,
 	vaddr = pmem_addr->vaddr;
 	paddr = pmem_start_addr + offset;
 
+	/* invalidating a partial line would throw away whatever else
+	 * shares it, write those lines back as well */
+	if (cmd == PMEM_INV_CACHES &&
+	    ((vaddr | length) & (L1_CACHE_BYTES - 1)))
+		cmd = PMEM_CLEAN_INV_CACHES;
+
 	DLOG("pmem cache maint on dev %s(id: %d)"
 		"(vaddr %lx paddr %lx len %lu bytes)\n",
 		get_name(file), id, vaddr, paddr, length);
@@ -1977,10 +2239,10 @@ static int pmem_connect(unsigned long connect, struct file *file)
 			goto put_src_file;
 		}
 
-		down_read(&src_data->sem);
+		down_write(&src_data->sem);
 
 		if (unlikely(!has_allocation(src_file))) {
-			up_read(&src_data->sem);
+			up_write(&src_data->sem);
 			pr_err("pmem: %s: src file has no allocation!\n",
 				__func__);
 			ret = -EINVAL;
@@ -1988,7 +2250,9 @@ static int pmem_connect(unsigned long connect, struct file *file)
 			struct pmem_data *data;
 			int src_index = src_data->index;
 
-			up_read(&src_data->sem);
+			/* the connected file shares the index */
+			src_data->flags |= PMEM_FLAGS_PINNED;
+			up_write(&src_data->sem);
 
 			data = file->private_data;
 			if (!data) {
@@ -2245,19 +2509,42 @@ static void pmem_get_size(struct pmem_region *region, struct file *file)
 	struct pmem_data *data = file->private_data;
 	int id = get_id(file);
 
-	down_read(&data->sem);
+	down_write(&data->sem);
 	if (!has_allocation(file)) {
 		region->offset = 0;
 		region->len = 0;
 	} else {
 		region->offset = pmem[id].start_addr(id, data);
 		region->len = pmem[id].len(id, data);
+		data->flags |= PMEM_FLAGS_PINNED;
 	}
-	up_read(&data->sem);
+	up_write(&data->sem);
 	DLOG("offset 0x%lx len 0x%lx\n", region->offset, region->len);
 }
 
 
+/* check that a range user space wants cache maintenance on is a pmem
+ * mapping of this region, the cache operations would fault on anything
+ * else.  Connected files share their master's mapping, so any file of the
+ * region will do. */
+static int pmem_user_range_ok(struct file *file, unsigned long vaddr,
+		unsigned long len)
+{
+	struct vm_area_struct *vma;
+	int ret;
+
+	if (vaddr + len < vaddr)
+		return 0;
+
+	down_read(&current->mm->mmap_sem);
+	vma = find_vma(current->mm, vaddr);
+	ret = vma && vma->vm_start <= vaddr && vaddr + len <= vma->vm_end &&
+		is_pmem_file(vma->vm_file) &&
+		get_id(vma->vm_file) == get_id(file);
+	up_read(&current->mm->mmap_sem);
+	return ret;
+}
+
 static long pmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	/* called from user space as file op, so file guaranteed to be not
@@ -2280,15 +2567,16 @@ static long pmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			struct pmem_region region;
 
 			DLOG("get_phys\n");
-			down_read(&data->sem);
+			down_write(&data->sem);
 			if (!has_allocation(file)) {
 				region.offset = 0;
 				region.len = 0;
 			} else {
 				region.offset = pmem[id].start_addr(id, data);
 				region.len = pmem[id].len(id, data);
+				data->flags |= PMEM_FLAGS_PINNED;
 			}
-			up_read(&data->sem);
+			up_write(&data->sem);
 
 			if (copy_to_user((void __user *)arg, &region,
 						sizeof(struct pmem_region)))
@@ -2374,11 +2662,7 @@ static long pmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 				return -EINVAL;
 			}
 
-			mutex_lock(&pmem[id].arena_mutex);
-			data->index = pmem[id].allocate(id,
-					arg,
-					SZ_4K);
-			mutex_unlock(&pmem[id].arena_mutex);
+			data->index = pmem_allocate(id, arg, SZ_4K);
 			ret = data->index == -1 ? -ENOMEM :
 				data->index;
 			up_write(&data->sem);
@@ -2421,11 +2705,8 @@ static long pmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 				return -EINVAL;
 			}
 
-			mutex_lock(&pmem[id].arena_mutex);
-			data->index = pmem[id].allocate(id,
-					alloc.size,
+			data->index = pmem_allocate(id, alloc.size,
 					alloc.align);
-			mutex_unlock(&pmem[id].arena_mutex);
 			ret = data->index == -1 ? -ENOMEM :
 				data->index;
 			up_write(&data->sem);
@@ -2444,8 +2725,27 @@ static long pmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 						sizeof(struct pmem_addr)))
 				return -EFAULT;
 
+			if (!pmem_user_range_ok(file, pmem_addr.vaddr,
+						pmem_addr.length))
+				return -EINVAL;
+
 			return pmem_cache_maint(file, cmd, &pmem_addr);
 		}
+	case PMEM_SET_CACHED:
+		{
+			int ret = 0;
+
+			DLOG("set cached %lu\n", arg);
+			down_write(&data->sem);
+			if (data->map_count)
+				ret = -EBUSY;
+			else if (arg)
+				data->flags |= PMEM_FLAGS_CACHED;
+			else
+				data->flags &= ~PMEM_FLAGS_CACHED;
+			up_write(&data->sem);
+			return ret;
+		}
 	default:
 		if (pmem[id].ioctl)
 			return pmem[id].ioctl(file, cmd, arg);
@@ -2784,6 +3084,7 @@ int pmem_setup(struct android_pmem_platform_data *pdata,
 			goto err_cant_register_device;
 		}
 		pmem[id].allocator.bitmap.bitmap_free = pmem[id].num_entries;
+		pmem[id].allocator.bitmap.auto_compact = 1;
 
 		pmem[id].allocate = pmem_allocator_bitmap;
 		pmem[id].free = pmem_free_bitmap;
@@ -0,0 +1,207 @@
+/* drivers/misc/pmem_alloc_test.c
+ *
+ * Allocation latency and fragmentation benchmark for pmem regions.
+ *
+ * Writing "<region> [iterations] [max_kb]" to
+ * /sys/kernel/debug/pmem_alloc_test/run replays a random mix of
+ * allocations of up to max_kb kilobytes and frees against /dev/<region>,
+ * keeping up to PMEM_TEST_MAX_LIVE allocations alive at once.  Reading the
+ * file returns the result of the last run: how many allocations failed,
+ * how many of those failed although the region had enough free memory in
+ * total, and the allocation latency.  Compare runs with the region's
+ * auto_compact attribute (/sys/kernel/pmem_regions/<region>/) set and
+ * cleared to see what compaction buys.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/err.h>
+#include <linux/debugfs.h>
+#include <linux/mutex.h>
+#include <linux/random.h>
+#include <linux/ktime.h>
+#include <linux/uaccess.h>
+#include <linux/android_pmem.h>
+#include <asm/sizes.h>
+
+#define PMEM_TEST_MAX_LIVE	64
+#define PMEM_TEST_NAME_SIZE	32
+
+struct pmem_test_result {
+	char region[PMEM_TEST_NAME_SIZE];
+	unsigned int iterations;
+	unsigned int allocs;
+	unsigned int failures;
+	unsigned int frag_failures;
+	unsigned int frees;
+	u64 total_ns;
+	u64 max_ns;
+	int error;
+};
+
+static DEFINE_MUTEX(pmem_test_lock);
+static struct pmem_test_result result;
+static struct file *live[PMEM_TEST_MAX_LIVE];
+static struct dentry *dent;
+
+static long pmem_test_ioctl(struct file *file, unsigned int cmd,
+			    unsigned long arg)
+{
+	mm_segment_t old_fs = get_fs();
+	long ret;
+
+	/* arg may point at kernel memory */
+	set_fs(KERNEL_DS);
+	ret = file->f_op->unlocked_ioctl(file, cmd, arg);
+	set_fs(old_fs);
+	return ret;
+}
+
+static int pmem_test_alloc(const char *path, unsigned long len)
+{
+	struct pmem_freespace fs;
+	struct file *file;
+	ktime_t start;
+	s64 ns;
+	int slot = random32() % PMEM_TEST_MAX_LIVE;
+
+	if (live[slot]) {
+		filp_close(live[slot], NULL);
+		live[slot] = NULL;
+		result.frees++;
+		return 0;
+	}
+
+	file = filp_open(path, O_RDWR, 0);
+	if (IS_ERR(file))
+		return PTR_ERR(file);
+
+	start = ktime_get();
+	if (pmem_test_ioctl(file, PMEM_ALLOCATE, len) < 0) {
+		result.failures++;
+		if (!pmem_test_ioctl(file, PMEM_GET_FREE_SPACE,
+				     (unsigned long)&fs) && fs.total >= len)
+			result.frag_failures++;
+		filp_close(file, NULL);
+		return 0;
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	result.allocs++;
+	result.total_ns += ns;
+	if (ns > result.max_ns)
+		result.max_ns = ns;
+	live[slot] = file;
+	return 0;
+}
+
+static void pmem_test_run(unsigned int iterations, unsigned int max_kb)
+{
+	char path[PMEM_TEST_NAME_SIZE + 8];
+	unsigned long len;
+	int i, ret = 0;
+
+	snprintf(path, sizeof(path), "/dev/%s", result.region);
+
+	for (i = 0; i < iterations && !ret; i++) {
+		len = PAGE_ALIGN((random32() % max_kb + 1) * SZ_1K);
+		ret = pmem_test_alloc(path, len);
+	}
+	result.iterations = i;
+	result.error = ret;
+
+	for (i = 0; i < PMEM_TEST_MAX_LIVE; i++) {
+		if (live[i]) {
+			filp_close(live[i], NULL);
+			live[i] = NULL;
+		}
+	}
+}
+
+static ssize_t pmem_test_write(struct file *file, const char __user *ubuf,
+			       size_t count, loff_t *ppos)
+{
+	char buf[64];
+	unsigned int iterations = 1000, max_kb = 4096;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	mutex_lock(&pmem_test_lock);
+	memset(&result, 0, sizeof(result));
+	if (sscanf(buf, "%31s %u %u", result.region, &iterations,
+		   &max_kb) < 1 || !max_kb) {
+		mutex_unlock(&pmem_test_lock);
+		return -EINVAL;
+	}
+	pmem_test_run(iterations, max_kb);
+	mutex_unlock(&pmem_test_lock);
+
+	return count;
+}
+
+static ssize_t pmem_test_read(struct file *file, char __user *ubuf,
+			      size_t count, loff_t *ppos)
+{
+	char buf[384];
+	int len;
+
+	mutex_lock(&pmem_test_lock);
+	len = scnprintf(buf, sizeof(buf),
+		"region %s\niterations %u\nerror %d\nallocations %u\n"
+		"frees %u\nfailures %u\nfragmentation_failures %u\n"
+		"avg_latency_us %llu\nmax_latency_us %llu\n",
+		result.region, result.iterations, result.error,
+		result.allocs, result.frees, result.failures,
+		result.frag_failures,
+		result.allocs ? div_u64(result.total_ns,
+					result.allocs) / NSEC_PER_USEC : 0,
+		div_u64(result.max_ns, NSEC_PER_USEC));
+	mutex_unlock(&pmem_test_lock);
+
+	return simple_read_from_buffer(ubuf, count, ppos, buf, len);
+}
+
+static const struct file_operations pmem_test_fops = {
+	.read = pmem_test_read,
+	.write = pmem_test_write,
+};
+
+static int __init pmem_alloc_test_init(void)
+{
+	dent = debugfs_create_dir("pmem_alloc_test", NULL);
+	if (IS_ERR_OR_NULL(dent))
+		return -ENOMEM;
+
+	if (!debugfs_create_file("run", S_IRUGO | S_IWUSR, dent, NULL,
+				 &pmem_test_fops)) {
+		debugfs_remove(dent);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static void __exit pmem_alloc_test_exit(void)
+{
+	debugfs_remove_recursive(dent);
+}
+
+module_init(pmem_alloc_test_init);
+module_exit(pmem_alloc_test_exit);
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("pmem allocation latency and fragmentation benchmark");
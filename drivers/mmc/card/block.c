@@ -31,6 +31,8 @@
 #include <linux/mutex.h>
 #include <linux/scatterlist.h>
 #include <linux/string_helpers.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <linux/mmc/card.h>
 #include <linux/mmc/host.h>
@@ -75,6 +77,7 @@ struct mmc_blk_data {
 
 	unsigned int	usage;
 	unsigned int	read_only;
+	struct dentry	*packed_stats;
 };
 
 static DEFINE_MUTEX(open_lock);
@@ -82,6 +85,10 @@ static DEFINE_MUTEX(open_lock);
 module_param(perdev_minors, int, 0444);
 MODULE_PARM_DESC(perdev_minors, "Minors numbers to allocate per device");
 
+static int packed_writes = 1;
+module_param(packed_writes, int, 0644);
+MODULE_PARM_DESC(packed_writes, "Pack queued writes on MMC 4.5 cards");
+
 static struct mmc_blk_data *mmc_blk_get(struct gendisk *disk)
 {
 	struct mmc_blk_data *md;
@@ -161,13 +168,6 @@ static const struct block_device_operations mmc_bdops = {
 	.owner			= THIS_MODULE,
 };
 
-struct mmc_blk_request {
-	struct mmc_request	mrq;
-	struct mmc_command	cmd;
-	struct mmc_command	stop;
-	struct mmc_data		data;
-};
-
 static u32 mmc_sd_num_wr_blocks(struct mmc_card *card)
 {
 	int err;
@@ -327,98 +327,163 @@ out:
 	return err ? 0 : 1;
 }
 
+static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
+			       struct mmc_card *card, int disable_multi,
+			       struct mmc_queue *mq)
+{
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct request *req = mqrq->req;
+	u32 readcmd, writecmd;
+
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
+
+	brq->cmd.arg = blk_rq_pos(req);
+	if (!mmc_card_blockaddr(card))
+		brq->cmd.arg <<= 9;
+	brq->cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+	brq->data.blksz = 512;
+	brq->stop.opcode = MMC_STOP_TRANSMISSION;
+	brq->stop.arg = 0;
+	brq->stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
+	brq->data.blocks = blk_rq_sectors(req);
+
+	/*
+	 * The block layer doesn't support all sector count
+	 * restrictions, so we need to be prepared for too big
+	 * requests.
+	 */
+	if (brq->data.blocks > card->host->max_blk_count)
+		brq->data.blocks = card->host->max_blk_count;
+
+	/*
+	 * After a read error, we redo the request one sector at a time
+	 * in order to accurately determine which sectors can be read
+	 * successfully.
+	 */
+	if (disable_multi && brq->data.blocks > 1)
+		brq->data.blocks = 1;
+
+	if (brq->data.blocks > 1) {
+		/* SPI multiblock writes terminate using a special
+		 * token, not a STOP_TRANSMISSION request.
+		 */
+		if (!mmc_host_is_spi(card->host)
+				|| rq_data_dir(req) == READ)
+			brq->mrq.stop = &brq->stop;
+		readcmd = MMC_READ_MULTIPLE_BLOCK;
+		writecmd = MMC_WRITE_MULTIPLE_BLOCK;
+	} else {
+		brq->mrq.stop = NULL;
+		readcmd = MMC_READ_SINGLE_BLOCK;
+		writecmd = MMC_WRITE_BLOCK;
+	}
+	if (rq_data_dir(req) == READ) {
+		brq->cmd.opcode = readcmd;
+		brq->data.flags |= MMC_DATA_READ;
+	} else {
+		brq->cmd.opcode = writecmd;
+		brq->data.flags |= MMC_DATA_WRITE;
+	}
+
+	mmc_set_data_timeout(&brq->data, card);
+
+	brq->data.sg = mqrq->sg;
+	brq->data.sg_len = mmc_queue_map_sg(mq, mqrq);
+
+	/*
+	 * Adjust the sg list so it is the same size as the
+	 * request.
+	 */
+	if (brq->data.blocks != blk_rq_sectors(req)) {
+		int i, data_size = brq->data.blocks << 9;
+		struct scatterlist *sg;
+
+		for_each_sg(brq->data.sg, sg, brq->data.sg_len, i) {
+			data_size -= sg->length;
+			if (data_size <= 0) {
+				sg->length += data_size;
+				i++;
+				break;
+			}
+		}
+		brq->data.sg_len = i;
+	}
+}
+
+/*
+ * While the current request is on the bus, peek at the next one in the
+ * queue and let the host map it for DMA, so that it can be started as
+ * soon as the current one completes.  The request stays on the queue and
+ * is picked up again by mmc_blk_issue_rw_rq() when the queue thread
+ * fetches it.
+ */
+static void mmc_blk_prep_next(struct mmc_queue *mq, struct mmc_card *card)
+{
+	struct mmc_queue_req *mqrq = mq->mqrq_next;
+	struct request_queue *q = mq->queue;
+	struct request *req = NULL;
+
+	if (!mqrq->sg || mqrq->req)
+		return;
+
+	spin_lock_irq(q->queue_lock);
+	if (!blk_queue_plugged(q))
+		req = blk_peek_request(q);
+	spin_unlock_irq(q->queue_lock);
+
+	if (!req || req->cmd_type != REQ_TYPE_FS ||
+	    (req->cmd_flags & REQ_DISCARD) || !blk_rq_sectors(req))
+		return;
+
+	mqrq->req = req;
+	mmc_blk_rw_rq_prep(mqrq, card, 0, mq);
+	mmc_pre_req(card->host, &mqrq->brq.mrq, false);
+}
+
+/*
+ * Drop the request prepared by mmc_blk_prep_next(), which is about to be
+ * issued some other way.
+ */
+static void mmc_blk_unprep_next(struct mmc_queue *mq, struct mmc_card *card)
+{
+	mmc_post_req(card->host, &mq->mqrq_next->brq.mrq, 0);
+	mq->mqrq_next->req = NULL;
+}
+
 static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 {
 	struct mmc_blk_data *md = mq->data;
 	struct mmc_card *card = md->queue.card;
-	struct mmc_blk_request brq;
+	struct mmc_blk_request *brq;
 	int ret = 1, disable_multi = 0;
 
 	mmc_claim_host(card->host);
 
 	do {
 		struct mmc_command cmd;
-		u32 readcmd, writecmd, status = 0;
-
-		memset(&brq, 0, sizeof(struct mmc_blk_request));
-		brq.mrq.cmd = &brq.cmd;
-		brq.mrq.data = &brq.data;
+		u32 status = 0;
 
-		brq.cmd.arg = blk_rq_pos(req);
-		if (!mmc_card_blockaddr(card))
-			brq.cmd.arg <<= 9;
-		brq.cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
-		brq.data.blksz = 512;
-		brq.stop.opcode = MMC_STOP_TRANSMISSION;
-		brq.stop.arg = 0;
-		brq.stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
-		brq.data.blocks = blk_rq_sectors(req);
-
-		/*
-		 * The block layer doesn't support all sector count
-		 * restrictions, so we need to be prepared for too big
-		 * requests.
-		 */
-		if (brq.data.blocks > card->host->max_blk_count)
-			brq.data.blocks = card->host->max_blk_count;
-
-		/*
-		 * After a read error, we redo the request one sector at a time
-		 * in order to accurately determine which sectors can be read
-		 * successfully.
-		 */
-		if (disable_multi && brq.data.blocks > 1)
-			brq.data.blocks = 1;
-
-		if (brq.data.blocks > 1) {
-			/* SPI multiblock writes terminate using a special
-			 * token, not a STOP_TRANSMISSION request.
-			 */
-			if (!mmc_host_is_spi(card->host)
-					|| rq_data_dir(req) == READ)
-				brq.mrq.stop = &brq.stop;
-			readcmd = MMC_READ_MULTIPLE_BLOCK;
-			writecmd = MMC_WRITE_MULTIPLE_BLOCK;
-		} else {
-			brq.mrq.stop = NULL;
-			readcmd = MMC_READ_SINGLE_BLOCK;
-			writecmd = MMC_WRITE_BLOCK;
-		}
-		if (rq_data_dir(req) == READ) {
-			brq.cmd.opcode = readcmd;
-			brq.data.flags |= MMC_DATA_READ;
+		if (mq->mqrq_next->req == req && !disable_multi) {
+			/* Mapped while the previous request was on the bus */
+			swap(mq->mqrq_cur, mq->mqrq_next);
+			mq->mqrq_next->req = NULL;
 		} else {
-			brq.cmd.opcode = writecmd;
-			brq.data.flags |= MMC_DATA_WRITE;
+			if (mq->mqrq_next->req == req)
+				mmc_blk_unprep_next(mq, card);
+			mq->mqrq_cur->req = req;
+			mmc_blk_rw_rq_prep(mq->mqrq_cur, card, disable_multi,
+					   mq);
+			mmc_queue_bounce_pre(mq);
+			mmc_pre_req(card->host, &mq->mqrq_cur->brq.mrq, true);
 		}
+		brq = &mq->mqrq_cur->brq;
 
-		mmc_set_data_timeout(&brq.data, card);
-
-		brq.data.sg = mq->sg;
-		brq.data.sg_len = mmc_queue_map_sg(mq);
-
-		/*
-		 * Adjust the sg list so it is the same size as the
-		 * request.
-		 */
-		if (brq.data.blocks != blk_rq_sectors(req)) {
-			int i, data_size = brq.data.blocks << 9;
-			struct scatterlist *sg;
-
-			for_each_sg(brq.data.sg, sg, brq.data.sg_len, i) {
-				data_size -= sg->length;
-				if (data_size <= 0) {
-					sg->length += data_size;
-					i++;
-					break;
-				}
-			}
-			brq.data.sg_len = i;
-		}
-
-		mmc_queue_bounce_pre(mq);
-
-		mmc_wait_for_req(card->host, &brq.mrq);
+		mmc_start_req(card->host, &brq->mrq);
+		mmc_blk_prep_next(mq, card);
+		mmc_wait_for_req_done(&brq->mrq);
+		mmc_post_req(card->host, &brq->mrq, 0);
 
 		mmc_queue_bounce_post(mq);
 
@@ -427,8 +492,8 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 		 * until later as we need to wait for the card to leave
 		 * programming mode even when things go wrong.
 		 */
-		if (brq.cmd.error || brq.data.error || brq.stop.error) {
-			if (brq.data.blocks > 1 && rq_data_dir(req) == READ) {
+		if (brq->cmd.error || brq->data.error || brq->stop.error) {
+			if (brq->data.blocks > 1 && rq_data_dir(req) == READ) {
 				/* Redo read one sector at a time */
 				printk(KERN_WARNING "%s: retrying using single "
 				       "block read\n", req->rq_disk->disk_name);
@@ -440,29 +505,29 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 			disable_multi = 0;
 		}
 
-		if (brq.cmd.error) {
+		if (brq->cmd.error) {
 			printk(KERN_ERR "%s: error %d sending read/write "
 			       "command, response %#x, card status %#x\n",
-			       req->rq_disk->disk_name, brq.cmd.error,
-			       brq.cmd.resp[0], status);
+			       req->rq_disk->disk_name, brq->cmd.error,
+			       brq->cmd.resp[0], status);
 		}
 
-		if (brq.data.error) {
-			if (brq.data.error == -ETIMEDOUT && brq.mrq.stop)
+		if (brq->data.error) {
+			if (brq->data.error == -ETIMEDOUT && brq->mrq.stop)
 				/* 'Stop' response contains card status */
-				status = brq.mrq.stop->resp[0];
+				status = brq->mrq.stop->resp[0];
 			printk(KERN_ERR "%s: error %d transferring data,"
 			       " sector %u, nr %u, card status %#x\n",
-			       req->rq_disk->disk_name, brq.data.error,
+			       req->rq_disk->disk_name, brq->data.error,
 			       (unsigned)blk_rq_pos(req),
 			       (unsigned)blk_rq_sectors(req), status);
 		}
 
-		if (brq.stop.error) {
+		if (brq->stop.error) {
 			printk(KERN_ERR "%s: error %d sending stop command, "
 			       "response %#x, card status %#x\n",
-			       req->rq_disk->disk_name, brq.stop.error,
-			       brq.stop.resp[0], status);
+			       req->rq_disk->disk_name, brq->stop.error,
+			       brq->stop.resp[0], status);
 		}
 
 		if (!mmc_host_is_spi(card->host) && rq_data_dir(req) != READ) {
@@ -495,7 +560,7 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 #endif
 		}
 
-		if (brq.cmd.error || brq.stop.error || brq.data.error) {
+		if (brq->cmd.error || brq->stop.error || brq->data.error) {
 			if (rq_data_dir(req) == READ) {
 				/*
 				 * After an error, we redo I/O one sector at a
@@ -503,7 +568,7 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 				 * read a single sector.
 				 */
 				spin_lock_irq(&md->lock);
-				ret = __blk_end_request(req, -EIO, brq.data.blksz);
+				ret = __blk_end_request(req, -EIO, brq->data.blksz);
 				spin_unlock_irq(&md->lock);
 				continue;
 			}
@@ -514,7 +579,7 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 		 * A block was successfully transferred.
 		 */
 		spin_lock_irq(&md->lock);
-		ret = __blk_end_request(req, 0, brq.data.bytes_xfered);
+		ret = __blk_end_request(req, 0, brq->data.bytes_xfered);
 		spin_unlock_irq(&md->lock);
 	} while (ret);
 
@@ -542,7 +607,7 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 		}
 	} else {
 		spin_lock_irq(&md->lock);
-		ret = __blk_end_request(req, 0, brq.data.bytes_xfered);
+		ret = __blk_end_request(req, 0, brq->data.bytes_xfered);
 		spin_unlock_irq(&md->lock);
 	}
 
@@ -556,6 +621,290 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 	return 0;
 }
 
+static int mmc_blk_packable(struct request *req)
+{
+	return req->cmd_type == REQ_TYPE_FS && rq_data_dir(req) == WRITE &&
+	       !(req->cmd_flags & (REQ_DISCARD | REQ_FLUSH | REQ_FUA)) &&
+	       blk_rq_sectors(req);
+}
+
+/*
+ * Gather the write @req and as many of the writes queued behind it as
+ * fit into one packed command on mq->packed->list.  Returns the number
+ * of requests gathered, or 0 if @req is to be issued on its own.
+ */
+static unsigned int mmc_blk_prep_packed_list(struct mmc_queue *mq,
+					     struct request *req)
+{
+	struct mmc_packed *packed = mq->packed;
+	struct request_queue *q = mq->queue;
+	struct mmc_card *card = mq->card;
+	struct mmc_host *host = card->host;
+	unsigned int max_entries, max_blocks, blocks, segs, nr = 1;
+	enum mmc_packed_stop stop;
+	struct request *next;
+	int unprep;
+
+	if (!packed || !packed_writes || !mmc_blk_packable(req))
+		return 0;
+
+	max_entries = min_t(unsigned int, card->ext_csd.max_packed_writes,
+			    MMC_PACKED_MAX_ENTRIES);
+	max_blocks = min(host->max_blk_count, host->max_req_size >> 9);
+
+	/* The header takes a block and a segment of its own */
+	blocks = blk_rq_sectors(req) + 1;
+	segs = req->nr_phys_segments + 1;
+	if (blocks > max_blocks || segs > host->max_segs)
+		return 0;
+
+	list_add_tail(&req->queuelist, &packed->list);
+
+	/* Any of these may have been mapped by mmc_blk_prep_next() */
+	unprep = (req == mq->mqrq_next->req);
+
+	spin_lock_irq(q->queue_lock);
+	for (;;) {
+		if (nr >= max_entries) {
+			stop = MMC_PACKED_STOP_ENTRIES;
+			break;
+		}
+		next = blk_queue_plugged(q) ? NULL : blk_peek_request(q);
+		if (!next) {
+			stop = MMC_PACKED_STOP_EMPTY;
+			break;
+		}
+		if (!mmc_blk_packable(next)) {
+			stop = MMC_PACKED_STOP_NOT_WRITE;
+			break;
+		}
+		if (blocks + blk_rq_sectors(next) > max_blocks) {
+			stop = MMC_PACKED_STOP_BLOCKS;
+			break;
+		}
+		if (segs + next->nr_phys_segments > host->max_segs) {
+			stop = MMC_PACKED_STOP_SEGS;
+			break;
+		}
+
+		blk_start_request(next);
+		list_add_tail(&next->queuelist, &packed->list);
+		if (next == mq->mqrq_next->req)
+			unprep = 1;
+		blocks += blk_rq_sectors(next);
+		segs += next->nr_phys_segments;
+		nr++;
+	}
+	spin_unlock_irq(q->queue_lock);
+
+	packed->stats.stop[stop]++;
+
+	if (nr == 1) {
+		list_del_init(&req->queuelist);
+		packed->stats.single++;
+		return 0;
+	}
+
+	if (unprep)
+		mmc_blk_unprep_next(mq, card);
+
+	packed->nr_entries = nr;
+	packed->blocks = blocks - 1;
+	return nr;
+}
+
+/*
+ * Build the packed command header and a scatterlist holding the header
+ * followed by the data of every gathered request.
+ */
+static void mmc_blk_packed_hdr_prep(struct mmc_queue *mq,
+				    struct mmc_queue_req *mqrq)
+{
+	struct mmc_packed *packed = mq->packed;
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct mmc_card *card = mq->card;
+	struct scatterlist *sg = mqrq->sg;
+	__le32 *hdr = packed->cmd_hdr;
+	struct request *req;
+	unsigned int i = 1, sg_len = 1;
+	u32 addr;
+
+	memset(hdr, 0, MMC_PACKED_HDR_SZ);
+	hdr[0] = cpu_to_le32((packed->nr_entries << 16) |
+			     (MMC_PACKED_CMD_WR << 8) | MMC_PACKED_CMD_VER);
+	list_for_each_entry(req, &packed->list, queuelist) {
+		addr = blk_rq_pos(req);
+		if (!mmc_card_blockaddr(card))
+			addr <<= 9;
+		hdr[i * 2] = cpu_to_le32(blk_rq_sectors(req));
+		hdr[i * 2 + 1] = cpu_to_le32(addr);
+		i++;
+	}
+
+	sg_init_table(sg, card->host->max_segs);
+	sg_set_buf(sg, hdr, MMC_PACKED_HDR_SZ);
+	list_for_each_entry(req, &packed->list, queuelist) {
+		sg_len += blk_rq_map_sg(mq->queue, req, sg + sg_len);
+		/* blk_rq_map_sg() ends the list after every request */
+		sg[sg_len - 1].page_link &= ~0x02;
+	}
+	sg_mark_end(&sg[sg_len - 1]);
+
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
+
+	/* The first entry's address; no stop, CMD23 sets the length */
+	req = list_first_entry(&packed->list, struct request, queuelist);
+	brq->cmd.opcode = MMC_WRITE_MULTIPLE_BLOCK;
+	brq->cmd.arg = blk_rq_pos(req);
+	if (!mmc_card_blockaddr(card))
+		brq->cmd.arg <<= 9;
+	brq->cmd.flags = MMC_RSP_R1 | MMC_CMD_ADTC;
+
+	brq->data.blksz = 512;
+	brq->data.blocks = packed->blocks + 1;
+	brq->data.flags = MMC_DATA_WRITE;
+	brq->data.sg = sg;
+	brq->data.sg_len = sg_len;
+
+	mmc_set_data_timeout(&brq->data, card);
+}
+
+static int mmc_blk_wait_while_busy(struct mmc_card *card, u32 *status)
+{
+	struct mmc_command cmd;
+	int err;
+
+	do {
+		memset(&cmd, 0, sizeof(struct mmc_command));
+		cmd.opcode = MMC_SEND_STATUS;
+		cmd.arg = card->rca << 16;
+		cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
+		err = mmc_wait_for_cmd(card->host, &cmd, 5);
+		if (err)
+			return err;
+	} while (!(cmd.resp[0] & R1_READY_FOR_DATA) ||
+		 (R1_CURRENT_STATE(cmd.resp[0]) == 7));
+
+	*status = cmd.resp[0];
+	return 0;
+}
+
+/*
+ * Ask the card which entry of a failed packed command went wrong.  The
+ * entries before it were written and can be completed; 0 means the
+ * card could not tell and everything has to be redone.  Only valid when
+ * the card flagged an exception event for this very command: otherwise
+ * the packed status still describes an older packed write.
+ */
+static unsigned int mmc_blk_packed_failure_index(struct mmc_card *card,
+						 unsigned int nr_entries)
+{
+	unsigned int idx = 0;
+	u8 *ext_csd;
+
+	ext_csd = kmalloc(512, GFP_KERNEL);
+	if (!ext_csd)
+		return 0;
+
+	if (!mmc_send_ext_csd(card, ext_csd) &&
+	    (ext_csd[EXT_CSD_EXP_EVENTS_STATUS] & EXT_CSD_PACKED_FAILURE) &&
+	    (ext_csd[EXT_CSD_PACKED_CMD_STATUS] &
+	     EXT_CSD_PACKED_INDEXED_ERROR)) {
+		idx = ext_csd[EXT_CSD_PACKED_FAILURE_INDEX];
+		/* The index is one based */
+		idx = (idx && idx <= nr_entries) ? idx - 1 : 0;
+	}
+
+	kfree(ext_csd);
+	return idx;
+}
+
+static int mmc_blk_issue_packed_rq(struct mmc_queue *mq)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_packed *packed = mq->packed;
+	struct mmc_blk_request *brq = &mq->mqrq_cur->brq;
+	struct mmc_command sbc;
+	struct request *req, *tmp;
+	unsigned int i = 0, done;
+	u32 status = 0;
+	int err, sent = 0;
+
+	mmc_claim_host(card->host);
+
+	mmc_blk_packed_hdr_prep(mq, mq->mqrq_cur);
+
+	memset(&sbc, 0, sizeof(struct mmc_command));
+	sbc.opcode = MMC_SET_BLOCK_COUNT;
+	sbc.arg = MMC_CMD23_ARG_PACKED | brq->data.blocks;
+	sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+	err = mmc_wait_for_cmd(card->host, &sbc, 0);
+	if (!err) {
+		mmc_pre_req(card->host, &brq->mrq, true);
+		mmc_start_req(card->host, &brq->mrq);
+		mmc_wait_for_req_done(&brq->mrq);
+		mmc_post_req(card->host, &brq->mrq, 0);
+
+		if (brq->cmd.error) {
+			err = brq->cmd.error;
+		} else {
+			/* the card accepted the write, some data may be in */
+			sent = 1;
+			if (brq->data.error)
+				err = brq->data.error;
+			else if (brq->data.bytes_xfered !=
+				 brq->data.blocks << 9)
+				err = -EIO;
+		}
+	}
+	if (mmc_blk_wait_while_busy(card, &status) && !err)
+		err = -EIO;
+
+	packed->stats.cmds++;
+	packed->stats.reqs += packed->nr_entries;
+	packed->stats.entries[packed->nr_entries]++;
+
+	done = packed->nr_entries;
+	if (err) {
+		packed->stats.failures++;
+		/*
+		 * Nothing was written if CMD23 or the write command failed,
+		 * and the packed status only describes this command if the
+		 * card raised an exception event for it.
+		 */
+		done = 0;
+		if (sent && (status & R1_EXCEPTION_EVENT))
+			done = mmc_blk_packed_failure_index(card,
+						packed->nr_entries);
+		printk(KERN_WARNING "%s: packed write of %u requests failed "
+		       "(%d), redoing %u of them\n", md->disk->disk_name,
+		       packed->nr_entries, err, packed->nr_entries - done);
+	}
+
+	/*
+	 * Complete what the card took and send the rest one at a time,
+	 * through the normal path and its error handling.
+	 */
+	list_for_each_entry_safe(req, tmp, &packed->list, queuelist) {
+		list_del_init(&req->queuelist);
+		if (i++ < done) {
+			spin_lock_irq(&md->lock);
+			__blk_end_request_all(req, 0);
+			spin_unlock_irq(&md->lock);
+		} else {
+			packed->stats.retried++;
+			mmc_blk_issue_rw_rq(mq, req);
+		}
+	}
+
+	mmc_release_host(card->host);
+
+	return err ? 0 : 1;
+}
+
 static int
 mmc_blk_set_blksize(struct mmc_blk_data *md, struct mmc_card *card);
 
@@ -576,11 +925,103 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 			return mmc_blk_issue_secdiscard_rq(mq, req);
 		else
 			return mmc_blk_issue_discard_rq(mq, req);
+	} else if (mmc_blk_prep_packed_list(mq, req)) {
+		return mmc_blk_issue_packed_rq(mq);
 	} else {
 		return mmc_blk_issue_rw_rq(mq, req);
 	}
 }
 
+#ifdef CONFIG_DEBUG_FS
+static const char *mmc_blk_packed_stop_names[MMC_PACKED_STOP_NR] = {
+	[MMC_PACKED_STOP_EMPTY]		= "queue empty",
+	[MMC_PACKED_STOP_NOT_WRITE]	= "not a write",
+	[MMC_PACKED_STOP_BLOCKS]	= "block limit",
+	[MMC_PACKED_STOP_SEGS]		= "segment limit",
+	[MMC_PACKED_STOP_ENTRIES]	= "entry limit",
+};
+
+static int mmc_blk_packed_stats_show(struct seq_file *s, void *unused)
+{
+	struct mmc_blk_data *md = s->private;
+	struct mmc_packed_stats *st = &md->queue.packed->stats;
+	int i;
+
+	seq_printf(s, "packed commands: %lu\n", st->cmds);
+	seq_printf(s, "packed requests: %lu\n", st->reqs);
+	seq_printf(s, "unpacked writes: %lu\n", st->single);
+	seq_printf(s, "failed commands: %lu\n", st->failures);
+	seq_printf(s, "retried requests: %lu\n", st->retried);
+
+	seq_printf(s, "requests per command:\n");
+	for (i = 2; i <= MMC_PACKED_MAX_ENTRIES; i++)
+		if (st->entries[i])
+			seq_printf(s, "  %2d: %lu\n", i, st->entries[i]);
+
+	seq_printf(s, "packing stopped by:\n");
+	for (i = 0; i < MMC_PACKED_STOP_NR; i++)
+		seq_printf(s, "  %s: %lu\n", mmc_blk_packed_stop_names[i],
+			   st->stop[i]);
+
+	return 0;
+}
+
+static int mmc_blk_packed_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_blk_packed_stats_show, inode->i_private);
+}
+
+/* Any write clears the statistics */
+static ssize_t mmc_blk_packed_stats_write(struct file *file,
+					  const char __user *ubuf,
+					  size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct mmc_blk_data *md = s->private;
+
+	memset(&md->queue.packed->stats, 0, sizeof(struct mmc_packed_stats));
+	return count;
+}
+
+static const struct file_operations mmc_blk_packed_stats_fops = {
+	.open		= mmc_blk_packed_stats_open,
+	.read		= seq_read,
+	.write		= mmc_blk_packed_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void mmc_blk_add_debugfs(struct mmc_card *card, struct mmc_blk_data *md)
+{
+	if (!card->debugfs_root || !md->queue.packed)
+		return;
+
+	md->packed_stats = debugfs_create_file("packed_stats",
+					       S_IRUSR | S_IWUSR,
+					       card->debugfs_root, md,
+					       &mmc_blk_packed_stats_fops);
+}
+
+static void mmc_blk_remove_debugfs(struct mmc_card *card,
+				   struct mmc_blk_data *md)
+{
+	/* Already gone along with the card's directory on removal */
+	if (card->debugfs_root)
+		debugfs_remove(md->packed_stats);
+	md->packed_stats = NULL;
+}
+#else
+static inline void mmc_blk_add_debugfs(struct mmc_card *card,
+				       struct mmc_blk_data *md)
+{
+}
+
+static inline void mmc_blk_remove_debugfs(struct mmc_card *card,
+					  struct mmc_blk_data *md)
+{
+}
+#endif
+
 static inline int mmc_blk_readonly(struct mmc_card *card)
 {
 	return mmc_card_readonly(card) ||
@@ -724,6 +1165,7 @@ static int mmc_blk_probe(struct mmc_card *card)
 	mmc_set_bus_resume_policy(card->host, 1);
 #endif
 	add_disk(md->disk);
+	mmc_blk_add_debugfs(card, md);
 	return 0;
 
  out:
@@ -738,6 +1180,8 @@ static void mmc_blk_remove(struct mmc_card *card)
 	struct mmc_blk_data *md = mmc_get_drvdata(card);
 
 	if (md) {
+		mmc_blk_remove_debugfs(card, md);
+
 		/* Stop new requests from getting into the queue */
 		del_gendisk(md->disk);
 
@@ -18,6 +18,7 @@
 #include <linux/scatterlist.h>
 #include <linux/swap.h>		/* For nr_free_buffer_pages() */
 #include <linux/list.h>
+#include <linux/random.h>
 
 #include <linux/debugfs.h>
 #include <linux/uaccess.h>
@@ -1766,6 +1767,176 @@ static int mmc_test_profile_seq_trim_perf(struct mmc_test_card *test)
 	return 0;
 }
 
+/*
+ * Card address of the i-th of a series of sz-byte transfers within the
+ * test area, either consecutive or at random.
+ */
+static unsigned int mmc_test_io_addr(struct mmc_test_card *test,
+				     unsigned long sz, unsigned int i,
+				     int random)
+{
+	if (random)
+		i = random32() % (test->area.max_sz / sz);
+	return test->area.dev_addr + i * (sz >> 9);
+}
+
+struct mmc_test_async_req {
+	struct mmc_request	mrq;
+	struct mmc_command	cmd;
+	struct mmc_command	stop;
+	struct mmc_data		data;
+};
+
+/*
+ * Transfer the bytes mapped by mmc_test_area_map() cnt times, preparing
+ * each request with mmc_pre_req() while the previous one is still being
+ * transferred.  Both requests share the same buffer, which is fine as
+ * its contents are not checked.
+ */
+static int mmc_test_area_io_nonblock(struct mmc_test_card *test,
+				     unsigned long sz, unsigned int cnt,
+				     int write, int random)
+{
+	struct mmc_test_area *t = &test->area;
+	struct mmc_host *host = test->card->host;
+	struct mmc_test_async_req rq[2];
+	struct mmc_test_async_req *cur = &rq[0], *prev = NULL;
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < cnt; i++) {
+		memset(cur, 0, sizeof(struct mmc_test_async_req));
+		cur->mrq.cmd = &cur->cmd;
+		cur->mrq.data = &cur->data;
+		cur->mrq.stop = &cur->stop;
+
+		mmc_test_prepare_mrq(test, &cur->mrq, t->sg, t->sg_len,
+				     mmc_test_io_addr(test, sz, i, random),
+				     t->blocks, 512, write);
+		mmc_pre_req(host, &cur->mrq, !prev);
+
+		if (prev) {
+			mmc_wait_for_req_done(&prev->mrq);
+			mmc_post_req(host, &prev->mrq, 0);
+			mmc_test_wait_busy(test);
+			ret = mmc_test_check_result(test, &prev->mrq);
+			if (ret) {
+				mmc_post_req(host, &cur->mrq, ret);
+				return ret;
+			}
+		}
+
+		mmc_start_req(host, &cur->mrq);
+		prev = cur;
+		cur = (cur == &rq[0]) ? &rq[1] : &rq[0];
+	}
+
+	if (prev) {
+		mmc_wait_for_req_done(&prev->mrq);
+		mmc_post_req(host, &prev->mrq, 0);
+		mmc_test_wait_busy(test);
+		ret = mmc_test_check_result(test, &prev->mrq);
+	}
+
+	return ret;
+}
+
+/*
+ * Transfer the whole test area in sz-byte pieces, either consecutively or
+ * at random addresses, and either one request at a time or with the next
+ * request prepared while the current one is on the bus.
+ */
+static int mmc_test_rw_perf(struct mmc_test_card *test, unsigned long sz,
+			    int write, int random, int nonblock)
+{
+	unsigned int i, cnt;
+	struct timespec ts1, ts2;
+	int ret;
+
+	if (write) {
+		ret = mmc_test_area_erase(test);
+		if (ret)
+			return ret;
+	}
+
+	ret = mmc_test_area_map(test, sz, 0);
+	if (ret)
+		return ret;
+
+	cnt = test->area.max_sz / sz;
+	getnstimeofday(&ts1);
+	if (nonblock) {
+		ret = mmc_test_area_io_nonblock(test, sz, cnt, write, random);
+	} else {
+		for (i = 0; i < cnt && !ret; i++)
+			ret = mmc_test_area_transfer(test,
+					mmc_test_io_addr(test, sz, i, random),
+					write);
+	}
+	if (ret)
+		return ret;
+	getnstimeofday(&ts2);
+	mmc_test_print_avg_rate(test, sz, cnt, &ts1, &ts2);
+	return 0;
+}
+
+static int mmc_test_nonblock_seq_perf(struct mmc_test_card *test, int write)
+{
+	unsigned long sz;
+	int ret;
+
+	for (sz = 512; sz < test->area.max_tfr; sz <<= 1) {
+		ret = mmc_test_rw_perf(test, sz, write, 0, 1);
+		if (ret)
+			return ret;
+	}
+	sz = test->area.max_tfr;
+	return mmc_test_rw_perf(test, sz, write, 0, 1);
+}
+
+/*
+ * Consecutive non-blocking read performance by transfer size.
+ */
+static int mmc_test_profile_seq_nonblock_read_perf(struct mmc_test_card *test)
+{
+	return mmc_test_nonblock_seq_perf(test, 0);
+}
+
+/*
+ * Consecutive non-blocking write performance by transfer size.
+ */
+static int mmc_test_profile_seq_nonblock_write_perf(struct mmc_test_card *test)
+{
+	return mmc_test_nonblock_seq_perf(test, 1);
+}
+
+static int mmc_test_random_perf(struct mmc_test_card *test, int write)
+{
+	unsigned long sz = min_t(unsigned long, 4096, test->area.max_tfr);
+	int ret;
+
+	ret = mmc_test_rw_perf(test, sz, write, 1, 0);
+	if (ret)
+		return ret;
+	return mmc_test_rw_perf(test, sz, write, 1, 1);
+}
+
+/*
+ * Random 4k read performance, blocking and then non-blocking.
+ */
+static int mmc_test_profile_random_read_perf(struct mmc_test_card *test)
+{
+	return mmc_test_random_perf(test, 0);
+}
+
+/*
+ * Random 4k write performance, blocking and then non-blocking.
+ */
+static int mmc_test_profile_random_write_perf(struct mmc_test_card *test)
+{
+	return mmc_test_random_perf(test, 1);
+}
+
 static const struct mmc_test_case mmc_test_cases[] = {
 	{
 		.name = "Basic write (no data verification)",
@@ -2005,6 +2176,34 @@ static const struct mmc_test_case mmc_test_cases[] = {
 		.cleanup = mmc_test_area_cleanup,
 	},
 
+	{
+		.name = "Consecutive non-blocking read performance by transfer size",
+		.prepare = mmc_test_area_prepare_fill,
+		.run = mmc_test_profile_seq_nonblock_read_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Consecutive non-blocking write performance by transfer size",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_profile_seq_nonblock_write_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Random 4k read performance (blocking, non-blocking)",
+		.prepare = mmc_test_area_prepare_fill,
+		.run = mmc_test_profile_random_read_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Random 4k write performance (blocking, non-blocking)",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_profile_random_write_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
@@ -129,6 +129,34 @@ static void mmc_request(struct request_queue *q)
 		wake_up_process(mq->thread);
 }
 
+static void mmc_queue_alloc_packed(struct mmc_queue *mq)
+{
+	struct mmc_packed *packed;
+
+	packed = kzalloc(sizeof(struct mmc_packed), GFP_KERNEL);
+	if (!packed)
+		return;
+
+	packed->cmd_hdr = kmalloc(MMC_PACKED_HDR_SZ, GFP_KERNEL);
+	if (!packed->cmd_hdr) {
+		kfree(packed);
+		return;
+	}
+
+	INIT_LIST_HEAD(&packed->list);
+	mq->packed = packed;
+}
+
+static void mmc_queue_free_packed(struct mmc_queue *mq)
+{
+	if (!mq->packed)
+		return;
+
+	kfree(mq->packed->cmd_hdr);
+	kfree(mq->packed);
+	mq->packed = NULL;
+}
+
 /**
  * mmc_init_queue - initialise a queue structure.
  * @mq: mmc queue
@@ -153,6 +181,8 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card, spinlock_t *lock
 
 	mq->queue->queuedata = mq;
 	mq->req = NULL;
+	mq->mqrq_cur = &mq->mqrq[0];
+	mq->mqrq_next = &mq->mqrq[1];
 
 	blk_queue_prep_rq(mq->queue, mmc_prep_request);
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, mq->queue);
@@ -200,13 +230,13 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card, spinlock_t *lock
 			blk_queue_max_segments(mq->queue, bouncesz / 512);
 			blk_queue_max_segment_size(mq->queue, bouncesz);
 
-			mq->sg = kmalloc(sizeof(struct scatterlist),
+			mq->mqrq_cur->sg = kmalloc(sizeof(struct scatterlist),
 				GFP_KERNEL);
-			if (!mq->sg) {
+			if (!mq->mqrq_cur->sg) {
 				ret = -ENOMEM;
 				goto cleanup_queue;
 			}
-			sg_init_table(mq->sg, 1);
+			sg_init_table(mq->mqrq_cur->sg, 1);
 
 			mq->bounce_sg = kmalloc(sizeof(struct scatterlist) *
 				bouncesz / 512, GFP_KERNEL);
@@ -226,13 +256,37 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card, spinlock_t *lock
 		blk_queue_max_segments(mq->queue, host->max_segs);
 		blk_queue_max_segment_size(mq->queue, host->max_seg_size);
 
-		mq->sg = kmalloc(sizeof(struct scatterlist) *
+		mq->mqrq_cur->sg = kmalloc(sizeof(struct scatterlist) *
 			host->max_segs, GFP_KERNEL);
-		if (!mq->sg) {
+		if (!mq->mqrq_cur->sg) {
 			ret = -ENOMEM;
 			goto cleanup_queue;
 		}
-		sg_init_table(mq->sg, host->max_segs);
+		sg_init_table(mq->mqrq_cur->sg, host->max_segs);
+
+		/*
+		 * Hosts that can prepare a request ahead of time get a
+		 * second scatterlist, so that the next request can be
+		 * mapped while the current one is being transferred.
+		 * Without it the block driver simply works one request
+		 * at a time.
+		 */
+		if (host->ops->pre_req) {
+			mq->mqrq_next->sg = kmalloc(sizeof(struct scatterlist) *
+				host->max_segs, GFP_KERNEL);
+			if (mq->mqrq_next->sg)
+				sg_init_table(mq->mqrq_next->sg,
+					      host->max_segs);
+		}
+
+		/*
+		 * MMC 4.5 cards can take several writes in one packed
+		 * command.  Packing is an optimisation only, so carry on
+		 * without it if the memory isn't there.
+		 */
+		if (mmc_card_mmc(card) && card->ext_csd.max_packed_writes &&
+		    !mmc_host_is_spi(host) && host->max_segs > 1)
+			mmc_queue_alloc_packed(mq);
 	}
 
 	sema_init(&mq->thread_sem, 1);
@@ -251,9 +305,11 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card, spinlock_t *lock
  		kfree(mq->bounce_sg);
  	mq->bounce_sg = NULL;
  cleanup_queue:
- 	if (mq->sg)
-		kfree(mq->sg);
-	mq->sg = NULL;
+	mmc_queue_free_packed(mq);
+	kfree(mq->mqrq[0].sg);
+	mq->mqrq[0].sg = NULL;
+	kfree(mq->mqrq[1].sg);
+	mq->mqrq[1].sg = NULL;
 	if (mq->bounce_buf)
 		kfree(mq->bounce_buf);
 	mq->bounce_buf = NULL;
@@ -272,6 +328,12 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
 	/* Then terminate our worker thread */
 	kthread_stop(mq->thread);
 
+	/* Drop the mapping of a request that was prepared but never issued */
+	if (mq->mqrq_next->req) {
+		mmc_post_req(mq->card->host, &mq->mqrq_next->brq.mrq, -ENODEV);
+		mq->mqrq_next->req = NULL;
+	}
+
 	/* Empty the queue */
 	spin_lock_irqsave(q->queue_lock, flags);
 	q->queuedata = NULL;
@@ -282,8 +344,11 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
  		kfree(mq->bounce_sg);
  	mq->bounce_sg = NULL;
 
-	kfree(mq->sg);
-	mq->sg = NULL;
+	mmc_queue_free_packed(mq);
+	kfree(mq->mqrq[0].sg);
+	mq->mqrq[0].sg = NULL;
+	kfree(mq->mqrq[1].sg);
+	mq->mqrq[1].sg = NULL;
 
 	if (mq->bounce_buf)
 		kfree(mq->bounce_buf);
@@ -340,7 +405,7 @@ void mmc_queue_resume(struct mmc_queue *mq)
 /*
  * Prepare the sg list(s) to be handed of to the host driver
  */
-unsigned int mmc_queue_map_sg(struct mmc_queue *mq)
+unsigned int mmc_queue_map_sg(struct mmc_queue *mq, struct mmc_queue_req *mqrq)
 {
 	unsigned int sg_len;
 	size_t buflen;
@@ -348,11 +413,11 @@ unsigned int mmc_queue_map_sg(struct mmc_queue *mq)
 	int i;
 
 	if (!mq->bounce_buf)
-		return blk_rq_map_sg(mq->queue, mq->req, mq->sg);
+		return blk_rq_map_sg(mq->queue, mqrq->req, mqrq->sg);
 
 	BUG_ON(!mq->bounce_sg);
 
-	sg_len = blk_rq_map_sg(mq->queue, mq->req, mq->bounce_sg);
+	sg_len = blk_rq_map_sg(mq->queue, mqrq->req, mq->bounce_sg);
 
 	mq->bounce_sg_len = sg_len;
 
@@ -360,7 +425,7 @@ unsigned int mmc_queue_map_sg(struct mmc_queue *mq)
 	for_each_sg(mq->bounce_sg, sg, sg_len, i)
 		buflen += sg->length;
 
-	sg_init_one(mq->sg, mq->bounce_buf, buflen);
+	sg_init_one(mqrq->sg, mq->bounce_buf, buflen);
 
 	return 1;
 }
@@ -381,7 +446,7 @@ void mmc_queue_bounce_pre(struct mmc_queue *mq)
 
 	local_irq_save(flags);
 	sg_copy_to_buffer(mq->bounce_sg, mq->bounce_sg_len,
-		mq->bounce_buf, mq->sg[0].length);
+		mq->bounce_buf, mq->mqrq_cur->sg[0].length);
 	local_irq_restore(flags);
 }
 
@@ -401,7 +466,7 @@ void mmc_queue_bounce_post(struct mmc_queue *mq)
 
 	local_irq_save(flags);
 	sg_copy_from_buffer(mq->bounce_sg, mq->bounce_sg_len,
-		mq->bounce_buf, mq->sg[0].length);
+		mq->bounce_buf, mq->mqrq_cur->sg[0].length);
 	local_irq_restore(flags);
 }
 
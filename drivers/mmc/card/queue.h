@@ -4,6 +4,50 @@
 struct request;
 struct task_struct;
 
+struct mmc_blk_request {
+	struct mmc_request	mrq;
+	struct mmc_command	cmd;
+	struct mmc_command	stop;
+	struct mmc_data		data;
+};
+
+struct mmc_queue_req {
+	struct request		*req;
+	struct mmc_blk_request	brq;
+	struct scatterlist	*sg;
+};
+
+#define MMC_PACKED_HDR_SZ	512	/* header block of a packed command */
+#define MMC_PACKED_MAX_ENTRIES	63	/* entries that fit in the header */
+
+/* Why a packed command did not take more requests */
+enum mmc_packed_stop {
+	MMC_PACKED_STOP_EMPTY,		/* nothing more queued */
+	MMC_PACKED_STOP_NOT_WRITE,	/* next request is not a plain write */
+	MMC_PACKED_STOP_BLOCKS,		/* host max_blk_count reached */
+	MMC_PACKED_STOP_SEGS,		/* host max_segs reached */
+	MMC_PACKED_STOP_ENTRIES,	/* card or header entry limit */
+	MMC_PACKED_STOP_NR,
+};
+
+struct mmc_packed_stats {
+	unsigned long		cmds;		/* packed commands issued */
+	unsigned long		reqs;		/* requests sent in them */
+	unsigned long		single;		/* writes with nothing to pack */
+	unsigned long		entries[MMC_PACKED_MAX_ENTRIES + 1];
+	unsigned long		stop[MMC_PACKED_STOP_NR];
+	unsigned long		failures;	/* packed commands that failed */
+	unsigned long		retried;	/* requests redone unpacked */
+};
+
+struct mmc_packed {
+	struct list_head	list;		/* requests being packed */
+	__le32			*cmd_hdr;
+	unsigned int		nr_entries;
+	unsigned int		blocks;		/* data blocks, no header */
+	struct mmc_packed_stats	stats;
+};
+
 struct mmc_queue {
 	struct mmc_card		*card;
 	struct task_struct	*thread;
@@ -13,10 +57,13 @@ struct mmc_queue {
 	int			(*issue_fn)(struct mmc_queue *, struct request *);
 	void			*data;
 	struct request_queue	*queue;
-	struct scatterlist	*sg;
 	char			*bounce_buf;
 	struct scatterlist	*bounce_sg;
 	unsigned int		bounce_sg_len;
+	struct mmc_queue_req	mqrq[2];
+	struct mmc_queue_req	*mqrq_cur;	/* being transferred */
+	struct mmc_queue_req	*mqrq_next;	/* prepared while mqrq_cur runs */
+	struct mmc_packed	*packed;	/* NULL if the card can't pack */
 };
 
 extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *);
@@ -24,7 +71,8 @@ extern void mmc_cleanup_queue(struct mmc_queue *);
 extern void mmc_queue_suspend(struct mmc_queue *);
 extern void mmc_queue_resume(struct mmc_queue *);
 
-extern unsigned int mmc_queue_map_sg(struct mmc_queue *);
+extern unsigned int mmc_queue_map_sg(struct mmc_queue *,
+				     struct mmc_queue_req *);
 extern void mmc_queue_bounce_pre(struct mmc_queue *);
 extern void mmc_queue_bounce_post(struct mmc_queue *);
 
@@ -249,6 +249,68 @@ void mmc_wait_for_req(struct mmc_host *host, struct mmc_request *mrq)
 
 EXPORT_SYMBOL(mmc_wait_for_req);
 
+/**
+ *	mmc_start_req - start a request without waiting for it
+ *	@host: MMC host to start command
+ *	@mrq: MMC request to start
+ *
+ *	Start a new MMC request for a host and return immediately.  The
+ *	caller must hold the host claimed until mmc_wait_for_req_done()
+ *	has returned for @mrq, and may use the time in between to prepare
+ *	the next request with mmc_pre_req().
+ */
+void mmc_start_req(struct mmc_host *host, struct mmc_request *mrq)
+{
+	init_completion(&mrq->completion);
+	mrq->done_data = &mrq->completion;
+	mrq->done = mmc_wait_done;
+
+	mmc_start_request(host, mrq);
+}
+EXPORT_SYMBOL(mmc_start_req);
+
+/**
+ *	mmc_wait_for_req_done - wait for a request started by mmc_start_req
+ *	@mrq: MMC request to wait for
+ */
+void mmc_wait_for_req_done(struct mmc_request *mrq)
+{
+	wait_for_completion_io(&mrq->completion);
+}
+EXPORT_SYMBOL(mmc_wait_for_req_done);
+
+/**
+ *	mmc_pre_req - prepare a request before it is started
+ *	@host: MMC host the request will be issued on
+ *	@mrq: MMC request to prepare
+ *	@is_first_req: true if no other request is currently in flight
+ *
+ *	Lets the host do the expensive parts of setting up a request, such
+ *	as mapping its scatterlist for DMA, while the previous request is
+ *	still being transferred.  Every mmc_pre_req() must be paired with
+ *	an mmc_post_req() once the request has completed or been dropped.
+ */
+void mmc_pre_req(struct mmc_host *host, struct mmc_request *mrq,
+		 bool is_first_req)
+{
+	if (host->ops->pre_req)
+		host->ops->pre_req(host, mrq, is_first_req);
+}
+EXPORT_SYMBOL(mmc_pre_req);
+
+/**
+ *	mmc_post_req - undo the work done by mmc_pre_req
+ *	@host: MMC host the request was issued on
+ *	@mrq: MMC request that has completed
+ *	@err: error, if the request was dropped without being started
+ */
+void mmc_post_req(struct mmc_host *host, struct mmc_request *mrq, int err)
+{
+	if (host->ops->post_req)
+		host->ops->post_req(host, mrq, err);
+}
+EXPORT_SYMBOL(mmc_post_req);
+
 /**
  *	mmc_wait_for_cmd - start a command and wait for completion
  *	@host: MMC host to start command
@@ -342,8 +342,10 @@ msmsdcc_dma_complete_tlet(unsigned long data)
 		if (!mrq->data->error)
 			mrq->data->error = -EIO;
 	}
-	dma_unmap_sg(mmc_dev(host->mmc), host->dma.sg, host->dma.num_ents,
-		     host->dma.dir);
+	/* Buffers mapped by msmsdcc_pre_req() are unmapped in post_req */
+	if (!mrq->data->host_cookie)
+		dma_unmap_sg(mmc_dev(host->mmc), host->dma.sg,
+			     host->dma.num_ents, host->dma.dir);
 
 	if (host->curr.user_pages) {
 		struct scatterlist *sg = host->dma.sg;
@@ -591,6 +593,21 @@ static int msmsdcc_check_dma_op_req(struct mmc_data *data)
 		return 0;
 }
 
+/*
+ * Undo the mapping done by msmsdcc_pre_req(), if there is one.
+ */
+static void msmsdcc_unmap_prepared(struct msmsdcc_host *host,
+				   struct mmc_data *data)
+{
+	if (!data->host_cookie)
+		return;
+
+	dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
+		     (data->flags & MMC_DATA_READ) ?
+		     DMA_FROM_DEVICE : DMA_TO_DEVICE);
+	data->host_cookie = 0;
+}
+
 static int msmsdcc_config_dma(struct msmsdcc_host *host, struct mmc_data *data)
 {
 	struct msmsdcc_nc_dmadata *nc;
@@ -601,8 +618,10 @@ static int msmsdcc_config_dma(struct msmsdcc_host *host, struct mmc_data *data)
 	int i;
 	struct scatterlist *sg = data->sg;
 
-	if (host->dma.channel == -1)
+	if (host->dma.channel == -1) {
+		msmsdcc_unmap_prepared(host, data);
 		return -ENOENT;
+	}
 
 	host->dma.sg = data->sg;
 	host->dma.num_ents = data->sg_len;
@@ -624,6 +643,8 @@ static int msmsdcc_config_dma(struct msmsdcc_host *host, struct mmc_data *data)
 		crci = DMOV_SDC5_CRCI;
 #endif
 	else {
+		/* falling back to PIO, which must not see a DMA mapping */
+		msmsdcc_unmap_prepared(host, data);
 		host->dma.sg = NULL;
 		host->dma.num_ents = 0;
 		return -ENOENT;
@@ -685,6 +706,12 @@ static int msmsdcc_config_dma(struct msmsdcc_host *host, struct mmc_data *data)
 	host->dma.hdr.complete_func = msmsdcc_dma_complete_func;
 	host->dma.hdr.crci_mask = msm_dmov_build_crci_mask(1, crci);
 
+	if (data->host_cookie) {
+		/* Already mapped by msmsdcc_pre_req(); just flush out nc */
+		dsb();
+		return 0;
+	}
+
 	n = dma_map_sg(mmc_dev(host->mmc), host->dma.sg,
 			host->dma.num_ents, host->dma.dir);
 	/* dsb inside dma_map_sg will write nc out to mem as well */
@@ -2023,9 +2050,48 @@ static int msmsdcc_disable(struct mmc_host *mmc, int lazy)
 #define msmsdcc_disable NULL
 #endif
 
+/*
+ * Map the data buffers of a request for the data mover ahead of time.
+ * The block driver calls this for the next request while the current
+ * one is still being transferred, which takes the cache maintenance done
+ * by dma_map_sg() out of the gap between two transfers.
+ */
+static void
+msmsdcc_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+		bool is_first_req)
+{
+	struct msmsdcc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+	int n;
+
+	if (!data || data->host_cookie)
+		return;
+
+	if (!host->is_dma_mode || host->dma.channel == -1 ||
+	    data->sg_len > NR_SG || msmsdcc_check_dma_op_req(data))
+		return;
+
+	n = dma_map_sg(mmc_dev(mmc), data->sg, data->sg_len,
+		       (data->flags & MMC_DATA_READ) ?
+		       DMA_FROM_DEVICE : DMA_TO_DEVICE);
+	if (n == data->sg_len)
+		data->host_cookie = n;
+}
+
+static void
+msmsdcc_post_req(struct mmc_host *mmc, struct mmc_request *mrq, int err)
+{
+	struct msmsdcc_host *host = mmc_priv(mmc);
+
+	if (mrq->data)
+		msmsdcc_unmap_prepared(host, mrq->data);
+}
+
 static const struct mmc_host_ops msmsdcc_ops = {
 	.enable		= msmsdcc_enable,
 	.disable	= msmsdcc_disable,
+	.pre_req	= msmsdcc_pre_req,
+	.post_req	= msmsdcc_post_req,
 	.request	= msmsdcc_request,
 	.set_ios	= msmsdcc_set_ios,
 	.get_ro		= msmsdcc_get_ro,
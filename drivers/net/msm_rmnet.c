@@ -439,16 +439,17 @@ static void *msm_rmnet_load_modem(struct net_device *dev)
 static void smd_net_notify(void *_dev, unsigned event)
 {
 	struct rmnet_private *p = netdev_priv((struct net_device *)_dev);
+	unsigned long flags;
 
 	switch (event) {
 	case SMD_EVENT_DATA:
-		spin_lock(&p->lock);
+		spin_lock_irqsave(&p->lock, flags);
 		if (p->skb && (smd_write_avail(p->ch) >= p->skb->len)) {
 			smd_disable_read_intr(p->ch);
 			tasklet_hi_schedule(&p->tsklt);
 		}
 
-		spin_unlock(&p->lock);
+		spin_unlock_irqrestore(&p->lock, flags);
 
 		if (smd_read_avail(p->ch) &&
 			(smd_read_avail(p->ch) >= smd_cur_packet_size(p->ch))) {
@@ -495,6 +496,9 @@ static int __rmnet_open(struct net_device *dev)
 
 		if (r < 0)
 			return -ENODEV;
+
+		/* keep the data path out of the smd irq handler */
+		smd_enable_deferred_notify(p->ch);
 	}
 
 	smd_disable_read_intr(p->ch);
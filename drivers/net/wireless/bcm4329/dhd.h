@@ -144,6 +144,12 @@ typedef struct dhd_pub {
 	ulong rx_readahead_cnt;	/* Number of packets where header read-ahead was used. */
 	ulong tx_realloc;	/* Number of tx packets we had to realloc for headroom */
 	ulong fc_packets;       /* Number of flow control pkts recvd */
+	ulong rx_batches;	/* Rx packet chains handed to the stack at once */
+	ulong rx_napi_polls;	/* NAPI poll passes delivering rx packets */
+	ulong rx_gro_merged;	/* Rx packets coalesced by GRO */
+	ulong dpc_us;		/* Wall clock time in DPC passes and rx delivery,
+				 * SDIO transfer waits included (usec)
+				 */
 
 	/* Last error return */
 	int bcmerror;
@@ -282,6 +288,7 @@ extern void * dhd_os_open_image(char * filename);
 extern int dhd_os_get_image_block(char * buf, int len, void * image);
 extern void dhd_os_close_image(void * image);
 extern void dhd_os_wd_timer(void *bus, uint wdtick);
+extern int dhd_os_set_glom(dhd_pub_t *pub, uint glom);
 extern void dhd_os_sdlock(dhd_pub_t * pub);
 extern void dhd_os_sdunlock(dhd_pub_t * pub);
 extern void dhd_os_sdlock_txq(dhd_pub_t * pub);
@@ -161,6 +161,7 @@ static int
 dhd_dump(dhd_pub_t *dhdp, char *buf, int buflen)
 {
 	char eabuf[ETHER_ADDR_STR_LEN];
+	ulong mbit;
 
 	struct bcmstrbuf b;
 	struct bcmstrbuf *strbuf = &b;
@@ -199,6 +200,16 @@ dhd_dump(dhd_pub_t *dhdp, char *buf, int buflen)
 	bcm_bprintf(strbuf, "rx_readahead_cnt %ld tx_realloc %ld fc_packets %ld\n",
 	            dhdp->rx_readahead_cnt, dhdp->tx_realloc, dhdp->fc_packets);
 	bcm_bprintf(strbuf, "wd_dpc_sched %ld\n", dhdp->wd_dpc_sched);
+	bcm_bprintf(strbuf, "rx_batches %ld rx_napi_polls %ld rx_gro_merged %ld\n",
+	            dhdp->rx_batches, dhdp->rx_napi_polls, dhdp->rx_gro_merged);
+	/* Wall clock cost of the data path since the last clearcounts;
+	 * this includes time blocked on the SDIO bus, it is not CPU time
+	 */
+	mbit = (dhdp->dstats.tx_bytes + dhdp->dstats.rx_bytes) / 125000;
+	bcm_bprintf(strbuf, "dpc_us %ld data Mbit %ld", dhdp->dpc_us, mbit);
+	if (mbit)
+		bcm_bprintf(strbuf, " dpc us/Mbit %ld", dhdp->dpc_us / mbit);
+	bcm_bprintf(strbuf, "\n");
 	bcm_bprintf(strbuf, "\n");
 
 	/* Add any prot info */
@@ -293,6 +304,8 @@ dhd_doiovar(dhd_pub_t *dhd_pub, const bcm_iovar_t *vi, uint32 actionid, const ch
 		dhd_pub->rx_readahead_cnt = 0;
 		dhd_pub->tx_realloc = 0;
 		dhd_pub->wd_dpc_sched = 0;
+		dhd_pub->rx_batches = dhd_pub->rx_napi_polls = 0;
+		dhd_pub->rx_gro_merged = dhd_pub->dpc_us = 0;
 		memset(&dhd_pub->dstats, 0, sizeof(dhd_pub->dstats));
 		dhd_bus_clearcounts(dhd_pub);
 		break;
@@ -38,6 +38,8 @@
 #include <linux/skbuff.h>
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
+#include <linux/ip.h>
+#include <linux/ktime.h>
 #include <linux/random.h>
 #include <linux/spinlock.h>
 #include <linux/ethtool.h>
@@ -229,6 +231,12 @@ extern void dhd_pktfilter_offload_set(dhd_pub_t * dhd, char *arg);
 extern void dhd_pktfilter_offload_enable(dhd_pub_t * dhd, char *arg, int enable, int master_mode);
 #endif
 
+/* Hand rx packets to the stack through NAPI so GRO can coalesce them */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 29)
+#define DHD_NAPI
+#define DHD_NAPI_WEIGHT	64	/* Packets per poll pass */
+#endif
+
 /* Interface control information */
 typedef struct dhd_if {
 	struct dhd_info *info;			/* back pointer to dhd_info */
@@ -294,9 +302,22 @@ typedef struct dhd_info {
 	bool set_multicast;
 	bool set_macaddress;
 	struct ether_addr macvalue;
+	bool set_glom;
+	uint glomvalue;
 	wait_queue_head_t ctrl_wait;
 	atomic_t pend_8021x_cnt;
 
+#ifdef DHD_NAPI
+	/* Rx delivery: a DPC pass collects its packets in rx_pendq and
+	 * hands them to the poll in one batch when it ends
+	 */
+	struct napi_struct napi;
+	struct sk_buff_head rx_napiq;
+	struct sk_buff_head rx_pendq;
+	bool rx_in_dpc;		/* rx_pendq is flushed at the end of the pass */
+	bool napi_on;		/* Poll enabled, primary interface is up */
+#endif /* DHD_NAPI */
+
 #ifdef CONFIG_HAS_EARLYSUSPEND
 	struct early_suspend early_suspend;
 #endif /* CONFIG_HAS_EARLYSUSPEND */
@@ -902,6 +923,31 @@ _dhd_set_mac_address(dhd_info_t *dhd, int ifidx, struct ether_addr *addr)
 	return ret;
 }
 
+static int
+_dhd_set_glom(dhd_info_t *dhd, uint glom)
+{
+	char buf[32];
+	wl_ioctl_t ioc;
+	int ret;
+
+	DHD_TRACE(("%s enter\n", __FUNCTION__));
+	if (!bcm_mkiovar("bus:txglom", (char*)&glom, 4, buf, 32)) {
+		DHD_ERROR(("%s: mkiovar failed for bus:txglom\n", __FUNCTION__));
+		return -1;
+	}
+	memset(&ioc, 0, sizeof(ioc));
+	ioc.cmd = WLC_SET_VAR;
+	ioc.buf = buf;
+	ioc.len = 32;
+	ioc.set = TRUE;
+
+	ret = dhd_prot_ioctl(&dhd->pub, 0, &ioc, ioc.buf, ioc.len);
+	if (ret < 0)
+		DHD_ERROR(("%s: set bus:txglom %d failed\n", __FUNCTION__, glom));
+
+	return ret;
+}
+
 #ifdef SOFTAP
 extern struct net_device *ap_net_dev;
 /* semaphore that the soft AP CODE waits on */
@@ -1045,6 +1091,10 @@ _dhd_sysioc_thread(void *data)
 				}
 			}
 		}
+		if (dhd->set_glom) {
+			dhd->set_glom = FALSE;
+			_dhd_set_glom(dhd, dhd->glomvalue);
+		}
 		dhd_os_wake_unlock(&dhd->pub);
 		dhd_os_start_unlock(&dhd->pub);
 	}
@@ -1220,6 +1270,101 @@ dhd_txflowcontrol(dhd_pub_t *dhdp, int ifidx, bool state)
 		netif_wake_queue(net);
 }
 
+#ifdef DHD_NAPI
+/* GRO only coalesces TCP segments whose checksum is known good.  Unless
+ * the dongle already verified it, sum the frame here so the stack can
+ * check the whole train once instead of every segment.
+ */
+static void
+dhd_rx_csum(struct sk_buff *skb)
+{
+	struct iphdr *iph = (struct iphdr *)skb->data;
+
+	if (skb->ip_summed != CHECKSUM_NONE || skb->protocol != htons(ETH_P_IP) ||
+	    skb->len < sizeof(*iph) || iph->protocol != IPPROTO_TCP ||
+	    !(skb->dev->features & NETIF_F_GRO))
+		return;
+
+	skb->csum = skb_checksum(skb, 0, skb->len, 0);
+	skb->ip_summed = CHECKSUM_COMPLETE;
+}
+
+static int
+dhd_napi_poll(struct napi_struct *napi, int budget)
+{
+	dhd_info_t *dhd = container_of(napi, dhd_info_t, napi);
+	struct sk_buff *skb;
+	ktime_t start = ktime_get();
+	int work = 0;
+
+	while (work < budget && (skb = skb_dequeue(&dhd->rx_napiq)) != NULL) {
+		dhd_rx_csum(skb);
+		switch (napi_gro_receive(napi, skb)) {
+		case GRO_MERGED:
+		case GRO_MERGED_FREE:
+			dhd->pub.rx_gro_merged++;
+			break;
+		default:
+			break;
+		}
+		work++;
+	}
+
+	if (work < budget) {
+		napi_complete(napi);
+		/* Pick up packets queued after the queue was seen empty */
+		if (!skb_queue_empty(&dhd->rx_napiq))
+			napi_reschedule(napi);
+	}
+	dhd->pub.rx_napi_polls++;
+
+	/* With a DPC thread the poll runs nested in the DPC pass (see
+	 * dhd_napi_sched()) and is already accounted for there.
+	 */
+	if (dhd->dpc_pid < 0)
+		dhd->pub.dpc_us += (ulong)ktime_us_delta(ktime_get(), start);
+
+	return work;
+}
+
+static void
+dhd_napi_sched(dhd_info_t *dhd, struct sk_buff_head *rxq)
+{
+	ulong flags;
+
+	spin_lock_irqsave(&dhd->rx_napiq.lock, flags);
+	skb_queue_splice_tail_init(rxq, &dhd->rx_napiq);
+	spin_unlock_irqrestore(&dhd->rx_napiq.lock, flags);
+	dhd->pub.rx_batches++;
+
+	/* From the DPC thread, the poll runs when bottom halves are
+	 * re-enabled; from the tasklet it follows in the same softirq run.
+	 */
+	local_bh_disable();
+	napi_schedule(&dhd->napi);
+	local_bh_enable();
+}
+
+/* End of a DPC pass: everything it read goes to the poll at once, so
+ * that GRO sees the whole batch before napi_complete() flushes it.
+ */
+static void
+dhd_napi_flush(dhd_info_t *dhd)
+{
+	struct sk_buff_head rxq;
+	ulong flags;
+
+	__skb_queue_head_init(&rxq);
+	spin_lock_irqsave(&dhd->rx_pendq.lock, flags);
+	skb_queue_splice_init(&dhd->rx_pendq, &rxq);
+	dhd->rx_in_dpc = FALSE;
+	spin_unlock_irqrestore(&dhd->rx_pendq.lock, flags);
+
+	if (!skb_queue_empty(&rxq))
+		dhd_napi_sched(dhd, &rxq);
+}
+#endif /* DHD_NAPI */
+
 void
 dhd_rx_frame(dhd_pub_t *dhdp, int ifidx, void *pktbuf, int numpkt)
 {
@@ -1231,6 +1376,12 @@ dhd_rx_frame(dhd_pub_t *dhdp, int ifidx, void *pktbuf, int numpkt)
 	int i;
 	dhd_if_t *ifp;
 	wl_event_msg_t event;
+#ifdef DHD_NAPI
+	struct sk_buff_head rxq;
+	ulong flags;
+
+	__skb_queue_head_init(&rxq);
+#endif
 
 	DHD_TRACE(("%s: Enter\n", __FUNCTION__));
 
@@ -1295,6 +1446,13 @@ dhd_rx_frame(dhd_pub_t *dhdp, int ifidx, void *pktbuf, int numpkt)
 		dhdp->dstats.rx_bytes += skb->len;
 		dhdp->rx_packets++; /* Local count */
 
+#ifdef DHD_NAPI
+		if (dhd->napi_on) {
+			__skb_queue_tail(&rxq, skb);
+			continue;
+		}
+#endif /* DHD_NAPI */
+
 		if (in_interrupt()) {
 			netif_rx(skb);
 		} else {
@@ -1315,6 +1473,19 @@ dhd_rx_frame(dhd_pub_t *dhdp, int ifidx, void *pktbuf, int numpkt)
 #endif /* LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 0) */
 		}
 	}
+#ifdef DHD_NAPI
+	/* Inside a DPC pass, wait for the rest of the pass */
+	if (!skb_queue_empty(&rxq)) {
+		spin_lock_irqsave(&dhd->rx_pendq.lock, flags);
+		if (dhd->rx_in_dpc) {
+			skb_queue_splice_tail_init(&rxq, &dhd->rx_pendq);
+			spin_unlock_irqrestore(&dhd->rx_pendq.lock, flags);
+		} else {
+			spin_unlock_irqrestore(&dhd->rx_pendq.lock, flags);
+			dhd_napi_sched(dhd, &rxq);
+		}
+	}
+#endif
 	dhd_os_wake_lock_timeout_enable(dhdp);
 }
 
@@ -1453,6 +1624,27 @@ dhd_watchdog(ulong data)
 	dhd_os_wake_unlock(&dhd->pub);
 }
 
+/* Run one bus DPC pass, charging its wall clock time (SDIO waits
+ * included) to the dpc_us counter
+ */
+static bool
+dhd_dpc_pass(dhd_info_t *dhd)
+{
+	ktime_t start = ktime_get();
+	bool resched;
+
+#ifdef DHD_NAPI
+	dhd->rx_in_dpc = TRUE;
+#endif
+	resched = dhd_bus_dpc(dhd->pub.bus);
+#ifdef DHD_NAPI
+	dhd_napi_flush(dhd);
+#endif
+	dhd->pub.dpc_us += (ulong)ktime_us_delta(ktime_get(), start);
+
+	return resched;
+}
+
 static int
 dhd_dpc_thread(void *data)
 {
@@ -1477,7 +1669,7 @@ dhd_dpc_thread(void *data)
 		if (down_interruptible(&dhd->dpc_sem) == 0) {
 			/* Call bus dpc unless it indicated down (then clean stop) */
 			if (dhd->pub.busstate != DHD_BUS_DOWN) {
-				if (dhd_bus_dpc(dhd->pub.bus)) {
+				if (dhd_dpc_pass(dhd)) {
 					up(&dhd->dpc_sem);
 				}
 				else {
@@ -1504,7 +1696,7 @@ dhd_dpc(ulong data)
 
 	/* Call bus dpc unless it indicated down (then clean stop) */
 	if (dhd->pub.busstate != DHD_BUS_DOWN) {
-		if (dhd_bus_dpc(dhd->pub.bus))
+		if (dhd_dpc_pass(dhd))
 			tasklet_schedule(&dhd->tasklet);
 	} else {
 		dhd_bus_stop(dhd->pub.bus, TRUE);
@@ -1882,6 +2074,15 @@ dhd_stop(struct net_device *net)
 	/* Set state and stop OS transmissions */
 	dhd->pub.up = 0;
 	netif_stop_queue(net);
+
+#ifdef DHD_NAPI
+	if (dhd->napi_on) {
+		dhd->napi_on = FALSE;
+		napi_disable(&dhd->napi);
+		skb_queue_purge(&dhd->rx_napiq);
+		skb_queue_purge(&dhd->rx_pendq);
+	}
+#endif /* DHD_NAPI */
 #else
 	DHD_ERROR(("BYPASS %s:due to BRCM compilation : under investigation ...\n", __FUNCTION__));
 #endif /* !defined(IGNORE_ETH0_DOWN) */
@@ -1923,6 +2124,13 @@ dhd_open(struct net_device *net)
 	else
 		dhd->iflist[ifidx]->net->features &= ~NETIF_F_IP_CSUM;
 #endif
+
+#ifdef DHD_NAPI
+	if (!dhd->napi_on) {
+		napi_enable(&dhd->napi);
+		dhd->napi_on = TRUE;
+	}
+#endif /* DHD_NAPI */
 	}
 	/* Allow transmit calls */
 	netif_start_queue(net);
@@ -2069,6 +2277,12 @@ dhd_attach(osl_t *osh, struct dhd_bus *bus, uint bus_hdrlen)
 	spin_lock_init(&dhd->txqlock);
 	spin_lock_init(&dhd->dhd_lock);
 
+#ifdef DHD_NAPI
+	skb_queue_head_init(&dhd->rx_napiq);
+	skb_queue_head_init(&dhd->rx_pendq);
+	netif_napi_add(net, &dhd->napi, dhd_napi_poll, DHD_NAPI_WEIGHT);
+#endif /* DHD_NAPI */
+
 	/* Initialize Wakelock stuff */
 	spin_lock_init(&dhd->wl_lock);
 	dhd->wl_count = 0;
@@ -2360,6 +2574,9 @@ dhd_net_attach(dhd_pub_t *dhdp, int ifidx)
 		temp_addr[0] |= 0x02;  /* set bit 2 , - Locally Administered address  */
 	}
 	net->hard_header_len = ETH_HLEN + dhd->pub.hdrlen;
+#ifdef DHD_NAPI
+	net->features |= NETIF_F_GRO;
+#endif
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 24)
 	net->ethtool_ops = &dhd_ethtool_ops;
 #endif /* LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 24) */
@@ -2504,6 +2721,11 @@ dhd_detach(dhd_pub_t *dhdp)
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 27)) && defined(CONFIG_PM_SLEEP)
 			unregister_pm_notifier(&dhd_sleep_pm_notifier);
 #endif /* (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 27)) && defined(CONFIG_PM_SLEEP) */
+#ifdef DHD_NAPI
+			netif_napi_del(&dhd->napi);
+			skb_queue_purge(&dhd->rx_napiq);
+			skb_queue_purge(&dhd->rx_pendq);
+#endif /* DHD_NAPI */
 			free_netdev(ifp->net);
 #ifdef CONFIG_HAS_WAKELOCK
 			wake_lock_destroy(&dhd->wl_wifi);
@@ -2724,6 +2946,21 @@ dhd_os_wd_timer(void *bus, uint wdtick)
 	}
 }
 
+/* Change the dongle's rx glomming from a context that can't block */
+int
+dhd_os_set_glom(dhd_pub_t *pub, uint glom)
+{
+	dhd_info_t *dhd = (dhd_info_t *)pub->info;
+
+	if (dhd->sysioc_pid < 0)
+		return -1;
+
+	dhd->glomvalue = glom;
+	dhd->set_glom = TRUE;
+	up(&dhd->sysioc_sem);
+	return 0;
+}
+
 void *
 dhd_os_open_image(char *filename)
 {
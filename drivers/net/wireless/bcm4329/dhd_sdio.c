@@ -82,6 +82,17 @@
 
 #define DHD_TXMINMAX	1	/* Max tx frames if rx still pending */
 
+#define DHD_TXBATCH	8	/* Max tx frames dequeued under one txq lock */
+
+/* Dongle glomming (bus:txglom) is requested while the rx rate is at least
+ * rxglom_hi frames/s and released again at or below rxglom_lo; the rate is
+ * sampled every DHD_GLOM_SAMPLE_MS from the watchdog.
+ */
+#define DHD_RXGLOM_HI		400
+#define DHD_RXGLOM_LO		100
+#define DHD_GLOM_FRAMES		8	/* Frames per superframe when glomming */
+#define DHD_GLOM_SAMPLE_MS	1000
+
 #define MEMBLOCK	2048		/* Block size used for downloading of dongle image */
 #define MAX_DATA_BUF	(32 * 1024)	/* Must be large enough to hold biggest possible glom */
 
@@ -270,6 +281,8 @@ typedef struct dhd_bus {
 	uint		pktgen_rcvd;		/* Number of test packets received */
 	uint		pktgen_fail;		/* Number of failed send attempts */
 	uint16		pktgen_len;		/* Length of next packet to send */
+	uint		pktgen_bytes;		/* Test payload bytes sent and received */
+	ulong		pktgen_dpc_us;		/* dpc_us when the counts were cleared */
 #endif /* SDTEST */
 
 	/* Some additional counters */
@@ -291,6 +304,17 @@ typedef struct dhd_bus {
 	uint		f2rxdata;		/* Number of frame data reads */
 	uint		f2txdata;		/* Number of f2 frame writes */
 	uint		f1regdata;		/* Number of f1 register accesses */
+	uint		txbatches;		/* Number of txq batch dequeues */
+	uint		txbatchpkts;		/* Packets sent from those batches */
+
+	/* Adaptive dongle glomming */
+	uint		rxglom_hi;		/* Rx frames/s to turn glomming on */
+	uint		rxglom_lo;		/* Rx frames/s to turn glomming off */
+	uint		glom_cur;		/* bus:txglom value last set */
+	uint		glom_ms;		/* Time since last rate sample */
+	ulong		glom_rxlast;		/* rx_packets at last rate sample */
+	uint		rxrate;			/* Rx frames/s at last sample */
+	uint		glom_changes;		/* Number of bus:txglom changes */
 
 	uint8		*ctrl_frame_buf;
 	uint32		ctrl_frame_len;
@@ -1142,12 +1166,15 @@ static uint
 dhdsdio_sendfromq(dhd_bus_t *bus, uint maxframes)
 {
 	void *pkt;
+	void *pkts[DHD_TXBATCH];
+	int precs[DHD_TXBATCH];
 	uint32 intstatus = 0;
 	uint retries = 0;
-	int ret = 0, prec_out;
+	int ret = 0;
 	uint cnt = 0;
 	uint datalen;
 	uint8 tx_prec_map;
+	uint i, npkts = 0, nbatch;
 
 	dhd_pub_t *dhd = bus->dhd;
 	sdpcmd_regs_t *regs = bus->regs;
@@ -1157,13 +1184,25 @@ dhdsdio_sendfromq(dhd_bus_t *bus, uint maxframes)
 	tx_prec_map = ~bus->flowcontrol;
 
 	/* Send frames until the limit or some other event */
-	for (cnt = 0; (cnt < maxframes) && DATAOK(bus); cnt++) {
-		dhd_os_sdlock_txq(bus->dhd);
-		if ((pkt = pktq_mdeq(&bus->txq, tx_prec_map, &prec_out)) == NULL) {
+	for (cnt = 0, i = 0; (cnt < maxframes) && DATAOK(bus); cnt++, i++) {
+		if (i == npkts) {
+			/* Refill the batch, no deeper than the dongle's tx window */
+			nbatch = MIN(maxframes - cnt, DHD_TXBATCH);
+			nbatch = MIN(nbatch, (uint8)(bus->tx_max - bus->tx_seq));
+			dhd_os_sdlock_txq(bus->dhd);
+			for (npkts = 0; npkts < nbatch; npkts++) {
+				pkts[npkts] = pktq_mdeq(&bus->txq, tx_prec_map, &precs[npkts]);
+				if (pkts[npkts] == NULL)
+					break;
+			}
 			dhd_os_sdunlock_txq(bus->dhd);
-			break;
+			if (npkts == 0)
+				break;
+			bus->txbatches++;
+			bus->txbatchpkts += npkts;
+			i = 0;
 		}
-		dhd_os_sdunlock_txq(bus->dhd);
+		pkt = pkts[i];
 		datalen = PKTLEN(bus->dhd->osh, pkt) - SDPCM_HDRLEN;
 
 #ifndef SDTEST
@@ -1183,13 +1222,31 @@ dhdsdio_sendfromq(dhd_bus_t *bus, uint maxframes)
 			/* Check device status, signal pending interrupt */
 			R_SDREG(intstatus, &regs->intstatus, retries);
 			bus->f2txdata++;
-			if (bcmsdh_regfail(bus->sdh))
+			if (bcmsdh_regfail(bus->sdh)) {
+				i++;	/* this one did go out */
 				break;
+			}
 			if (intstatus & bus->hostintmask)
 				bus->ipend = TRUE;
 		}
 	}
 
+	/* Put back whatever of the last batch was not sent, in order */
+	if (i < npkts) {
+		dhd_os_sdlock_txq(bus->dhd);
+		while (npkts-- > i) {
+			pkt = pkts[npkts];
+			if (pktq_full(&bus->txq) || pktq_pfull(&bus->txq, precs[npkts])) {
+				PKTPULL(bus->dhd->osh, pkt, SDPCM_HDRLEN);
+				dhd_txcomplete(bus->dhd, pkt, FALSE);
+				PKTFREE(bus->dhd->osh, pkt, TRUE);
+				bus->dhd->tx_errors++;
+			} else
+				pktq_penq_head(&bus->txq, precs[npkts], pkt);
+		}
+		dhd_os_sdunlock_txq(bus->dhd);
+	}
+
 	/* Deflow-control stack if needed */
 	if (dhd_doflow && dhd->up && (dhd->busstate == DHD_BUS_DATA) &&
 	    dhd->txoff && (pktq_len(&bus->txq) < FCLOW))
@@ -1424,6 +1481,8 @@ enum {
 	IOV_TXBOUND,
 	IOV_RXBOUND,
 	IOV_TXMINMAX,
+	IOV_RXGLOM_HI,
+	IOV_RXGLOM_LO,
 	IOV_IDLETIME,
 	IOV_IDLECLOCK,
 	IOV_SD1IDLE,
@@ -1456,6 +1515,8 @@ const bcm_iovar_t dhdsdio_iovars[] = {
 	{"txbound",	IOV_TXBOUND,	0,	IOVT_UINT32,	0 },
 	{"rxbound",	IOV_RXBOUND,	0,	IOVT_UINT32,	0 },
 	{"txminmax", IOV_TXMINMAX,	0,	IOVT_UINT32,	0 },
+	{"rxglom_hi",	IOV_RXGLOM_HI,	0,	IOVT_UINT32,	0 },
+	{"rxglom_lo",	IOV_RXGLOM_LO,	0,	IOVT_UINT32,	0 },
 	{"cpu",		IOV_CPU,	0,	IOVT_BOOL,	0 },
 #endif /* DHD_DEBUG */
 #ifdef DHD_DEBUG_TRAP
@@ -1487,6 +1548,9 @@ void
 dhd_bus_dump(dhd_pub_t *dhdp, struct bcmstrbuf *strbuf)
 {
 	dhd_bus_t *bus = dhdp->bus;
+#ifdef SDTEST
+	ulong dpc_us, mbit;
+#endif
 
 	bcm_bprintf(strbuf, "Bus SDIO structure:\n");
 	bcm_bprintf(strbuf, "hostintmask 0x%08x intstatus 0x%08x sdpcm_ver %d\n",
@@ -1512,6 +1576,11 @@ dhd_bus_dump(dhd_pub_t *dhdp, struct bcmstrbuf *strbuf)
 	bcm_bprintf(strbuf, "f2rx (hdrs/data) %d (%d/%d), f2tx %d f1regs %d\n",
 	            (bus->f2rxhdrs + bus->f2rxdata), bus->f2rxhdrs, bus->f2rxdata,
 	            bus->f2txdata, bus->f1regdata);
+	bcm_bprintf(strbuf, "txbatches %d txbatchpkts %d\n",
+	            bus->txbatches, bus->txbatchpkts);
+	bcm_bprintf(strbuf, "glom %d rxrate %d/s (hi %d lo %d) changes %d\n",
+	            bus->glom_cur, bus->rxrate, bus->rxglom_hi, bus->rxglom_lo,
+	            bus->glom_changes);
 	{
 		dhd_dump_pct(strbuf, "\nRx: pkts/f2rd", bus->dhd->rx_packets,
 		             (bus->f2rxhdrs + bus->f2rxdata));
@@ -1531,6 +1600,7 @@ dhd_bus_dump(dhd_pub_t *dhdp, struct bcmstrbuf *strbuf)
 		dhd_dump_pct(strbuf, ", pkts/sd", bus->dhd->tx_packets,
 		             (bus->f2txdata + bus->f1regdata));
 		dhd_dump_pct(strbuf, ", pkts/int", bus->dhd->tx_packets, bus->intrcount);
+		dhd_dump_pct(strbuf, ", pkts/batch", bus->txbatchpkts, bus->txbatches);
 		bcm_bprintf(strbuf, "\n");
 
 		dhd_dump_pct(strbuf, "Total: pkts/f2rw",
@@ -1554,6 +1624,12 @@ dhd_bus_dump(dhd_pub_t *dhdp, struct bcmstrbuf *strbuf)
 		            bus->pktgen_total, bus->pktgen_minlen, bus->pktgen_maxlen);
 		bcm_bprintf(strbuf, "send attempts %d rcvd %d fail %d\n",
 		            bus->pktgen_sent, bus->pktgen_rcvd, bus->pktgen_fail);
+		dpc_us = bus->dhd->dpc_us - bus->pktgen_dpc_us;
+		mbit = bus->pktgen_bytes / 125000;
+		bcm_bprintf(strbuf, "bytes %d dpc %lu us", bus->pktgen_bytes, dpc_us);
+		if (mbit)
+			bcm_bprintf(strbuf, ", %lu us/Mbit", dpc_us / mbit);
+		bcm_bprintf(strbuf, "\n");
 	}
 #endif /* SDTEST */
 #ifdef DHD_DEBUG
@@ -1576,6 +1652,12 @@ dhd_bus_clearcounts(dhd_pub_t *dhdp)
 	bus->tx_sderrs = bus->fc_rcvd = bus->fc_xoff = bus->fc_xon = 0;
 	bus->rxglomfail = bus->rxglomframes = bus->rxglompkts = 0;
 	bus->f2rxhdrs = bus->f2rxdata = bus->f2txdata = bus->f1regdata = 0;
+	bus->txbatches = bus->txbatchpkts = bus->glom_changes = 0;
+#ifdef SDTEST
+	/* dpc_us was cleared along with the other dhd counters */
+	bus->pktgen_bytes = 0;
+	bus->pktgen_dpc_us = 0;
+#endif /* SDTEST */
 }
 
 #ifdef SDTEST
@@ -1629,8 +1711,11 @@ dhdsdio_pktgen_set(dhd_bus_t *bus, uint8 *arg)
 	bus->pktgen_len = MIN(bus->pktgen_len, bus->pktgen_maxlen);
 
 	/* Clear counts for a new pktgen (mode change, or was stopped) */
-	if (bus->pktgen_count && (!oldcnt || oldmode != bus->pktgen_mode))
+	if (bus->pktgen_count && (!oldcnt || oldmode != bus->pktgen_mode)) {
 		bus->pktgen_sent = bus->pktgen_rcvd = bus->pktgen_fail = 0;
+		bus->pktgen_bytes = 0;
+		bus->pktgen_dpc_us = bus->dhd->dpc_us;
+	}
 
 	return 0;
 }
@@ -2295,6 +2380,25 @@ dhdsdio_doiovar(dhd_bus_t *bus, const bcm_iovar_t *vi, uint32 actionid, const ch
 		dhd_txminmax = (uint)int_val;
 		break;
 
+	case IOV_GVAL(IOV_RXGLOM_HI):
+		int_val = (int32)bus->rxglom_hi;
+		bcopy(&int_val, arg, val_size);
+		break;
+
+	case IOV_SVAL(IOV_RXGLOM_HI):
+		/* 0 leaves dongle glomming as it is */
+		bus->rxglom_hi = (uint)int_val;
+		break;
+
+	case IOV_GVAL(IOV_RXGLOM_LO):
+		int_val = (int32)bus->rxglom_lo;
+		bcopy(&int_val, arg, val_size);
+		break;
+
+	case IOV_SVAL(IOV_RXGLOM_LO):
+		bus->rxglom_lo = (uint)int_val;
+		break;
+
 
 
 #endif /* DHD_DEBUG */
@@ -2715,6 +2819,9 @@ dhd_bus_stop(struct dhd_bus *bus, bool enforce_mutex)
 	bus->rxskip = FALSE;
 	bus->tx_seq = bus->rx_seq = 0;
 
+	/* The dongle comes back up with glomming off */
+	bus->glom_cur = bus->glom_ms = bus->rxrate = 0;
+
 	if (enforce_mutex)
 		dhd_os_sdunlock(bus->dhd);
 }
@@ -4429,6 +4536,8 @@ dhdsdio_pktgen(dhd_bus_t *bus)
 			bus->pktgen_fail++;
 			if (bus->pktgen_stop && bus->pktgen_stop == bus->pktgen_fail)
 				bus->pktgen_count = 0;
+		} else {
+			bus->pktgen_bytes += len;
 		}
 		bus->pktgen_sent++;
 
@@ -4488,6 +4597,8 @@ dhdsdio_testrcv(dhd_bus_t *bus, void *pkt, uint seq)
 		return;
 	}
 
+	bus->pktgen_bytes += pktlen;
+
 	/* Extract header fields */
 	data = PKTDATA(osh, pkt);
 	cmd = *data++;
@@ -4635,6 +4746,31 @@ dhd_bus_watchdog(dhd_pub_t *dhdp)
 	}
 #endif
 
+	/* Have the dongle glom rx frames only while the rx rate warrants it */
+	if (bus->rxglom_hi && (dhdp->busstate == DHD_BUS_DATA)) {
+		bus->glom_ms += dhd_watchdog_ms;
+		if (bus->glom_ms >= DHD_GLOM_SAMPLE_MS) {
+			uint glom = bus->glom_cur;
+
+			bus->rxrate = (uint)(dhdp->rx_packets - bus->glom_rxlast) * 1000 /
+			        bus->glom_ms;
+			bus->glom_rxlast = dhdp->rx_packets;
+			bus->glom_ms = 0;
+
+			if (bus->rxrate >= bus->rxglom_hi)
+				glom = DHD_GLOM_FRAMES;
+			else if (bus->rxrate <= bus->rxglom_lo)
+				glom = 0;
+
+			if ((glom != bus->glom_cur) && (dhd_os_set_glom(dhdp, glom) == 0)) {
+				DHD_INFO(("%s: rx %d frames/s, glom %d\n",
+				          __FUNCTION__, bus->rxrate, glom));
+				bus->glom_cur = glom;
+				bus->glom_changes++;
+			}
+		}
+	}
+
 	/* On idle timeout clear activity flag and/or turn off clock */
 	if ((bus->idletime > 0) && (bus->clkstate == CLK_AVAIL)) {
 		if (++bus->idlecount >= bus->idletime) {
@@ -5151,6 +5287,9 @@ dhdsdio_probe_init(dhd_bus_t *bus, osl_t *osh, void *sdh)
 	bus->idletime = (int32)dhd_idletime;
 	bus->idleclock = DHD_IDLE_ACTIVE;
 
+	bus->rxglom_hi = DHD_RXGLOM_HI;
+	bus->rxglom_lo = DHD_RXGLOM_LO;
+
 	/* Query the SD clock speed */
 	if (bcmsdh_iovar_op(sdh, "sd_divisor", NULL, 0,
 	                    &bus->sd_divisor, sizeof(int32), FALSE) != BCME_OK) {
@@ -531,39 +531,54 @@ static void mdp_ppp_setbg(MDPIBUF *iBuf)
 	((format == MDP_Y_CBCR_H2V2 || format == MDP_Y_CRCB_H2V2) ?  2 :\
 	(format == MDP_Y_CBCR_H2V1 || format == MDP_Y_CRCB_H2V1) ?  1 : 1)
 
-static void get_len(struct mdp_img *img, struct mdp_rect *rect, uint32_t bpp,
-			uint32_t *len0, uint32_t *len1)
+/*
+ * Byte ranges of the rows of @rect in @img: plane 0 from the first row
+ * of the rect, and for pseudo planar formats the CbCr plane, which
+ * follows the full height of the Y plane.
+ */
+static void get_ranges(struct mdp_img *img, struct mdp_rect *rect,
+		       uint32_t bpp, unsigned long *start0, uint32_t *len0,
+		       unsigned long *start1, uint32_t *len1)
 {
+	uint32_t ratio, y1;
+
+	*start0 = img->offset + (rect->y * img->width + rect->x) * bpp;
 	*len0 = IMG_LEN(rect->h, img->width, rect->w, bpp);
-	if (IS_PSEUDOPLNR(img->format))
-		*len1 = *len0/Y_TO_CRCB_RATIO(img->format);
-	else
+	if (IS_PSEUDOPLNR(img->format)) {
+		ratio = Y_TO_CRCB_RATIO(img->format);
+		y1 = rect->y / ratio;
+		*start1 = img->offset + img->height * img->width * bpp +
+			  y1 * img->width * bpp;
+		*len1 = (DIV_ROUND_UP(rect->y + rect->h, ratio) - y1) *
+			img->width * bpp;
+	} else {
+		*start1 = 0;
 		*len1 = 0;
+	}
 }
 
 static void flush_imgs(struct mdp_blit_req *req, int src_bpp, int dst_bpp,
 			struct file *p_src_file, struct file *p_dst_file)
 {
 #ifdef CONFIG_ANDROID_PMEM
+	unsigned long src0_start, src1_start, dst0_start, dst1_start;
 	uint32_t src0_len, src1_len, dst0_len, dst1_len;
 
 	/* flush src images to memory before dma to mdp */
-	get_len(&req->src, &req->src_rect, src_bpp,
-	&src0_len, &src1_len);
+	get_ranges(&req->src, &req->src_rect, src_bpp,
+		   &src0_start, &src0_len, &src1_start, &src1_len);
 
-	flush_pmem_file(p_src_file,
-	req->src.offset, src0_len);
+	flush_pmem_file(p_src_file, src0_start, src0_len);
 
-	if (IS_PSEUDOPLNR(req->src.format))
-		flush_pmem_file(p_src_file,
-			req->src.offset + src0_len, src1_len);
+	if (src1_len)
+		flush_pmem_file(p_src_file, src1_start, src1_len);
 
-	get_len(&req->dst, &req->dst_rect, dst_bpp, &dst0_len, &dst1_len);
-	flush_pmem_file(p_dst_file, req->dst.offset, dst0_len);
+	get_ranges(&req->dst, &req->dst_rect, dst_bpp,
+		   &dst0_start, &dst0_len, &dst1_start, &dst1_len);
+	flush_pmem_file(p_dst_file, dst0_start, dst0_len);
 
-	if (IS_PSEUDOPLNR(req->dst.format))
-		flush_pmem_file(p_dst_file,
-			req->dst.offset + dst0_len, dst1_len);
+	if (dst1_len)
+		flush_pmem_file(p_dst_file, dst1_start, dst1_len);
 #endif
 }
 
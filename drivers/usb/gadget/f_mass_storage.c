@@ -74,6 +74,9 @@
  *				being a CD-ROM.
  *	->nofua		Flag specifying that FUA flag in SCSI WRITE(10,12)
  *				commands for this LUN shall be ignored.
+ *	->nocache	Flag specifying that data shall not be kept
+ *				in the page cache once it has been
+ *				transferred (see below).
  *
  *	lun_name_format	A printf-like format for names of the LUN
  *				devices.  This determines how the
@@ -143,10 +146,19 @@
  * (look for FSG_MODULE_PARAMETERS() macro usage, what's inside it is
  * the prefix).
  *
+ * Independently of the above, the depth and size of the buffer
+ * pipeline are always available as unprefixed parameters:
+ *
+ *	num_buffers=N	Default N = 2 (4 with CONFIG_USB_CSW_HACK),
+ *				number of data buffers, at most 32.
+ *	buflen=N	Default N = 16384, size of each data buffer in
+ *				bytes, rounded down to a whole number of
+ *				pages and capped at 128K.
+ *
  *
  * Requirements are modest; only a bulk-in and a bulk-out endpoint are
- * needed.  The memory requirement amounts to two 16K buffers, size
- * configurable by a parameter.  Support is included for both
+ * needed.  The memory requirement amounts to two 16K buffers, number
+ * and size configurable by parameters.  Support is included for both
  * full-speed and high-speed operation.
  *
  * Note that the driver is slightly non-portable in that it assumes a
@@ -166,6 +178,16 @@
  * ro setting are not allowed when the medium is loaded or if CD-ROM
  * emulation is being used.
  *
+ * Writing 1 to the "nocache" attribute of a LUN makes the function
+ * start writeback of the data the host sends as soon as it has been
+ * copied to the backing file, and drop pages from the page cache once
+ * they have been read or written back.  The host keeps its own cache
+ * of the medium, so a second copy here only costs memory, and a long
+ * write no longer piles up dirty pages that all have to be flushed at
+ * once when the dirty limits are hit.  This is the closest the
+ * function can get to O_DIRECT access: the data buffers are kernel
+ * memory, which the direct I/O paths cannot pin.
+ *
  * When a LUN receive an "eject" SCSI request (Start/Stop Unit),
  * if the LUN is removable, the backing file is released to simulate
  * ejection.
@@ -218,13 +240,13 @@
  *
  * To provide maximum throughput, the driver uses a circular pipeline of
  * buffer heads (struct fsg_buffhd).  In principle the pipeline can be
- * arbitrarily long; in practice the benefits don't justify having more
- * than 2 stages (i.e., double buffering).  But it helps to think of the
- * pipeline as being a long one.  Each buffer head contains a bulk-in and
- * a bulk-out request pointer (since the buffer can be used for both
- * output and input -- directions always are given from the host's
- * point of view) as well as a pointer to the buffer and various state
- * variables.
+ * arbitrarily long; double buffering is the default, but a deeper ring
+ * (the "num_buffers" parameter) lets the host queue more data while the
+ * thread is blocked in file I/O, which helps with slow backing media.
+ * Each buffer head contains a bulk-in and a bulk-out request pointer
+ * (since the buffer can be used for both output and input -- directions
+ * always are given from the host's point of view) as well as a pointer
+ * to the buffer and various state variables.
  *
  * Use of the pipeline follows a simple protocol.  There is a variable
  * (fsg->next_buffhd_to_fill) that points to the next buffer head to use.
@@ -322,6 +344,14 @@ static const char fsg_string_interface[] = "Mass Storage";
 static int write_error_after_csw_sent;
 static int csw_hack_sent;
 #endif
+
+static unsigned int fsg_num_buffers = FSG_NUM_BUFFERS;
+module_param_named(num_buffers, fsg_num_buffers, uint, S_IRUGO);
+MODULE_PARM_DESC(num_buffers, "number of data buffers (2-32)");
+
+static unsigned int fsg_buflen = FSG_BUFLEN;
+module_param_named(buflen, fsg_buflen, uint, S_IRUGO);
+MODULE_PARM_DESC(buflen, "size of each data buffer in bytes");
 /*-------------------------------------------------------------------------*/
 
 struct fsg_dev;
@@ -371,7 +401,9 @@ struct fsg_common {
 
 	struct fsg_buffhd	*next_buffhd_to_fill;
 	struct fsg_buffhd	*next_buffhd_to_drain;
-	struct fsg_buffhd	buffhds[FSG_NUM_BUFFERS];
+	struct fsg_buffhd	*buffhds;
+	unsigned int		num_buffers;
+	u32			buflen;
 
 	int			cmnd_size;
 	u8			cmnd[MAX_COMMAND_SIZE];
@@ -425,6 +457,7 @@ struct fsg_config {
 		char removable;
 		char cdrom;
 		char nofua;
+		char nocache;
 	} luns[FSG_MAX_LUNS];
 
 	const char		*lun_name_format;
@@ -744,6 +777,37 @@ static int sleep_thread(struct fsg_common *common)
 }
 
 
+/*-------------------------------------------------------------------------*/
+
+/* Helpers for LUNs with the nocache attribute set */
+
+static void fsg_lun_drop_pages(struct fsg_lun *curlun, loff_t start,
+			       loff_t end)
+{
+	if (end > start)
+		invalidate_mapping_pages(curlun->filp->f_mapping,
+					 start >> PAGE_CACHE_SHIFT,
+					 (end - 1) >> PAGE_CACHE_SHIFT);
+}
+
+static void fsg_lun_start_writeback(struct fsg_lun *curlun, loff_t offset,
+				    unsigned int amount)
+{
+	struct address_space *mapping = curlun->filp->f_mapping;
+
+	filemap_fdatawrite_range(mapping, offset, offset + amount - 1);
+
+	/*
+	 * The previous range has had a whole buffer's worth of USB
+	 * transfer time to reach the medium; drop whatever of it is
+	 * clean by now.  Pages still under writeback are skipped.
+	 */
+	fsg_lun_drop_pages(curlun, curlun->wb_start, curlun->wb_end);
+	curlun->wb_start = offset;
+	curlun->wb_end = offset + amount;
+}
+
+
 /*-------------------------------------------------------------------------*/
 
 static int do_read(struct fsg_common *common)
@@ -799,7 +863,7 @@ static int do_read(struct fsg_common *common)
 		 * If this means reading 0 then we were asked to read past
 		 *	the end of file.
 		 */
-		amount = min(amount_left, FSG_BUFLEN);
+		amount = min(amount_left, common->buflen);
 		amount = min((loff_t)amount,
 			     curlun->file_length - file_offset);
 		partial_page = file_offset & (PAGE_CACHE_SIZE - 1);
@@ -847,6 +911,9 @@ static int do_read(struct fsg_common *common)
 			     (int)nread, amount);
 			nread -= (nread & 511);	/* Round down to a block */
 		}
+		if (curlun->nocache)
+			fsg_lun_drop_pages(curlun, file_offset,
+					   file_offset + nread);
 		file_offset  += nread;
 		amount_left  -= nread;
 		common->residue -= nread;
@@ -955,7 +1022,7 @@ static int do_write(struct fsg_common *common)
 			 *	to write past the end of file.
 			 * Finally, round down to a block boundary.
 			 */
-			amount = min(amount_left_to_req, FSG_BUFLEN);
+			amount = min(amount_left_to_req, common->buflen);
 			amount = min((loff_t)amount,
 				     curlun->file_length - usb_offset);
 			partial_page = usb_offset & (PAGE_CACHE_SIZE - 1);
@@ -1059,6 +1126,9 @@ static int do_write(struct fsg_common *common)
 				nwritten -= (nwritten & 511);
 				/* Round down to a block */
 			}
+			if (curlun->nocache && nwritten > 0)
+				fsg_lun_start_writeback(curlun, file_offset,
+							nwritten);
 			file_offset += nwritten;
 			amount_left_to_write -= nwritten;
 			common->residue -= nwritten;
@@ -1087,12 +1157,13 @@ write_error:
 				 * yet from the host. So there is no point in
 				 * csw right away without the complete data.
 				 */
-				for (i = 0; i < FSG_NUM_BUFFERS; i++) {
+				for (i = 0; i < common->num_buffers; i++) {
 					if (common->buffhds[i].state ==
 							BUF_STATE_BUSY)
 						break;
 				}
-				if (!amount_left_to_req && i == FSG_NUM_BUFFERS) {
+				if (!amount_left_to_req &&
+				    i == common->num_buffers) {
 					csw_hack_sent = 1;
 					send_status(common);
 				}
@@ -1201,7 +1272,7 @@ static int do_verify(struct fsg_common *common)
 		 * If this means reading 0 then we were asked to read
 		 * past the end of file.
 		 */
-		amount = min(amount_left, FSG_BUFLEN);
+		amount = min(amount_left, common->buflen);
 		amount = min((loff_t)amount,
 			     curlun->file_length - file_offset);
 		if (amount == 0) {
@@ -1657,7 +1728,7 @@ static int pad_with_zeros(struct fsg_dev *fsg)
 				return rc;
 		}
 
-		nsend = min(fsg->common->usb_amount_left, FSG_BUFLEN);
+		nsend = min(fsg->common->usb_amount_left, fsg->common->buflen);
 		memset(bh->buf + nkeep, 0, nsend - nkeep);
 		bh->inreq->length = nsend;
 		bh->inreq->zero = 0;
@@ -1700,7 +1771,7 @@ static int throw_away_data(struct fsg_common *common)
 		bh = common->next_buffhd_to_fill;
 		if (bh->state == BUF_STATE_EMPTY
 		 && common->usb_amount_left > 0) {
-			amount = min(common->usb_amount_left, FSG_BUFLEN);
+			amount = min(common->usb_amount_left, common->buflen);
 
 			/*
 			 * amount is always divisible by 512, hence by
@@ -2456,7 +2527,7 @@ reset:
 	if (common->fsg) {
 		fsg = common->fsg;
 
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < common->num_buffers; ++i) {
 			struct fsg_buffhd *bh = &common->buffhds[i];
 
 			if (bh->inreq) {
@@ -2483,7 +2554,7 @@ reset:
 
 
 	/* Allocate the requests */
-	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+	for (i = 0; i < common->num_buffers; ++i) {
 		struct fsg_buffhd	*bh = &common->buffhds[i];
 
 		rc = alloc_request(common, fsg->bulk_in, &bh->inreq);
@@ -2590,7 +2661,7 @@ static void handle_exception(struct fsg_common *common)
 
 	/* Cancel all the pending transfers */
 	if (likely(common->fsg)) {
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < common->num_buffers; ++i) {
 			bh = &common->buffhds[i];
 			if (bh->inreq_busy)
 				usb_ep_dequeue(common->fsg->bulk_in, bh->inreq);
@@ -2602,7 +2673,7 @@ static void handle_exception(struct fsg_common *common)
 		/* Wait until everything is idle */
 		for (;;) {
 			int num_active = 0;
-			for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+			for (i = 0; i < common->num_buffers; ++i) {
 				bh = &common->buffhds[i];
 				num_active += bh->inreq_busy + bh->outreq_busy;
 			}
@@ -2625,7 +2696,7 @@ static void handle_exception(struct fsg_common *common)
 	 */
 	spin_lock_irq(&common->lock);
 
-	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+	for (i = 0; i < common->num_buffers; ++i) {
 		bh = &common->buffhds[i];
 		bh->state = BUF_STATE_EMPTY;
 	}
@@ -2808,9 +2879,37 @@ static int fsg_main_thread(void *common_)
 
 /*************************** DEVICE ATTRIBUTES ***************************/
 
+static ssize_t fsg_show_nocache(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct fsg_lun	*curlun = fsg_lun_from_dev(dev);
+
+	return sprintf(buf, "%u\n", curlun->nocache);
+}
+
+static ssize_t fsg_store_nocache(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct fsg_lun	*curlun = fsg_lun_from_dev(dev);
+	struct rw_semaphore	*filesem = dev_get_drvdata(dev);
+	unsigned long	nocache;
+
+	if (strict_strtoul(buf, 2, &nocache))
+		return -EINVAL;
+
+	down_write(filesem);
+	curlun->nocache = nocache;
+	curlun->wb_start = curlun->wb_end = 0;
+	up_write(filesem);
+
+	return count;
+}
+
 /* Write permission is checked per LUN in store_*() functions. */
 static DEVICE_ATTR(ro, 0644, fsg_show_ro, fsg_store_ro);
 static DEVICE_ATTR(nofua, 0644, fsg_show_nofua, fsg_store_nofua);
+static DEVICE_ATTR(nocache, 0644, fsg_show_nocache, fsg_store_nocache);
 static DEVICE_ATTR(file, 0644, fsg_show_file, fsg_store_file);
 
 
@@ -2896,6 +2995,7 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 		curlun->ro = lcfg->cdrom || lcfg->ro;
 		curlun->removable = lcfg->removable;
 		curlun->nofua = lcfg->nofua;
+		curlun->nocache = lcfg->nocache;
 		curlun->dev.release = fsg_lun_release;
 
 #ifdef CONFIG_USB_ANDROID_MASS_STORAGE
@@ -2927,6 +3027,9 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 		if (rc)
 			goto error_luns;
 		rc = device_create_file(&curlun->dev, &dev_attr_nofua);
+		if (rc)
+			goto error_luns;
+		rc = device_create_file(&curlun->dev, &dev_attr_nocache);
 		if (rc)
 			goto error_luns;
 
@@ -2943,14 +3046,30 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 	common->nluns = nluns;
 
 	/* Data buffers cyclic list */
+	common->num_buffers = clamp_t(unsigned, fsg_num_buffers, 2,
+				      FSG_MAX_NUM_BUFFERS);
+	common->buflen = clamp_t(u32, fsg_buflen & PAGE_MASK, PAGE_SIZE,
+				 FSG_MAX_BUFLEN);
+	if (common->num_buffers != fsg_num_buffers ||
+	    common->buflen != fsg_buflen)
+		WARNING(common, "using %u buffers of %u bytes\n",
+			common->num_buffers, common->buflen);
+
+	common->buffhds = kcalloc(common->num_buffers,
+				  sizeof *common->buffhds, GFP_KERNEL);
+	if (unlikely(!common->buffhds)) {
+		rc = -ENOMEM;
+		goto error_release;
+	}
+
 	bh = common->buffhds;
-	i = FSG_NUM_BUFFERS;
+	i = common->num_buffers;
 	goto buffhds_first_it;
 	do {
 		bh->next = bh + 1;
 		++bh;
 buffhds_first_it:
-		bh->buf = kmalloc(FSG_BUFLEN, GFP_KERNEL);
+		bh->buf = kmalloc(common->buflen, GFP_KERNEL);
 		if (unlikely(!bh->buf)) {
 			rc = -ENOMEM;
 			goto error_release;
@@ -3059,6 +3178,7 @@ static void fsg_common_release(struct kref *ref)
 		/* In error recovery common->nluns may be zero. */
 		for (; i; --i, ++lun) {
 			device_remove_file(&lun->dev, &dev_attr_nofua);
+			device_remove_file(&lun->dev, &dev_attr_nocache);
 			device_remove_file(&lun->dev, &dev_attr_ro);
 			device_remove_file(&lun->dev, &dev_attr_file);
 			fsg_lun_close(lun);
@@ -3068,12 +3188,14 @@ static void fsg_common_release(struct kref *ref)
 		kfree(common->luns);
 	}
 
-	{
+	if (likely(common->buffhds)) {
 		struct fsg_buffhd *bh = common->buffhds;
-		unsigned i = FSG_NUM_BUFFERS;
+		unsigned i = common->num_buffers;
 		do {
 			kfree(bh->buf);
 		} while (++bh, --i);
+
+		kfree(common->buffhds);
 	}
 
 	if (common->free_storage_on_release)
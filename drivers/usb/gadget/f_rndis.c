@@ -103,6 +103,19 @@ static inline struct f_rndis *func_to_rndis(struct usb_function *f)
 	return container_of(f, struct f_rndis, port.func);
 }
 
+/* RNDIS lets a transfer carry several packet messages; the host's own
+ * transfer size limit applies on top of rndis_dl_max_pkt_per_xfer
+ */
+static unsigned int rndis_dl_max_pkt_per_xfer = 3;
+module_param(rndis_dl_max_pkt_per_xfer, uint, S_IRUGO);
+MODULE_PARM_DESC(rndis_dl_max_pkt_per_xfer,
+	"packets per transfer to the host");
+
+static unsigned int rndis_ul_max_pkt_per_xfer = 1;
+module_param(rndis_ul_max_pkt_per_xfer, uint, S_IRUGO);
+MODULE_PARM_DESC(rndis_ul_max_pkt_per_xfer,
+	"packets per transfer the host may send");
+
 /* peak (theoretical) bulk transfer rate in bits-per-second */
 static unsigned int bitrate(struct usb_gadget *g)
 {
@@ -330,14 +343,14 @@ static struct usb_ether_platform_data *rndis_pdata;
 static struct sk_buff *rndis_add_header(struct gether *port,
 					struct sk_buff *skb)
 {
-	struct sk_buff *skb2;
-
-	skb2 = skb_realloc_headroom(skb, sizeof(struct rndis_packet_msg_type));
-	if (skb2)
-		rndis_add_hdr(skb2);
+	/* the stack normally leaves enough headroom; copy only if not */
+	if (skb_cow_head(skb, sizeof(struct rndis_packet_msg_type))) {
+		dev_kfree_skb_any(skb);
+		return NULL;
+	}
 
-	dev_kfree_skb_any(skb);
-	return skb2;
+	rndis_add_hdr(skb);
+	return skb;
 }
 
 static void rndis_response_available(void *_rndis)
@@ -734,6 +747,8 @@ rndis_bind(struct usb_configuration *c, struct usb_function *f)
 
 	rndis_set_param_medium(rndis->config, NDIS_MEDIUM_802_3, 0);
 	rndis_set_host_mac(rndis->config, rndis->ethaddr);
+	rndis_set_param_xfer(rndis->config, rndis->port.ul_max_pkts_per_xfer,
+			&rndis->port.dl_max_xfer_size);
 
 #ifdef CONFIG_USB_ANDROID_RNDIS
 	if (rndis_pdata) {
@@ -869,6 +884,8 @@ rndis_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN])
 	rndis->port.header_len = sizeof(struct rndis_packet_msg_type);
 	rndis->port.wrap = rndis_add_header;
 	rndis->port.unwrap = rndis_rm_hdr;
+	rndis->port.dl_max_pkts_per_xfer = rndis_dl_max_pkt_per_xfer;
+	rndis->port.ul_max_pkts_per_xfer = rndis_ul_max_pkt_per_xfer;
 
 	rndis->port.func.name = "rndis";
 	rndis->port.func.strings = rndis_strings;
@@ -32,6 +32,7 @@
 #include <linux/workqueue.h>
 #include <linux/switch.h>
 #include <linux/pm_runtime.h>
+#include <linux/log2.h>
 
 #include <mach/msm72k_otg.h>
 #include <linux/io.h>
@@ -60,6 +61,13 @@ static const char driver_name[] = "msm72k_udc";
 
 #define SETUP_BUF_SIZE     8
 
+/* A dTD covers five pages, so 16K always fits whatever the offset of
+ * its buffer.  Longer requests and scatterlists are split over a chain
+ * of dTDs, allocated as the request first needs them.
+ */
+#define TD_MAX_BYTES       0x4000
+#define REQ_MAX_TDS        32
+
 
 static const char *const ep_name[] = {
 	"ep0out", "ep1out", "ep2out", "ep3out",
@@ -75,6 +83,20 @@ static const char *const ep_name[] = {
 /*To release the wakelock from debugfs*/
 static int release_wlocks;
 
+/* link requests queued behind live ones straight into the hardware
+ * queue (ATDTW tripwire) instead of waiting for the completion irq
+ */
+static int hw_append = 1;
+module_param(hw_append, bool, 0644);
+MODULE_PARM_DESC(hw_append, "append to running endpoint queues");
+
+/* interrupt threshold, in microframes: completions that land within
+ * this window are reported with a single interrupt
+ */
+static unsigned itc;
+module_param(itc, uint, 0644);
+MODULE_PARM_DESC(itc, "interrupt threshold (0, 1, 2, 4, 8, 16, 32, 64)");
+
 struct msm_request {
 	struct usb_request req;
 
@@ -95,8 +117,27 @@ struct msm_request {
 	dma_addr_t item_dma;
 
 	struct ept_queue_item *item;
+
+	/* dTDs after the first one, for requests longer than TD_MAX_BYTES */
+	struct ept_queue_item *xitem[REQ_MAX_TDS - 1];
+	dma_addr_t xitem_dma[REQ_MAX_TDS - 1];
+	unsigned nr_items;	/* dTDs allocated, including item */
+	unsigned nr_tds;	/* dTDs used by the queued transfer */
 };
 
+static inline struct ept_queue_item *req_td(struct msm_request *req,
+					     unsigned n)
+{
+	return n ? req->xitem[n - 1] : req->item;
+}
+
+static inline dma_addr_t req_td_dma(struct msm_request *req, unsigned n)
+{
+	return n ? req->xitem_dma[n - 1] : req->item_dma;
+}
+
+#define req_last_td(req) req_td(req, (req)->nr_tds - 1)
+
 #define to_msm_request(r) container_of(r, struct msm_request, req)
 #define to_msm_endpoint(r) container_of(r, struct msm_endpoint, ep)
 #define to_msm_otg(xceiv)  container_of(xceiv, struct msm_otg, otg)
@@ -223,6 +264,7 @@ static int msm72k_wakeup(struct usb_gadget *_gadget);
 static int msm72k_pullup_internal(struct usb_gadget *_gadget, int is_active);
 static int msm72k_set_halt(struct usb_ep *_ep, int value);
 static void flush_endpoint(struct msm_endpoint *ept);
+static void flush_endpoint_hw(struct usb_info *ui, unsigned bits);
 static void usb_reset(struct usb_info *ui);
 static int usb_ept_set_halt(struct usb_ep *_ep, int value);
 
@@ -516,6 +558,8 @@ struct usb_request *usb_ept_alloc_req(struct msm_endpoint *ept,
 	req->item = dma_pool_alloc(ui->pool, gfp_flags, &req->item_dma);
 	if (!req->item)
 		goto fail2;
+	req->nr_items = 1;
+	req->nr_tds = 1;
 
 	if (bufsize) {
 		req->req.buf = kmalloc(bufsize, gfp_flags);
@@ -569,6 +613,160 @@ static void usb_ept_enable(struct msm_endpoint *ept, int yes,
 	       ept->num, in ? "in" : "out", yes ? "enabled" : "disabled");
 }
 
+/* Number of dTDs the request needs, or -EINVAL for a scatterlist the
+ * hardware can't take: each dTD starts a new packet, so every entry but
+ * the last has to end on a packet boundary.
+ */
+static int usb_req_count_tds(struct msm_endpoint *ept,
+			     struct msm_request *req)
+{
+	struct scatterlist *sg;
+	unsigned i;
+	int n = 0;
+
+	if (!req->req.num_sgs)
+		return max_t(int, DIV_ROUND_UP(req->req.length,
+					       TD_MAX_BYTES), 1);
+
+	if (ept->num == 0)
+		return -EINVAL;
+
+	for_each_sg(req->req.sg, sg, req->req.num_sgs, i) {
+		if (!sg->length)
+			return -EINVAL;
+		if (i != req->req.num_sgs - 1 &&
+		    sg->length % ept->ep.maxpacket)
+			return -EINVAL;
+		n += DIV_ROUND_UP(sg->length, TD_MAX_BYTES);
+	}
+	return n;
+}
+
+static int usb_req_alloc_tds(struct usb_info *ui, struct msm_request *req,
+			     unsigned count)
+{
+	unsigned n;
+
+	while (req->nr_items < count) {
+		n = req->nr_items - 1;
+		req->xitem[n] = dma_pool_alloc(ui->pool, GFP_ATOMIC,
+					       &req->xitem_dma[n]);
+		if (!req->xitem[n])
+			return -ENOMEM;
+		req->nr_items++;
+	}
+	return 0;
+}
+
+static void usb_req_free_tds(struct usb_info *ui, struct msm_request *req)
+{
+	unsigned n;
+
+	while (req->nr_items > 1) {
+		n = --req->nr_items - 1;
+		dma_pool_free(ui->pool, req->xitem[n], req->xitem_dma[n]);
+	}
+}
+
+static void usb_req_unmap(struct msm_endpoint *ept, struct msm_request *req)
+{
+	enum dma_data_direction dir = (ept->flags & EPT_FLAG_IN) ?
+				      DMA_TO_DEVICE : DMA_FROM_DEVICE;
+
+	if (req->req.num_mapped_sgs) {
+		dma_unmap_sg(NULL, req->req.sg, req->req.num_sgs, dir);
+		req->req.num_mapped_sgs = 0;
+	} else
+		dma_unmap_single(NULL, req->dma, req->req.length, dir);
+}
+
+/* fill dTDs from n on to cover len bytes at dma, returns the next one */
+static unsigned usb_req_fill_tds(struct msm_endpoint *ept,
+				 struct msm_request *req, unsigned n,
+				 dma_addr_t dma, unsigned len)
+{
+	struct ept_queue_item *item;
+	unsigned chunk;
+	/* a short packet may retire an OUT transfer before its last dTD,
+	 * so have each of them interrupt to be sure that is noticed
+	 */
+	unsigned ioc = (ept->flags & EPT_FLAG_IN) ? 0 : INFO_IOC;
+
+	do {
+		chunk = min_t(unsigned, len, TD_MAX_BYTES);
+		item = req_td(req, n);
+		item->info = INFO_BYTES(chunk) | ioc | INFO_ACTIVE;
+		item->page0 = dma;
+		item->page1 = (dma + 0x1000) & 0xfffff000;
+		item->page2 = (dma + 0x2000) & 0xfffff000;
+		item->page3 = (dma + 0x3000) & 0xfffff000;
+		item->page4 = (dma + 0x4000) & 0xfffff000;
+		if (n)
+			req_td(req, n - 1)->next = req_td_dma(req, n);
+		n++;
+		dma += chunk;
+		len -= chunk;
+	} while (len);
+
+	return n;
+}
+
+/* prepare the transaction descriptor items for the hardware */
+static void usb_req_prep_tds(struct msm_endpoint *ept,
+			     struct msm_request *req)
+{
+	struct scatterlist *sg;
+	unsigned i, n = 0;
+
+	if (req->req.num_mapped_sgs) {
+		for_each_sg(req->req.sg, sg, req->req.num_mapped_sgs, i)
+			n = usb_req_fill_tds(ept, req, n, sg_dma_address(sg),
+					     sg_dma_len(sg));
+	} else
+		n = usb_req_fill_tds(ept, req, 0, req->dma, req->req.length);
+
+	req->nr_tds = n;
+	req_last_td(req)->info |= INFO_IOC;
+	req_last_td(req)->next = TERMINATE;
+}
+
+/* Has the hardware finished with the request?  Collects the status bits
+ * and the count of bytes not transferred over its dTDs.  An OUT transfer
+ * ends at a short packet, possibly ahead of its last dTD; that is
+ * reported through *early, as the controller will carry on into the
+ * dTDs left behind.
+ */
+static int usb_req_retired(struct msm_endpoint *ept, struct msm_request *req,
+			   unsigned *info, unsigned *residue, int *early)
+{
+	unsigned n, td_info, left;
+
+	*info = 0;
+	*residue = 0;
+	*early = 0;
+
+	for (n = 0; n < req->nr_tds; n++) {
+		td_info = req_td(req, n)->info;
+		/* if the transaction is still in-flight, stop here */
+		if (td_info & INFO_ACTIVE)
+			return 0;
+
+		left = (td_info >> 16) & 0x7FFF;
+		*info |= td_info;
+		*residue += left;
+		if (left && !(ept->flags & EPT_FLAG_IN) &&
+		    n != req->nr_tds - 1) {
+			*early = 1;
+			break;
+		}
+	}
+
+	while (++n < req->nr_tds)
+		*residue += (req_td(req, n)->info >> 16) & 0x7FFF;
+
+	return 1;
+}
+
 static void usb_ept_start(struct msm_endpoint *ept)
 {
 	struct usb_info *ui = ept->ui;
@@ -582,19 +780,11 @@ static void usb_ept_start(struct msm_endpoint *ept)
 
 	while (req) {
 		req->live = 1;
-		/* prepare the transaction descriptor item for the hardware */
-		req->item->info =
-			INFO_BYTES(req->req.length) | INFO_IOC | INFO_ACTIVE;
-		req->item->page0 = req->dma;
-		req->item->page1 = (req->dma + 0x1000) & 0xfffff000;
-		req->item->page2 = (req->dma + 0x2000) & 0xfffff000;
-		req->item->page3 = (req->dma + 0x3000) & 0xfffff000;
-
-		if (req->next == NULL) {
-			req->item->next = TERMINATE;
+		usb_req_prep_tds(ept, req);
+
+		if (req->next == NULL)
 			break;
-		}
-		req->item->next = req->next->item_dma;
+		req_last_td(req)->next = req->next->item_dma;
 		req = req->next;
 	}
 
@@ -636,6 +826,46 @@ reprime_ept:
 	}
 }
 
+/* Link a request onto the end of a queue the controller is still working
+ * through.  The add-dTD tripwire tells whether the endpoint was still
+ * primed once the new link was in place; if it was not, and the new dTDs
+ * were never picked up, the request is left for handle_endpoint() to
+ * start once the requests ahead of it complete.
+ */
+static void usb_ept_append(struct msm_endpoint *ept, struct msm_request *last,
+			   struct msm_request *req)
+{
+	struct usb_info *ui = ept->ui;
+	unsigned n = 1 << ept->bit;
+	unsigned stat;
+
+	usb_req_prep_tds(ept, req);
+	req_last_td(last)->next = req->item_dma;
+	/* the new link must be visible before the endpoint is examined */
+	mb();
+
+	if (readl_relaxed(USB_ENDPTPRIME) & n)
+		goto live;
+
+	do {
+		writel_relaxed(readl_relaxed(USB_USBCMD) | USBCMD_ATDTW,
+			       USB_USBCMD);
+		stat = readl_relaxed(USB_ENDPTSTAT) & n;
+	} while (!(readl_relaxed(USB_USBCMD) & USBCMD_ATDTW));
+	writel_relaxed(readl_relaxed(USB_USBCMD) & ~USBCMD_ATDTW, USB_USBCMD);
+
+	if (stat)
+		goto live;
+
+	dma_coherent_post_ops();
+	if (req->item->info & INFO_ACTIVE) {
+		req_last_td(last)->next = TERMINATE;
+		return;
+	}
+live:
+	req->live = 1;
+}
+
 int usb_ept_queue_xfer(struct msm_endpoint *ept, struct usb_request *_req)
 {
 	unsigned long flags;
@@ -643,8 +873,13 @@ int usb_ept_queue_xfer(struct msm_endpoint *ept, struct usb_request *_req)
 	struct msm_request *last;
 	struct usb_info *ui = ept->ui;
 	unsigned length = req->req.length;
+	enum dma_data_direction dir;
+	int tds;
 
-	if (length > 0x4000)
+	tds = usb_req_count_tds(ept, req);
+	if (tds < 0)
+		return tds;
+	if (tds > REQ_MAX_TDS)
 		return -EMSGSIZE;
 
 	spin_lock_irqsave(&ui->lock, flags);
@@ -684,26 +919,37 @@ int usb_ept_queue_xfer(struct msm_endpoint *ept, struct usb_request *_req)
 		schedule_delayed_work(&ui->rw_work, REMOTE_WAKEUP_DELAY);
 	}
 
+	if (usb_req_alloc_tds(ui, req, tds)) {
+		spin_unlock_irqrestore(&ui->lock, flags);
+		return -ENOMEM;
+	}
+
 	req->busy = 1;
 	req->live = 0;
 	req->next = 0;
 	req->req.status = -EBUSY;
 
-	req->dma = dma_map_single(NULL, req->req.buf, length,
-				  (ept->flags & EPT_FLAG_IN) ?
-				  DMA_TO_DEVICE : DMA_FROM_DEVICE);
-
+	dir = (ept->flags & EPT_FLAG_IN) ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
+	if (req->req.num_sgs)
+		req->req.num_mapped_sgs = dma_map_sg(NULL, req->req.sg,
+						     req->req.num_sgs, dir);
+	else {
+		req->req.num_mapped_sgs = 0;
+		req->dma = dma_map_single(NULL, req->req.buf, length, dir);
+	}
 
 	/* Add the new request to the end of the queue */
 	last = ept->last;
 	if (last) {
 		/* Already requests in the queue. add us to the
-		 * end, but let the completion interrupt actually
-		 * start things going, to avoid hw issues
+		 * end; unless the hardware can take us on the fly,
+		 * let the completion interrupt actually start
+		 * things going, to avoid hw issues
 		 */
 		last->next = req;
 		req->prev = last;
-
+		if (hw_append && ept->num && last->live)
+			usb_ept_append(ept, last, req);
 	} else {
 		/* queue was empty -- kick the hardware */
 		ept->req = req;
@@ -1069,9 +1315,10 @@ ack:
 static void handle_endpoint(struct usb_info *ui, unsigned bit)
 {
 	struct msm_endpoint *ept = ui->ept + bit;
-	struct msm_request *req;
+	struct msm_request *req, *next;
 	unsigned long flags;
-	unsigned info;
+	unsigned info, residue;
+	int early;
 
 	/*
 	INFO("handle_endpoint() %d %s req=%p(%08x)\n",
@@ -1090,11 +1337,9 @@ static void handle_endpoint(struct usb_info *ui, unsigned bit)
 			break;
 		}
 
-		/* clean speculative fetches on req->item->info */
+		/* clean speculative fetches on the dTD infos */
 		dma_coherent_post_ops();
-		info = req->item->info;
-		/* if the transaction is still in-flight, stop here */
-		if (info & INFO_ACTIVE)
+		if (!usb_req_retired(ept, req, &info, &residue, &early))
 			break;
 
 		/* advance ept queue to the next request */
@@ -1102,9 +1347,17 @@ static void handle_endpoint(struct usb_info *ui, unsigned bit)
 		if (ept->req == 0)
 			ept->last = 0;
 
-		dma_unmap_single(NULL, req->dma, req->req.length,
-				 (ept->flags & EPT_FLAG_IN) ?
-				 DMA_TO_DEVICE : DMA_FROM_DEVICE);
+		if (early) {
+			/* keep the controller out of the dTDs the short
+			 * packet left behind, and restart the queue from
+			 * the next request
+			 */
+			flush_endpoint_hw(ui, 1 << ept->bit);
+			for (next = ept->req; next; next = next->next)
+				next->live = 0;
+		}
+
+		usb_req_unmap(ept, req);
 
 		if (info & (INFO_HALTED | INFO_BUFFER_ERROR | INFO_TXN_ERROR)) {
 			/* XXX pass on more specific error code */
@@ -1117,8 +1370,7 @@ static void handle_endpoint(struct usb_info *ui, unsigned bit)
 			       info);
 		} else {
 			req->req.status = 0;
-			req->req.actual =
-				req->req.length - ((info >> 16) & 0x7FFF);
+			req->req.actual = req->req.length - residue;
 		}
 		req->busy = 0;
 		req->live = 0;
@@ -1171,6 +1423,7 @@ static void flush_endpoint_sw(struct msm_endpoint *ept)
 		req->live = 0;
 		req->req.status = -ESHUTDOWN;
 		req->req.actual = 0;
+		usb_req_unmap(ept, req);
 
 		/* Gadget driver may free the request in completion
 		 * handler. So keep a copy of next req pointer
@@ -1348,6 +1601,7 @@ static void usb_prepare(struct usb_info *ui)
 static void usb_reset(struct usb_info *ui)
 {
 	struct msm_otg *otg = to_msm_otg(ui->xceiv);
+	unsigned n;
 
 	dev_dbg(&ui->pdev->dev, "reset controller\n");
 
@@ -1362,8 +1616,11 @@ static void usb_reset(struct usb_info *ui)
 	else
 		otg->reset(ui->xceiv, 1);
 
-	/* set usb controller interrupt threshold to zero*/
-	writel((readl(USB_USBCMD) & ~USBCMD_ITC_MASK) | USBCMD_ITC(0),
+	/* set usb controller interrupt threshold; the hardware takes
+	 * zero or a power of two up to 64 microframes
+	 */
+	n = itc ? rounddown_pow_of_two(min(itc, 64U)) : 0;
+	writel((readl(USB_USBCMD) & ~USBCMD_ITC_MASK) | USBCMD_ITC(n),
 							USB_USBCMD);
 
 	writel(ui->dma, USB_ENDPOINTLISTADDR);
@@ -1740,9 +1997,9 @@ static ssize_t debug_read_status(struct file *file, char __user *ubuf,
 
 		for (req = ept->req; req; req = req->next)
 			i += scnprintf(buf + i, PAGE_SIZE - i,
-			"  req @%08x next=%08x info=%08x page0=%08x %c %c\n",
-				req->item_dma, req->item->next,
-				req->item->info, req->item->page0,
+			"  req @%08x next=%08x info=%08x page0=%08x tds=%u %c %c\n",
+				req->item_dma, req_last_td(req)->next,
+				req->item->info, req->item->page0, req->nr_tds,
 				req->busy ? 'B' : ' ',
 				req->live ? 'L' : ' ');
 	}
@@ -1900,6 +2157,7 @@ msm72k_free_request(struct usb_ep *_ep, struct usb_request *_req)
 	BUG_ON(req->busy);
 	if (req->alloced)
 		kfree(req->req.buf);
+	usb_req_free_tds(ui, req);
 	dma_pool_free(ui->pool, req->item, req->item_dma);
 	kfree(req);
 }
@@ -1936,6 +2194,7 @@ static int msm72k_dequeue(struct usb_ep *_ep, struct usb_request *_req)
 
 	struct msm_request *temp_req;
 	unsigned long flags;
+	unsigned n;
 
 	if (!(ui && req && ep->req))
 		return -EINVAL;
@@ -1958,24 +2217,24 @@ static int msm72k_dequeue(struct usb_ep *_ep, struct usb_request *_req)
 
 	if (ep->req == req) {
 		ep->req = req->next;
-		ep->head->next = req->item->next;
+		ep->head->next = req_last_td(req)->next;
 	} else {
 		req->prev->next = req->next;
 		if (req->next)
 			req->next->prev = req->prev;
-		req->prev->item->next = req->item->next;
+		req_last_td(req->prev)->next = req_last_td(req)->next;
 	}
 
 	if (!req->next)
 		ep->last = req->prev;
 
 	/* initialize request to default */
-	req->item->next = TERMINATE;
-	req->item->info = 0;
+	for (n = 0; n < req->nr_tds; n++) {
+		req_td(req, n)->next = TERMINATE;
+		req_td(req, n)->info = 0;
+	}
 	req->live = 0;
-	dma_unmap_single(NULL, req->dma, req->req.length,
-		(ep->flags & EPT_FLAG_IN) ?
-		DMA_TO_DEVICE : DMA_FROM_DEVICE);
+	usb_req_unmap(ep, req);
 
 	if (req->req.complete) {
 		req->req.status = -ECONNRESET;
@@ -2423,6 +2682,7 @@ static int msm72k_probe(struct platform_device *pdev)
 
 	ui->gadget.ops = &msm72k_ops;
 	ui->gadget.is_dualspeed = 1;
+	ui->gadget.sg_supported = 1;
 	device_initialize(&ui->gadget.dev);
 	dev_set_name(&ui->gadget.dev, "gadget");
 	ui->gadget.dev.parent = &pdev->dev;
@@ -597,6 +597,10 @@ static int rndis_init_response(int configNr, rndis_init_msg_type *buf)
 		return -ENOMEM;
 	resp = (rndis_init_cmplt_type *)r->buf;
 
+	/* what the host takes in one transfer bounds tx aggregation */
+	if (params->dl_max_xfer_size)
+		*params->dl_max_xfer_size = le32_to_cpu(buf->MaxTransferSize);
+
 	resp->MessageType = cpu_to_le32(REMOTE_NDIS_INITIALIZE_CMPLT);
 	resp->MessageLength = cpu_to_le32(52);
 	resp->RequestID = buf->RequestID; /* Still LE in msg buffer */
@@ -605,12 +609,12 @@ static int rndis_init_response(int configNr, rndis_init_msg_type *buf)
 	resp->MinorVersion = cpu_to_le32(RNDIS_MINOR_VERSION);
 	resp->DeviceFlags = cpu_to_le32(RNDIS_DF_CONNECTIONLESS);
 	resp->Medium = cpu_to_le32(RNDIS_MEDIUM_802_3);
-	resp->MaxPacketsPerTransfer = cpu_to_le32(1);
-	resp->MaxTransferSize = cpu_to_le32(
+	resp->MaxPacketsPerTransfer = cpu_to_le32(params->max_pkt_per_xfer);
+	resp->MaxTransferSize = cpu_to_le32(params->max_pkt_per_xfer * (
 		  params->dev->mtu
 		+ sizeof(struct ethhdr)
 		+ sizeof(struct rndis_packet_msg_type)
-		+ 22);
+		+ 22));
 	resp->PacketAlignmentFactor = cpu_to_le32(0);
 	resp->AFListOffset = cpu_to_le32(0);
 	resp->AFListSize = cpu_to_le32(0);
@@ -975,6 +979,19 @@ int rndis_set_param_medium(u8 configNr, u32 medium, u32 speed)
 	return 0;
 }
 
+int rndis_set_param_xfer(u8 configNr, u32 max_pkt_per_xfer,
+			 u32 *dl_max_xfer_size)
+{
+	pr_debug("%s: %u\n", __func__, max_pkt_per_xfer);
+	if (configNr >= RNDIS_MAX_CONFIGS) return -1;
+
+	rndis_per_dev_params[configNr].max_pkt_per_xfer =
+		max_t(u32, max_pkt_per_xfer, 1);
+	rndis_per_dev_params[configNr].dl_max_xfer_size = dl_max_xfer_size;
+
+	return 0;
+}
+
 void rndis_add_hdr(struct sk_buff *skb)
 {
 	struct rndis_packet_msg_type *header;
@@ -1043,30 +1060,71 @@ static rndis_resp_t *rndis_add_response(int configNr, u32 length)
 	return r;
 }
 
+/*
+ * A transfer from the host may carry up to max_pkt_per_xfer packet
+ * messages back to back.  All but the last become clones of the
+ * transfer's skb, trimmed to their data, so nothing is copied.
+ */
 int rndis_rm_hdr(struct gether *port,
 			struct sk_buff *skb,
 			struct sk_buff_head *list)
 {
-	/* tmp points to a struct rndis_packet_msg_type */
-	__le32 *tmp = (void *)skb->data;
+	struct rndis_packet_msg_type *hdr;
+	struct sk_buff *skb2;
+	u32 msg_len, data_offset, data_len;
+	int queued = 0;
+
+	while (skb->len >= sizeof(*hdr)) {
+		hdr = (void *)skb->data;
+
+		/* anything after a message that isn't one is padding */
+		if (cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
+				!= get_unaligned(&hdr->MessageType)) {
+			dev_kfree_skb_any(skb);
+			return queued ? 0 : -EINVAL;
+		}
 
-	/* MessageType, MessageLength */
-	if (cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
-			!= get_unaligned(tmp++)) {
-		dev_kfree_skb_any(skb);
-		return -EINVAL;
-	}
-	tmp++;
+		msg_len = get_unaligned_le32(&hdr->MessageLength);
+		data_offset = get_unaligned_le32(&hdr->DataOffset);
+		data_len = get_unaligned_le32(&hdr->DataLength);
+
+		/* DataOffset counts from the DataOffset field */
+		if (data_offset + 8 > skb->len
+				|| data_len > skb->len - data_offset - 8) {
+			dev_kfree_skb_any(skb);
+			return -EOVERFLOW;
+		}
+
+		/* the last message keeps the skb, whatever padding follows */
+		if (msg_len < sizeof(*hdr) || msg_len >= skb->len
+				|| skb->len - msg_len < sizeof(*hdr)) {
+			skb_pull(skb, data_offset + 8);
+			skb_trim(skb, data_len);
+			skb_queue_tail(list, skb);
+			return 0;
+		}
 
-	/* DataOffset, DataLength */
-	if (!skb_pull(skb, get_unaligned_le32(tmp++) + 8)) {
-		dev_kfree_skb_any(skb);
-		return -EOVERFLOW;
+		/* the data must not run into the next message */
+		if (data_offset + 8 + data_len > msg_len) {
+			dev_kfree_skb_any(skb);
+			return -EOVERFLOW;
+		}
+
+		skb2 = skb_clone(skb, GFP_ATOMIC);
+		if (!skb2) {
+			dev_kfree_skb_any(skb);
+			return -ENOMEM;
+		}
+		skb_pull(skb2, data_offset + 8);
+		skb_trim(skb2, data_len);
+		skb_queue_tail(list, skb2);
+		queued = 1;
+
+		skb_pull(skb, msg_len);
 	}
-	skb_trim(skb, get_unaligned_le32(tmp++));
 
-	skb_queue_tail(list, skb);
-	return 0;
+	dev_kfree_skb_any(skb);
+	return -EINVAL;
 }
 
 #ifdef CONFIG_USB_GADGET_DEBUG_FILES
@@ -1192,6 +1250,7 @@ int rndis_init(void)
 		rndis_per_dev_params[i].confignr = i;
 		rndis_per_dev_params[i].used = 0;
 		rndis_per_dev_params[i].state = RNDIS_UNINITIALIZED;
+		rndis_per_dev_params[i].max_pkt_per_xfer = 1;
 		rndis_per_dev_params[i].media_state
 				= NDIS_MEDIA_STATE_DISCONNECTED;
 		INIT_LIST_HEAD(&(rndis_per_dev_params[i].resp_queue));
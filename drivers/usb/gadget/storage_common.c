@@ -242,6 +242,11 @@ struct fsg_lun {
 	unsigned int	registered:1;
 	unsigned int	info_valid:1;
 	unsigned int	nofua:1;
+	unsigned int	nocache:1;
+
+	/* Range last handed to writeback while nocache is set */
+	loff_t		wb_start;
+	loff_t		wb_end;
 
 	u32		sense_data;
 	u32		sense_data_info;
@@ -268,10 +273,12 @@ static struct fsg_lun *fsg_lun_from_dev(struct device *dev)
 #else
 #define FSG_NUM_BUFFERS    2
 #endif
+#define FSG_MAX_NUM_BUFFERS	32
 
 
 /* Default size of buffer length. */
 #define FSG_BUFLEN	((u32)16384)
+#define FSG_MAX_BUFLEN	((u32)131072)
 
 /* Maximal number of LUNs supported in mass storage function */
 #define FSG_MAX_LUNS	8
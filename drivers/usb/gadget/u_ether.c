@@ -28,6 +28,7 @@
 #include <linux/ctype.h>
 #include <linux/etherdevice.h>
 #include <linux/ethtool.h>
+#include <linux/if_vlan.h>
 
 #include "u_ether.h"
 
@@ -55,6 +56,27 @@
 
 #define UETH__VERSION	"29-May-2008"
 
+/* how well transfers are being filled, reported through ethtool -S */
+struct eth_agg_stats {
+	unsigned long		tx_xfers;	/* transfers queued */
+	unsigned long		tx_pkts;	/* packets they carried */
+	unsigned long		tx_multi;	/* ... more than one of them */
+	unsigned long		tx_held;	/* sent by tx_complete() */
+	unsigned long		rx_xfers;
+	unsigned long		rx_pkts;
+	unsigned long		rx_multi;
+};
+
+static const char eth_agg_stat_names[][ETH_GSTRING_LEN] = {
+	"tx_xfers",
+	"tx_pkts",
+	"tx_multi_pkt_xfers",
+	"tx_held_xfers",
+	"rx_xfers",
+	"rx_pkts",
+	"rx_multi_pkt_xfers",
+};
+
 struct eth_dev {
 	/* lock is held while accessing port_usb
 	 * or updating its backlink port_usb->ioport
@@ -69,6 +91,17 @@ struct eth_dev {
 	struct list_head	tx_reqs, rx_reqs;
 	atomic_t		tx_qlen;
 
+	/* tx aggregation copies packets into buffers owned by the
+	 * requests; the one being filled may be held back (under
+	 * req_lock) while other transfers are in flight
+	 */
+	unsigned		tx_agg_pkts;	/* per transfer, 0 if off */
+	unsigned		tx_agg_bufsize;
+	struct usb_request	*tx_agg_req;
+	unsigned		tx_agg_count;	/* packets in tx_agg_req */
+
+	struct eth_agg_stats	agg_stats;
+
 	struct sk_buff_head	rx_frames;
 
 	unsigned		header_len;
@@ -186,9 +219,39 @@ static void eth_get_drvinfo(struct net_device *net, struct ethtool_drvinfo *p)
  *   - ... probably more ethtool ops
  */
 
+static int eth_get_sset_count(struct net_device *net, int sset)
+{
+	switch (sset) {
+	case ETH_SS_STATS:
+		return ARRAY_SIZE(eth_agg_stat_names);
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static void eth_get_strings(struct net_device *net, u32 sset, u8 *data)
+{
+	if (sset == ETH_SS_STATS)
+		memcpy(data, eth_agg_stat_names, sizeof(eth_agg_stat_names));
+}
+
+static void eth_get_ethtool_stats(struct net_device *net,
+				  struct ethtool_stats *stats, u64 *data)
+{
+	struct eth_dev	*dev = netdev_priv(net);
+	unsigned long	*counter = (unsigned long *)&dev->agg_stats;
+	int		i;
+
+	for (i = 0; i < ARRAY_SIZE(eth_agg_stat_names); i++)
+		data[i] = counter[i];
+}
+
 static const struct ethtool_ops ops = {
 	.get_drvinfo = eth_get_drvinfo,
 	.get_link = ethtool_op_get_link,
+	.get_sset_count = eth_get_sset_count,
+	.get_strings = eth_get_strings,
+	.get_ethtool_stats = eth_get_ethtool_stats,
 };
 
 static void defer_kevent(struct eth_dev *dev, int flag)
@@ -237,6 +300,8 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 	 */
 	size += sizeof(struct ethhdr) + dev->net->mtu + RX_EXTRA;
 	size += dev->port_usb->header_len;
+	if (dev->port_usb->ul_max_pkts_per_xfer > 1)
+		size *= dev->port_usb->ul_max_pkts_per_xfer;
 	size += out->maxpacket - 1;
 	size -= size % out->maxpacket;
 
@@ -280,6 +345,7 @@ static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 	struct sk_buff	*skb = req->context, *skb2;
 	struct eth_dev	*dev = ep->driver_data;
 	int		status = req->status;
+	unsigned	frames = 0;
 
 	switch (status) {
 
@@ -307,6 +373,7 @@ static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 
 		skb2 = skb_dequeue(&dev->rx_frames);
 		while (skb2) {
+			frames++;
 			if (status < 0
 					|| ETH_HLEN > skb2->len
 					|| skb2->len > ETH_FRAME_LEN) {
@@ -327,6 +394,11 @@ static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 next_frame:
 			skb2 = skb_dequeue(&dev->rx_frames);
 		}
+
+		dev->agg_stats.rx_xfers++;
+		dev->agg_stats.rx_pkts += frames;
+		if (frames > 1)
+			dev->agg_stats.rx_multi++;
 		break;
 
 	/* software-driven interface shutdown */
@@ -425,6 +497,44 @@ done:
 	return status;
 }
 
+/* largest frame a transfer may have to carry, framing included */
+static unsigned tx_max_frame(struct eth_dev *dev, struct gether *link)
+{
+	return dev->net->mtu + ETH_HLEN + VLAN_HLEN + link->header_len;
+}
+
+/* Give each tx request a buffer to aggregate packets in, or leave
+ * aggregation off if that much memory can't be had.
+ */
+static void alloc_tx_buffers(struct eth_dev *dev, struct gether *link)
+{
+	struct usb_request	*req;
+	unsigned		size;
+
+	size = link->dl_max_pkts_per_xfer * tx_max_frame(dev, link);
+
+	spin_lock(&dev->req_lock);
+	list_for_each_entry(req, &dev->tx_reqs, list)
+		req->buf = NULL;
+	list_for_each_entry(req, &dev->tx_reqs, list) {
+		/* one spare byte, for padding in place of a zlp */
+		req->buf = kmalloc(size + 1, GFP_ATOMIC);
+		if (!req->buf)
+			goto fail;
+	}
+	dev->tx_agg_pkts = link->dl_max_pkts_per_xfer;
+	dev->tx_agg_bufsize = size;
+	dev->tx_agg_req = NULL;
+	spin_unlock(&dev->req_lock);
+	return;
+
+fail:
+	DBG(dev, "no tx aggregation buffers\n");
+	list_for_each_entry(req, &dev->tx_reqs, list)
+		kfree(req->buf);
+	spin_unlock(&dev->req_lock);
+}
+
 static void rx_fill(struct eth_dev *dev, gfp_t gfp_flags)
 {
 	struct usb_request	*req;
@@ -461,11 +571,17 @@ static void eth_work(struct work_struct *work)
 		DBG(dev, "work done, flags = 0x%lx\n", dev->todo);
 }
 
+static void tx_agg_send(struct eth_dev *dev, struct usb_ep *in,
+			struct usb_request *req, unsigned count);
+
 static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 {
-	struct sk_buff	*skb = req->context;
-	struct eth_dev	*dev = ep->driver_data;
+	struct sk_buff		*skb = req->context;
+	struct eth_dev		*dev = ep->driver_data;
+	struct usb_request	*held = NULL;
+	unsigned		count = 0;
 
+	/* aggregated transfers have their packets counted as queued */
 	switch (req->status) {
 	default:
 		dev->net->stats.tx_errors++;
@@ -475,20 +591,120 @@ static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 	case -ESHUTDOWN:		/* disconnect etc */
 		break;
 	case 0:
-		dev->net->stats.tx_bytes += skb->len;
+		if (skb)
+			dev->net->stats.tx_bytes += skb->len;
 	}
-	dev->net->stats.tx_packets++;
+	if (skb)
+		dev->net->stats.tx_packets++;
 
 	spin_lock(&dev->req_lock);
 	list_add(&req->list, &dev->tx_reqs);
+	atomic_dec(&dev->tx_qlen);
+	/* a transfer held back for more packets goes out now */
+	if (dev->tx_agg_req && req->status == 0) {
+		held = dev->tx_agg_req;
+		count = dev->tx_agg_count;
+		dev->tx_agg_req = NULL;
+	}
 	spin_unlock(&dev->req_lock);
-	dev_kfree_skb_any(skb);
+	if (skb)
+		dev_kfree_skb_any(skb);
+
+	if (held) {
+		dev->agg_stats.tx_held++;
+		tx_agg_send(dev, ep, held, count);
+	}
 
-	atomic_dec(&dev->tx_qlen);
 	if (netif_carrier_ok(dev->net))
 		netif_wake_queue(dev->net);
 }
 
+static void tx_agg_send(struct eth_dev *dev, struct usb_ep *in,
+			struct usb_request *req, unsigned count)
+{
+	unsigned long	flags;
+	int		retval;
+
+	req->context = NULL;
+	req->complete = tx_complete;
+
+	/* same zlp framing as eth_start_xmit() */
+	req->zero = 1;
+	if (!dev->zlp && (req->length % in->maxpacket) == 0)
+		req->length++;
+
+	/* tx_complete() must run to send any transfer held back */
+	req->no_interrupt = 0;
+
+	retval = usb_ep_queue(in, req, GFP_ATOMIC);
+	if (retval == 0) {
+		dev->net->trans_start = jiffies;
+		atomic_inc(&dev->tx_qlen);
+		dev->agg_stats.tx_xfers++;
+		dev->agg_stats.tx_pkts += count;
+		if (count > 1)
+			dev->agg_stats.tx_multi++;
+		return;
+	}
+
+	DBG(dev, "tx queue err %d\n", retval);
+	dev->net->stats.tx_dropped += count;
+	spin_lock_irqsave(&dev->req_lock, flags);
+	if (list_empty(&dev->tx_reqs))
+		netif_start_queue(dev->net);
+	list_add(&req->list, &dev->tx_reqs);
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+}
+
+/*
+ * Copy a framed packet (if any) into the transfer being built, then hold
+ * the transfer back for more or send it.  It is held only while other
+ * transfers are in flight, as tx_complete() is what sends it otherwise,
+ * and only while another packet of any size still fits under the host's
+ * limit (@limit, 0 if not known yet).
+ */
+static void eth_agg_xmit(struct eth_dev *dev, struct usb_ep *in,
+			 struct usb_request *req, unsigned count,
+			 struct sk_buff *skb, unsigned limit)
+{
+	unsigned	frame = dev->tx_agg_bufsize / dev->tx_agg_pkts;
+	unsigned long	flags;
+
+	if (skb) {
+		if (req->length + skb->len <= dev->tx_agg_bufsize) {
+			memcpy(req->buf + req->length, skb->data, skb->len);
+			req->length += skb->len;
+			count++;
+			dev->net->stats.tx_packets++;
+			dev->net->stats.tx_bytes += skb->len;
+		} else
+			dev->net->stats.tx_dropped++;
+		dev_kfree_skb_any(skb);
+	}
+
+	/* leave room for the pad byte under the host's limit */
+	limit = min(limit, dev->tx_agg_bufsize + 1);
+
+	spin_lock_irqsave(&dev->req_lock, flags);
+	if (count < dev->tx_agg_pkts && req->length + frame < limit
+			&& atomic_read(&dev->tx_qlen) > 0) {
+		dev->tx_agg_req = req;
+		dev->tx_agg_count = count;
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+		return;
+	}
+	if (!count) {
+		if (list_empty(&dev->tx_reqs))
+			netif_start_queue(dev->net);
+		list_add(&req->list, &dev->tx_reqs);
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+		return;
+	}
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+
+	tx_agg_send(dev, in, req, count);
+}
+
 static inline int is_promisc(u16 cdc_filter)
 {
 	return cdc_filter & USB_CDC_PACKET_TYPE_PROMISCUOUS;
@@ -504,11 +720,14 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 	unsigned long		flags;
 	struct usb_ep		*in;
 	u16			cdc_filter;
+	unsigned		agg_limit = 0;
+	unsigned		agg_count = 0;
 
 	spin_lock_irqsave(&dev->lock, flags);
 	if (dev->port_usb) {
 		in = dev->port_usb->in_ep;
 		cdc_filter = dev->port_usb->cdc_filter;
+		agg_limit = dev->port_usb->dl_max_xfer_size;
 	} else {
 		in = NULL;
 		cdc_filter = 0;
@@ -543,22 +762,31 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 	}
 
 	spin_lock_irqsave(&dev->req_lock, flags);
-	/*
-	 * this freelist can be empty if an interrupt triggered disconnect()
-	 * and reconfigured the gadget (shutting down this queue) after the
-	 * network stack decided to xmit but before we got the spinlock.
-	 */
-	if (list_empty(&dev->tx_reqs)) {
-		spin_unlock_irqrestore(&dev->req_lock, flags);
-		return NETDEV_TX_BUSY;
-	}
+	if (dev->tx_agg_req) {
+		/* carry on filling the transfer that was held back */
+		req = dev->tx_agg_req;
+		agg_count = dev->tx_agg_count;
+		dev->tx_agg_req = NULL;
+	} else {
+		/*
+		 * this freelist can be empty if an interrupt triggered
+		 * disconnect() and reconfigured the gadget (shutting down
+		 * this queue) after the network stack decided to xmit but
+		 * before we got the spinlock.
+		 */
+		if (list_empty(&dev->tx_reqs)) {
+			spin_unlock_irqrestore(&dev->req_lock, flags);
+			return NETDEV_TX_BUSY;
+		}
 
-	req = container_of(dev->tx_reqs.next, struct usb_request, list);
-	list_del(&req->list);
+		req = container_of(dev->tx_reqs.next, struct usb_request, list);
+		list_del(&req->list);
+		req->length = 0;
 
-	/* temporarily stop TX queue when the freelist empties */
-	if (list_empty(&dev->tx_reqs))
-		netif_stop_queue(net);
+		/* temporarily stop TX queue when the freelist empties */
+		if (list_empty(&dev->tx_reqs))
+			netif_stop_queue(net);
+	}
 	spin_unlock_irqrestore(&dev->req_lock, flags);
 
 	/* no buffer copies needed, unless the network stack did it
@@ -572,11 +800,19 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 		if (dev->port_usb)
 			skb = dev->wrap(dev->port_usb, skb);
 		spin_unlock_irqrestore(&dev->lock, flags);
-		if (!skb)
-			goto drop;
+		if (!skb) {
+			if (!dev->tx_agg_pkts)
+				goto drop;
+			dev->net->stats.tx_dropped++;
+		} else
+			length = skb->len;
+	}
 
-		length = skb->len;
+	if (dev->tx_agg_pkts) {
+		eth_agg_xmit(dev, in, req, agg_count, skb, agg_limit);
+		return NETDEV_TX_OK;
 	}
+
 	req->buf = skb->data;
 	req->context = skb;
 	req->complete = tx_complete;
@@ -612,6 +848,8 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 	case 0:
 		net->trans_start = jiffies;
 		atomic_inc(&dev->tx_qlen);
+		dev->agg_stats.tx_xfers++;
+		dev->agg_stats.tx_pkts++;
 	}
 
 	if (retval) {
@@ -890,6 +1128,10 @@ struct net_device *gether_connect(struct gether *link)
 		result = alloc_requests(dev, link, qlen(dev->gadget));
 
 	if (result == 0) {
+		dev->tx_agg_pkts = 0;
+		if (link->dl_max_pkts_per_xfer > 1)
+			alloc_tx_buffers(dev, link);
+
 		dev->zlp = link->is_zlp_ok;
 		DBG(dev, "qlen %d\n", qlen(dev->gadget));
 
@@ -957,15 +1199,22 @@ void gether_disconnect(struct gether *link)
 	 */
 	usb_ep_disable(link->in_ep);
 	spin_lock(&dev->req_lock);
+	if (dev->tx_agg_req) {
+		list_add(&dev->tx_agg_req->list, &dev->tx_reqs);
+		dev->tx_agg_req = NULL;
+	}
 	while (!list_empty(&dev->tx_reqs)) {
 		req = container_of(dev->tx_reqs.next,
 					struct usb_request, list);
 		list_del(&req->list);
 
 		spin_unlock(&dev->req_lock);
+		if (dev->tx_agg_pkts)
+			kfree(req->buf);
 		usb_ep_free_request(link->in_ep, req);
 		spin_lock(&dev->req_lock);
 	}
+	dev->tx_agg_pkts = 0;
 	spin_unlock(&dev->req_lock);
 	link->in_ep->driver_data = NULL;
 	link->in = NULL;
@@ -66,6 +66,12 @@ struct gether {
 	bool				is_fixed;
 	u32				fixed_out_len;
 	u32				fixed_in_len;
+	/* framings that can carry several packets per transfer (RNDIS)
+	 * set these; dl_max_xfer_size is the host's limit, 0 until known
+	 */
+	u32				dl_max_pkts_per_xfer;
+	u32				dl_max_xfer_size;
+	u32				ul_max_pkts_per_xfer;
 	struct sk_buff			*(*wrap)(struct gether *port,
 						struct sk_buff *skb);
 	int				(*unwrap)(struct gether *port,
@@ -228,6 +228,30 @@ struct mdp_dma_data {
 	struct completion dmap_comp;
 };
 
+struct mdp_ppp_statistic {
+	ulong blit;		/* blits issued to the PPP */
+	ulong blit_us;		/* accumulated blit time */
+	ulong blit_last_us;
+	ulong blit_max_us;
+	ulong flush;		/* source cache flushes done */
+	ulong flush_skip;	/* source cache flushes found redundant */
+	ulong flush_bytes;
+	ulong flush_us;		/* accumulated cache maintenance time */
+};
+
+extern struct mdp_ppp_statistic mdp_ppp_stat;
+
+struct mdp_pan_statistic {
+	ulong update;		/* pan display calls */
+	ulong split;		/* updates sent as separate rectangles */
+	ulong dma;		/* DMA transfers issued */
+	u64 pixels;		/* pixels transferred */
+	u64 union_pixels;	/* pixels a single bounding box would send */
+	ktime_t since;		/* start of the measurement window */
+};
+
+extern struct mdp_pan_statistic mdp_pan_stat;
+
 #define MDP_CMD_DEBUG_ACCESS_BASE   (MDP_BASE+0x10000)
 
 #define MDP_DMA2_TERM 0x1
@@ -655,6 +679,7 @@ void mdp_set_dma_pan_info(struct fb_info *info, struct mdp_dirty_region *dirty,
 void mdp_dma_pan_update(struct fb_info *info);
 void mdp_refresh_screen(unsigned long data);
 int mdp_ppp_blit(struct fb_info *info, struct mdp_blit_req *req);
+void mdp_ppp_blit_list_start(void);
 void mdp_lcd_update_workqueue_handler(struct work_struct *work);
 void mdp_vsync_resync_workqueue_handler(struct work_struct *work);
 void mdp_dma2_update(struct msm_fb_data_type *mfd);
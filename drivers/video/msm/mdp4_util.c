@@ -203,6 +203,10 @@ int mdp_ppp_blit(struct fb_info *info, struct mdp_blit_req *req)
 	return -1;
 }
 
+void mdp_ppp_blit_list_start(void)
+{
+}
+
 void mdp4_fetch_cfg(uint32 core_clk)
 {
 
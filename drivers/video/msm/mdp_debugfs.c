@@ -23,6 +23,7 @@
 #include <linux/debugfs.h>
 #include <linux/semaphore.h>
 #include <linux/uaccess.h>
+#include <asm/div64.h>
 #include <asm/system.h>
 #include <asm/mach-types.h>
 #include <mach/hardware.h>
@@ -424,6 +425,206 @@ static const struct file_operations mdp_stat_fops = {
 };
 #endif
 
+#ifndef CONFIG_FB_MSM_MDP40
+extern struct semaphore mdp_ppp_mutex;
+
+static int mdp_ppp_stat_open(struct inode *inode, struct file *file)
+{
+	/* non-seekable */
+	file->f_mode &= ~(FMODE_LSEEK | FMODE_PREAD | FMODE_PWRITE);
+	return 0;
+}
+
+static int mdp_ppp_stat_release(struct inode *inode, struct file *file)
+{
+	return 0;
+}
+
+static ssize_t mdp_ppp_stat_write(
+	struct file *file,
+	const char __user *buff,
+	size_t count,
+	loff_t *ppos)
+{
+	if (count > sizeof(debug_buf))
+		return -EFAULT;
+
+	down(&mdp_ppp_mutex);
+	memset((char *)&mdp_ppp_stat, 0 , sizeof(mdp_ppp_stat));	/* reset */
+	up(&mdp_ppp_mutex);
+
+	return count;
+}
+
+static ssize_t mdp_ppp_stat_read(
+	struct file *file,
+	char __user *buff,
+	size_t count,
+	loff_t *ppos)
+{
+	int len = 0;
+	int tot = 0;
+	int dlen;
+	char *bp;
+	struct mdp_ppp_statistic stat;
+
+	if (*ppos)
+		return 0;	/* the end */
+
+	down(&mdp_ppp_mutex);
+	stat = mdp_ppp_stat;
+	up(&mdp_ppp_mutex);
+
+	bp = debug_buf;
+	dlen = sizeof(debug_buf);
+
+	len = snprintf(bp, dlen, "blit:          %08lu\n", stat.blit);
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "blit_avg_us:   %08lu\n",
+				stat.blit ? stat.blit_us / stat.blit : 0);
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "blit_last_us:  %08lu\n",
+				stat.blit_last_us);
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "blit_max_us:   %08lu\n\n",
+				stat.blit_max_us);
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "flush:         %08lu\n", stat.flush);
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "flush_skip:    %08lu\n", stat.flush_skip);
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "flush_kbytes:  %08lu\n",
+				stat.flush_bytes >> 10);
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "flush_avg_us:  %08lu\n",
+				stat.flush ? stat.flush_us / stat.flush : 0);
+	bp += len;
+	dlen -= len;
+
+	tot = (uint32)bp - (uint32)debug_buf;
+	*bp = 0;
+	tot++;
+
+	if (tot < 0)
+		return 0;
+	if (copy_to_user(buff, debug_buf, tot))
+		return -EFAULT;
+
+	*ppos += tot;	/* increase offset */
+
+	return tot;
+}
+
+static const struct file_operations mdp_ppp_stat_fops = {
+	.open = mdp_ppp_stat_open,
+	.release = mdp_ppp_stat_release,
+	.read = mdp_ppp_stat_read,
+	.write = mdp_ppp_stat_write,
+};
+#endif
+
+static int mdp_pan_stat_open(struct inode *inode, struct file *file)
+{
+	/* non-seekable */
+	file->f_mode &= ~(FMODE_LSEEK | FMODE_PREAD | FMODE_PWRITE);
+	return 0;
+}
+
+static int mdp_pan_stat_release(struct inode *inode, struct file *file)
+{
+	return 0;
+}
+
+static ssize_t mdp_pan_stat_write(
+	struct file *file,
+	const char __user *buff,
+	size_t count,
+	loff_t *ppos)
+{
+	if (count > sizeof(debug_buf))
+		return -EFAULT;
+
+	memset((char *)&mdp_pan_stat, 0 , sizeof(mdp_pan_stat));	/* reset */
+	mdp_pan_stat.since = ktime_get();
+
+	return count;
+}
+
+static ssize_t mdp_pan_stat_read(
+	struct file *file,
+	char __user *buff,
+	size_t count,
+	loff_t *ppos)
+{
+	int len = 0;
+	int tot = 0;
+	int dlen;
+	char *bp;
+	struct mdp_pan_statistic stat;
+	u64 pps;
+	s64 msec;
+
+	if (*ppos)
+		return 0;	/* the end */
+
+	stat = mdp_pan_stat;
+	msec = ktime_to_ms(ktime_sub(ktime_get(), stat.since));
+	pps = stat.pixels * MSEC_PER_SEC;
+	if (msec > 0)
+		do_div(pps, (u32)msec);
+	else
+		pps = 0;
+
+	bp = debug_buf;
+	dlen = sizeof(debug_buf);
+
+	len = snprintf(bp, dlen, "update:         %08lu\n", stat.update);
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "split:          %08lu\n", stat.split);
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "dma:            %08lu\n\n", stat.dma);
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "pixels:         %llu\n", stat.pixels);
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "union_pixels:   %llu\n", stat.union_pixels);
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "pixels_per_sec: %llu\n", pps);
+	bp += len;
+	dlen -= len;
+
+	tot = (uint32)bp - (uint32)debug_buf;
+	*bp = 0;
+	tot++;
+
+	if (tot < 0)
+		return 0;
+	if (copy_to_user(buff, debug_buf, tot))
+		return -EFAULT;
+
+	*ppos += tot;	/* increase offset */
+
+	return tot;
+}
+
+static const struct file_operations mdp_pan_stat_fops = {
+	.open = mdp_pan_stat_open,
+	.release = mdp_pan_stat_release,
+	.read = mdp_pan_stat_read,
+	.write = mdp_pan_stat_write,
+};
+
 /*
  * MDDI
  *
@@ -1191,8 +1392,22 @@ int mdp_debugfs_init(void)
 			__FILE__, __LINE__);
 		return -1;
 	}
+#else
+	if (debugfs_create_file("ppp_stat", 0644, dent, 0, &mdp_ppp_stat_fops)
+			== NULL) {
+		printk(KERN_ERR "%s(%d): debugfs_create_file: debug fail\n",
+			__FILE__, __LINE__);
+		return -1;
+	}
 #endif
 
+	if (debugfs_create_file("pan_stat", 0644, dent, 0, &mdp_pan_stat_fops)
+			== NULL) {
+		printk(KERN_ERR "%s(%d): debugfs_create_file: debug fail\n",
+			__FILE__, __LINE__);
+		return -1;
+	}
+
 	dent = debugfs_create_dir("mddi", NULL);
 
 	if (IS_ERR(dent)) {
@@ -24,6 +24,7 @@
 #include <linux/file.h>
 #include <linux/android_pmem.h>
 #include <linux/major.h>
+#include <linux/ktime.h>
 
 #include "linux/proc_fs.h"
 
@@ -544,37 +545,161 @@ static void mdp_ppp_setbg(MDPIBUF *iBuf)
 	((format == MDP_Y_CBCR_H2V2 || format == MDP_Y_CRCB_H2V2) ?  2 :\
 	(format == MDP_Y_CBCR_H2V1 || format == MDP_Y_CRCB_H2V1) ?  1 : 1)
 
+struct mdp_ppp_statistic mdp_ppp_stat;
+
 #ifdef CONFIG_ANDROID_PMEM
-static void get_len(struct mdp_img *img, struct mdp_rect *rect, uint32_t bpp,
-			uint32_t *len0, uint32_t *len1)
+/*
+ * Image ranges known to be coherent in memory for the blit list being
+ * processed: either flushed already as a source, or just written by the
+ * PPP as a destination.  The caller is blocked in MSMFB_BLIT for the whole
+ * list, so the CPU can't dirty them again and repeated cache maintenance
+ * is skipped.  Protected by mdp_ppp_mutex.
+ */
+#define MDP_PPP_MAX_CLEAN_IMGS	8
+
+struct mdp_ppp_clean_img {
+	struct file *file;
+	unsigned long start;
+	unsigned long end;
+};
+
+static struct mdp_ppp_clean_img mdp_ppp_clean_imgs[MDP_PPP_MAX_CLEAN_IMGS];
+static int mdp_ppp_clean_cnt;
+static struct task_struct *mdp_ppp_clean_owner;
+
+static void mdp_ppp_clean_reset(void)
+{
+	mdp_ppp_clean_cnt = 0;
+	mdp_ppp_clean_owner = current;
+}
+
+static int mdp_ppp_img_is_clean(struct file *file, unsigned long start,
+				unsigned long len)
+{
+	int i;
+
+	/* another process blitted in between, nothing can be trusted */
+	if (mdp_ppp_clean_owner != current) {
+		mdp_ppp_clean_reset();
+		return FALSE;
+	}
+
+	for (i = 0; i < mdp_ppp_clean_cnt; i++) {
+		if ((mdp_ppp_clean_imgs[i].file == file) &&
+		    (mdp_ppp_clean_imgs[i].start <= start) &&
+		    (mdp_ppp_clean_imgs[i].end >= start + len))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static void mdp_ppp_img_set_clean(struct file *file, unsigned long start,
+				  unsigned long len)
+{
+	struct mdp_ppp_clean_img *img;
+
+	if (!file || !len)
+		return;
+
+	if (mdp_ppp_clean_owner != current)
+		mdp_ppp_clean_reset();
+
+	/* table full: recycle the oldest entry */
+	if (mdp_ppp_clean_cnt == MDP_PPP_MAX_CLEAN_IMGS) {
+		memmove(&mdp_ppp_clean_imgs[0], &mdp_ppp_clean_imgs[1],
+			sizeof(mdp_ppp_clean_imgs[0]) *
+			(MDP_PPP_MAX_CLEAN_IMGS - 1));
+		mdp_ppp_clean_cnt--;
+	}
+
+	img = &mdp_ppp_clean_imgs[mdp_ppp_clean_cnt++];
+	img->file = file;
+	img->start = start;
+	img->end = start + len;
+}
+
+/*
+ * Called once per MSMFB_BLIT request list: userspace may have written any
+ * buffer since the previous list, so forget everything we knew.
+ */
+void mdp_ppp_blit_list_start(void)
 {
+	down(&mdp_ppp_mutex);
+	mdp_ppp_clean_reset();
+	up(&mdp_ppp_mutex);
+}
+
+/*
+ * Byte ranges of the rows of @rect in @img: plane 0 from the first row
+ * of the rect, and for pseudo planar formats the CbCr plane, which
+ * follows the full height of the Y plane.
+ */
+static void get_ranges(struct mdp_img *img, struct mdp_rect *rect,
+		       uint32_t bpp, unsigned long *start0, uint32_t *len0,
+		       unsigned long *start1, uint32_t *len1)
+{
+	uint32_t ratio, y1;
+
+	*start0 = img->offset + (rect->y * img->width + rect->x) * bpp;
 	*len0 = IMG_LEN(rect->h, img->width, rect->w, bpp);
-	if (IS_PSEUDOPLNR(img->format))
-		*len1 = *len0/Y_TO_CRCB_RATIO(img->format);
-	else
+	if (IS_PSEUDOPLNR(img->format)) {
+		ratio = Y_TO_CRCB_RATIO(img->format);
+		y1 = rect->y / ratio;
+		*start1 = img->offset + img->height * img->width * bpp +
+			  y1 * img->width * bpp;
+		*len1 = (DIV_ROUND_UP(rect->y + rect->h, ratio) - y1) *
+			img->width * bpp;
+	} else {
+		*start1 = 0;
 		*len1 = 0;
+	}
 }
 
 static void flush_imgs(struct mdp_blit_req *req, int src_bpp, int dst_bpp,
 			struct file *p_src_file, struct file *p_dst_file)
 {
+	unsigned long src0_start, src1_start, dst0_start, dst1_start;
 	uint32_t src0_len, src1_len;
+	uint32_t dst0_len, dst1_len;
+	ktime_t start;
 
 	if (!(req->flags & MDP_BLIT_NON_CACHED)) {
 		/* flush src images to memory before dma to mdp */
-		get_len(&req->src, &req->src_rect, src_bpp,
-		&src0_len, &src1_len);
-
-		flush_pmem_file(p_src_file,
-		req->src.offset, src0_len);
-
-		if (IS_PSEUDOPLNR(req->src.format))
-			flush_pmem_file(p_src_file,
-				req->src.offset + src0_len, src1_len);
+		get_ranges(&req->src, &req->src_rect, src_bpp,
+			   &src0_start, &src0_len, &src1_start, &src1_len);
+
+		if (mdp_ppp_img_is_clean(p_src_file, src0_start, src0_len) &&
+		    (!src1_len ||
+		     mdp_ppp_img_is_clean(p_src_file, src1_start, src1_len))) {
+			mdp_ppp_stat.flush_skip++;
+		} else {
+			start = ktime_get();
+			flush_pmem_file(p_src_file, src0_start, src0_len);
+
+			if (src1_len)
+				flush_pmem_file(p_src_file,
+						src1_start, src1_len);
+			mdp_ppp_stat.flush_us +=
+				ktime_to_us(ktime_sub(ktime_get(), start));
+			mdp_ppp_stat.flush++;
+			mdp_ppp_stat.flush_bytes += src0_len + src1_len;
+
+			mdp_ppp_img_set_clean(p_src_file, src0_start,
+					      src0_len);
+			mdp_ppp_img_set_clean(p_src_file, src1_start,
+					      src1_len);
+		}
 	}
 
+	/* the PPP output only ever lives in memory, never in the cache */
+	get_ranges(&req->dst, &req->dst_rect, dst_bpp,
+		   &dst0_start, &dst0_len, &dst1_start, &dst1_len);
+	mdp_ppp_img_set_clean(p_dst_file, dst0_start, dst0_len);
+	mdp_ppp_img_set_clean(p_dst_file, dst1_start, dst1_len);
 }
 #else
+void mdp_ppp_blit_list_start(void) { }
+
 static void flush_imgs(struct mdp_blit_req *req, int src_bpp, int dst_bpp,
 			struct file *p_src_file, struct file *p_dst_file) { }
 #endif
@@ -1309,6 +1434,8 @@ int mdp_ppp_blit(struct fb_info *info, struct mdp_blit_req *req)
 	u32 dst_width, dst_height;
 	struct file *p_src_file = 0 , *p_dst_file = 0;
 	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	ktime_t start;
+	ulong blit_us;
 
 	if (req->dst.format == MDP_FB_FORMAT)
 		req->dst.format =  mfd->fb_imgType;
@@ -1465,6 +1592,7 @@ int mdp_ppp_blit(struct fb_info *info, struct mdp_blit_req *req)
 	}
 
 	down(&mdp_ppp_mutex);
+	start = ktime_get();
 	/* MDP cmd block enable */
 	mdp_pipe_ctrl(MDP_CMD_BLOCK, MDP_BLOCK_POWER_ON, FALSE);
 
@@ -1562,6 +1690,13 @@ int mdp_ppp_blit(struct fb_info *info, struct mdp_blit_req *req)
 
 	/* MDP cmd block disable */
 	mdp_pipe_ctrl(MDP_CMD_BLOCK, MDP_BLOCK_POWER_OFF, FALSE);
+
+	blit_us = ktime_to_us(ktime_sub(ktime_get(), start));
+	mdp_ppp_stat.blit++;
+	mdp_ppp_stat.blit_us += blit_us;
+	mdp_ppp_stat.blit_last_us = blit_us;
+	if (blit_us > mdp_ppp_stat.blit_max_us)
+		mdp_ppp_stat.blit_max_us = blit_us;
 	up(&mdp_ppp_mutex);
 
 	put_img(p_src_file);
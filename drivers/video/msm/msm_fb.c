@@ -1079,6 +1079,8 @@ static int msm_fb_register(struct msm_fb_data_type *mfd)
 
 	mfd->pan_waiting = FALSE;
 	init_completion(&mfd->pan_comp);
+	spin_lock_init(&mfd->damage_lock);
+	mfd->damage_cnt = 0;
 	init_completion(&mfd->refresher_comp);
 	sema_init(&mfd->sem, 1);
 
@@ -1343,12 +1345,183 @@ static int msm_fb_release(struct fb_info *info, int user)
 
 DEFINE_SEMAPHORE(msm_fb_pan_sem);
 
+struct mdp_pan_statistic mdp_pan_stat;
+
+/*
+ * Fixed cost of one extra DMA/MDDI transfer, in pixels: register setup,
+ * MDDI link packet overhead and the completion interrupt.  Damage is sent
+ * as separate rectangles only when that beats the bounding box by more
+ * than this per rectangle.
+ */
+static int damage_rect_cost = 4096;
+module_param(damage_rect_cost, int, 0644);
+
+static u32 msm_fb_rect_area(struct mdp_rect *r)
+{
+	return r->w * r->h;
+}
+
+static void msm_fb_rect_union(struct mdp_rect *a, struct mdp_rect *b,
+			      struct mdp_rect *u)
+{
+	u32 x0 = min(a->x, b->x);
+	u32 y0 = min(a->y, b->y);
+	u32 x1 = max(a->x + a->w, b->x + b->w);
+	u32 y1 = max(a->y + a->h, b->y + b->h);
+
+	u->x = x0;
+	u->y = y0;
+	u->w = x1 - x0;
+	u->h = y1 - y0;
+}
+
+static int msm_fb_rect_contains(struct mdp_rect *a, struct mdp_rect *b)
+{
+	return (b->x >= a->x) && (b->y >= a->y) &&
+		(b->x + b->w <= a->x + a->w) &&
+		(b->y + b->h <= a->y + a->h);
+}
+
+/* called with mfd->damage_lock held */
+static void msm_fb_add_damage(struct msm_fb_data_type *mfd,
+			      struct mdp_rect *r)
+{
+	struct mdp_rect u;
+	int i, best = 0;
+	u32 cost, best_cost = ~0;
+
+	for (i = 0; i < mfd->damage_cnt; i++)
+		if (msm_fb_rect_contains(&mfd->damage[i], r))
+			return;
+
+	/* drop rectangles swallowed by the new one */
+	for (i = 0; i < mfd->damage_cnt; ) {
+		if (msm_fb_rect_contains(r, &mfd->damage[i]))
+			mfd->damage[i] = mfd->damage[--mfd->damage_cnt];
+		else
+			i++;
+	}
+
+	if (mfd->damage_cnt < MDP_MAX_DAMAGE_RECTS) {
+		mfd->damage[mfd->damage_cnt++] = *r;
+		return;
+	}
+
+	/* list full: merge with the rectangle that grows the least */
+	for (i = 0; i < mfd->damage_cnt; i++) {
+		msm_fb_rect_union(&mfd->damage[i], r, &u);
+		cost = msm_fb_rect_area(&u) -
+			msm_fb_rect_area(&mfd->damage[i]);
+		if (cost < best_cost) {
+			best_cost = cost;
+			best = i;
+		}
+	}
+	msm_fb_rect_union(&mfd->damage[best], r, &mfd->damage[best]);
+}
+
+static int msmfb_damage(struct fb_info *info, void __user *p)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	struct mdp_damage damage;
+	struct mdp_rect *r;
+	unsigned long flag;
+	int i;
+
+	if (copy_from_user(&damage, p, sizeof(damage)))
+		return -EFAULT;
+
+	if (damage.count > MDP_MAX_DAMAGE_RECTS)
+		return -EINVAL;
+
+	for (i = 0; i < damage.count; i++) {
+		r = &damage.rect[i];
+		if ((r->w == 0) || (r->h == 0) ||
+		    (r->x >= info->var.xres) || (r->y >= info->var.yres))
+			return -EINVAL;
+		/* clip to the visible screen */
+		r->w = min(r->w, info->var.xres - r->x);
+		r->h = min(r->h, info->var.yres - r->y);
+	}
+
+	spin_lock_irqsave(&mfd->damage_lock, flag);
+	for (i = 0; i < damage.count; i++)
+		msm_fb_add_damage(mfd, &damage.rect[i]);
+	spin_unlock_irqrestore(&mfd->damage_lock, flag);
+
+	return 0;
+}
+
+/*
+ * Take the accumulated damage, sorted top to bottom so the transfers
+ * follow the panel scan.  Returns the number of rectangles to send
+ * separately, 0 when the single bounding box in *bbox is cheaper, or -1
+ * when nothing was damaged.
+ */
+static int msm_fb_get_damage(struct msm_fb_data_type *mfd,
+			     struct mdp_rect *rect, struct mdp_rect *bbox)
+{
+	struct mdp_rect tmp;
+	unsigned long flag;
+	u32 sum = 0;
+	int i, j, cnt;
+
+	spin_lock_irqsave(&mfd->damage_lock, flag);
+	cnt = mfd->damage_cnt;
+	memcpy(rect, mfd->damage, cnt * sizeof(*rect));
+	mfd->damage_cnt = 0;
+	spin_unlock_irqrestore(&mfd->damage_lock, flag);
+
+	if (cnt == 0)
+		return -1;
+
+	for (i = 1; i < cnt; i++) {
+		tmp = rect[i];
+		for (j = i; (j > 0) && (rect[j - 1].y > tmp.y); j--)
+			rect[j] = rect[j - 1];
+		rect[j] = tmp;
+	}
+
+	*bbox = rect[0];
+	for (i = 0; i < cnt; i++) {
+		msm_fb_rect_union(bbox, &rect[i], bbox);
+		sum += msm_fb_rect_area(&rect[i]) + damage_rect_cost;
+	}
+	mdp_pan_stat.union_pixels += msm_fb_rect_area(bbox);
+
+	if ((cnt == 1) || (sum >= msm_fb_rect_area(bbox)))
+		return 0;
+
+	return cnt;
+}
+
+static void msm_fb_pan_rect(struct fb_info *info, struct mdp_rect *r,
+			    boolean sync)
+{
+	struct mdp_dirty_region dirty;
+
+	dirty.xoffset = r->x;
+	dirty.yoffset = r->y;
+	dirty.width = r->w;
+	dirty.height = r->h;
+
+	mdp_set_dma_pan_info(info, &dirty, sync);
+	mdp_dma_pan_update(info);
+
+	mdp_pan_stat.dma++;
+	mdp_pan_stat.pixels += r->w * r->h;
+}
+
 static int msm_fb_pan_display(struct fb_var_screeninfo *var,
 			      struct fb_info *info)
 {
 	struct mdp_dirty_region dirty;
 	struct mdp_dirty_region *dirtyPtr = NULL;
 	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	struct mdp_rect damage[MDP_MAX_DAMAGE_RECTS];
+	struct mdp_rect bbox;
+	unsigned long flag;
+	int i, damage_cnt = -1;
 
 	if ((!mfd->op_enable) || (!mfd->panel_power_on))
 		return -EPERM;
@@ -1398,6 +1571,20 @@ static int msm_fb_pan_display(struct fb_var_screeninfo *var,
 			return -EINVAL;
 
 		dirtyPtr = &dirty;
+
+		/* an explicit region supersedes any queued damage */
+		spin_lock_irqsave(&mfd->damage_lock, flag);
+		mfd->damage_cnt = 0;
+		spin_unlock_irqrestore(&mfd->damage_lock, flag);
+	} else {
+		damage_cnt = msm_fb_get_damage(mfd, damage, &bbox);
+		if (damage_cnt == 0) {
+			dirty.xoffset = bbox.x;
+			dirty.yoffset = bbox.y;
+			dirty.width = bbox.w;
+			dirty.height = bbox.h;
+			dirtyPtr = &dirty;
+		}
 	}
 	complete(&mfd->msmfb_update_notify);
 	mutex_lock(&msm_fb_notify_update_sem);
@@ -1410,9 +1597,22 @@ static int msm_fb_pan_display(struct fb_var_screeninfo *var,
 	mutex_unlock(&msm_fb_notify_update_sem);
 
 	down(&msm_fb_pan_sem);
-	mdp_set_dma_pan_info(info, dirtyPtr,
-			     (var->activate == FB_ACTIVATE_VBL));
-	mdp_dma_pan_update(info);
+	mdp_pan_stat.update++;
+	if (damage_cnt > 0) {
+		mdp_pan_stat.split++;
+		/* wait for vsync once, before the first rect of the update */
+		for (i = 0; i < damage_cnt; i++)
+			msm_fb_pan_rect(info, &damage[i], (i == 0) &&
+					(var->activate == FB_ACTIVATE_VBL));
+	} else {
+		mdp_set_dma_pan_info(info, dirtyPtr,
+				     (var->activate == FB_ACTIVATE_VBL));
+		mdp_dma_pan_update(info);
+		mdp_pan_stat.dma++;
+		mdp_pan_stat.pixels += dirtyPtr ?
+			dirtyPtr->width * dirtyPtr->height :
+			info->var.xres * info->var.yres;
+	}
 	up(&msm_fb_pan_sem);
 
 	++mfd->panel_info.frame_count;
@@ -2337,6 +2537,10 @@ static int msmfb_blit(struct fb_info *info, void __user *p)
 	count = req_list_header.count;
 	if (count < 0 || count >= MAX_BLIT_REQ)
 		return -EINVAL;
+
+	/* buffers may have been written by the CPU since the last list */
+	mdp_ppp_blit_list_start();
+
 	while (count > 0) {
 		/*
 		 * Access the requests through a narrow window to decrease copy
@@ -2850,6 +3054,10 @@ static int msm_fb_ioctl(struct fb_info *info, unsigned int cmd,
 		ret = msmfb_notify_update(info, argp);
 		break;
 
+	case MSMFB_DAMAGE:
+		ret = msmfb_damage(info, argp);
+		break;
+
 	case MSMFB_SET_PAGE_PROTECTION:
 #if defined CONFIG_ARCH_QSD8X50 || defined CONFIG_ARCH_MSM8X60
 		ret = copy_from_user(&fb_page_protection, argp,
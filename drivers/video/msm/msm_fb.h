@@ -98,6 +98,11 @@ struct msm_fb_data_type {
 	boolean pan_waiting;
 	struct completion pan_comp;
 
+	/* damage accumulated since the last pan, see MSMFB_DAMAGE */
+	spinlock_t damage_lock;
+	struct mdp_rect damage[MDP_MAX_DAMAGE_RECTS];
+	int damage_cnt;
+
 	/* vsync */
 	boolean use_mdp_vsync;
 	__u32 vsync_gpio;
@@ -61,6 +61,12 @@
 
 #define PMEM_GET_FREE_SPACE	_IOW(PMEM_IOCTL_MAGIC, 14, unsigned int)
 #define PMEM_ALLOCATE_ALIGNED	_IOW(PMEM_IOCTL_MAGIC, 15, unsigned int)
+/* Map this file cached (arg 1) or with the region's default attributes
+ * (arg 0).  Must be issued before the file is mmaped.  A cached mapping
+ * has to be synced with PMEM_CLEAN_CACHES/PMEM_INV_CACHES over the range
+ * the CPU touched before the buffer is handed to or taken from hardware.
+ */
+#define PMEM_SET_CACHED		_IOW(PMEM_IOCTL_MAGIC, 16, unsigned int)
 struct pmem_region {
 	unsigned long offset;
 	unsigned long len;
@@ -10,6 +10,32 @@
 
 extern u32  crc32_le(u32 crc, unsigned char const *p, size_t len);
 extern u32  crc32_be(u32 crc, unsigned char const *p, size_t len);
+extern u32  __crc32c_le(u32 crc, unsigned char const *p, size_t len);
+
+extern u32  crc32_le_shift(u32 crc, size_t len) __attribute_const__;
+extern u32  __crc32c_le_shift(u32 crc, size_t len) __attribute_const__;
+
+/**
+ * crc32_le_combine - Combine two crc32 check values into one
+ * @crc1: crc32 of the first block
+ * @crc2: crc32 of the second block, computed with a seed of 0
+ * @len2: length of the second block
+ *
+ * If crc1 = crc32_le(seed, A, lenA) and crc2 = crc32_le(0, B, len2),
+ * this returns crc32_le(seed, A + B, lenA + len2), so that the two
+ * blocks can be checksummed independently (e.g. on different CPUs)
+ * and merged in O(log(len2)) time.
+ */
+static inline u32 crc32_le_combine(u32 crc1, u32 crc2, size_t len2)
+{
+	return crc32_le_shift(crc1, len2) ^ crc2;
+}
+
+/* The same for crc32c, as computed by __crc32c_le() */
+static inline u32 __crc32c_le_combine(u32 crc1, u32 crc2, size_t len2)
+{
+	return __crc32c_le_shift(crc1, len2) ^ crc2;
+}
 
 #define crc32(seed, data, length)  crc32_le(seed, (unsigned char const *)data, length)
 
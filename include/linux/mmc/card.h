@@ -55,6 +55,8 @@ struct mmc_ext_csd {
 	unsigned int		sec_trim_mult;	/* Secure trim multiplier  */
 	unsigned int		sec_erase_mult;	/* Secure erase multiplier */
 	unsigned int		trim_timeout;		/* In milliseconds */
+	unsigned int		max_packed_writes;	/* 0 if unsupported */
+	unsigned int		max_packed_reads;
 };
 
 struct sd_scr {
@@ -91,6 +91,23 @@
 #define AUDIO_GET_ACDB_BLK _IOW(AUDIO_IOCTL_MAGIC, 96,  \
 					struct msm_acdb_cmd_device)
 
+/* PCM out, mmap mode: the ring of buffer_count periods of buffer_size
+ * bytes (see AUDIO_GET_CONFIG) is mmap()ed at offset 0.  Userspace fills
+ * periods in order and queues the next arg bytes with AUDIO_OUT_COMMIT;
+ * each commit starts on a period boundary and a trailing partial period
+ * is played short.  Returns the number of free periods; poll() reports
+ * POLLOUT while the next period is free.
+ */
+#define AUDIO_OUT_COMMIT     _IOW(AUDIO_IOCTL_MAGIC, 97, unsigned)
+
+/* MP3/AAC playback: everything written so far ends the current track.
+ * Queued data is handed to the DSP without draining, so the next track
+ * can be written straight away and plays gaplessly; an
+ * AUDIO_EVENT_TRACK_DONE event carrying arg in event_payload.reserved is
+ * posted once the DSP has consumed the last buffer of the track.
+ */
+#define AUDIO_TRACK_END      _IOW(AUDIO_IOCTL_MAGIC, 98, unsigned)
+
 #define	AUDIO_MAX_COMMON_IOCTL_NUM	100
 
 
@@ -254,6 +271,7 @@ struct msm_audio_pcm_config {
 #define AUDIO_EVENT_READ_DONE   3
 #define AUDIO_EVENT_STREAM_INFO 4
 #define AUDIO_EVENT_BITSTREAM_ERROR_INFO 5
+#define AUDIO_EVENT_TRACK_DONE 6
 
 #define AUDIO_CODEC_TYPE_MP3 0
 #define AUDIO_CODEC_TYPE_AAC 1
@@ -50,6 +50,7 @@
 
 #define MSMFB_OVERLAY_3D       _IOWR(MSMFB_IOCTL_MAGIC, 146, \
 						struct msmfb_overlay_3d)
+#define MSMFB_DAMAGE		_IOW(MSMFB_IOCTL_MAGIC, 147, struct mdp_damage)
 
 #define MDP_IMGTYPE2_START 0x10000
 #define MSMFB_DRIVER_VERSION	0xF9E8D701
@@ -135,6 +136,17 @@ struct mdp_rect {
 	uint32_t h;
 };
 
+#define MDP_MAX_DAMAGE_RECTS	8
+
+/*
+ * Screen regions changed since the last pan, accumulated by the driver
+ * until the next FBIOPAN_DISPLAY.
+ */
+struct mdp_damage {
+	uint32_t count;
+	struct mdp_rect rect[MDP_MAX_DAMAGE_RECTS];
+};
+
 struct mdp_img {
 	uint32_t width;
 	uint32_t height;
@@ -164,6 +164,12 @@
 #define MSM_CAM_IOCTL_GET_CONFIG_INFO \
 	_IOR(MSM_CAM_IOCTL_MAGIC, 40, struct msm_cam_config_dev_info *)
 
+#define MSM_CAM_IOCTL_FRAME_RING_SETUP \
+	_IOW(MSM_CAM_IOCTL_MAGIC, 41, struct msm_frame_ring_cfg *)
+
+#define MSM_CAM_IOCTL_FRAME_RING_SYNC \
+	_IO(MSM_CAM_IOCTL_MAGIC, 42)
+
 #define MSM_CAMERA_LED_OFF  0
 #define MSM_CAMERA_LED_LOW  1
 #define MSM_CAMERA_LED_HIGH 2
@@ -451,6 +457,48 @@ struct msm_frame {
 	int st_quality_ind_len;
 };
 
+/* Shared frame ring for the frame node.
+ *
+ * MSM_CAM_IOCTL_FRAME_RING_SETUP allocates the ring and, if eventfd is not
+ * negative, arranges for that eventfd to be signalled with the number of
+ * frames delivered in each batch.  The ring is then mmap()ed from the frame
+ * node at offset 0.  Indices are free running; entry i lives in slot
+ * i % MSM_FRAME_RING_SIZE.
+ *
+ * The driver appends finished preview/video frames at done_head and
+ * userspace consumes them by advancing done_tail.  Userspace returns
+ * buffers by filling rel[] at rel_head and advancing it; the driver hands
+ * them back to the VFE on the next frame done, on poll() and on
+ * MSM_CAM_IOCTL_FRAME_RING_SYNC.  Crop and face detection data are not
+ * carried in the ring; clients that need them per frame keep using
+ * MSM_CAM_IOCTL_GETFRAME.
+ */
+#define MSM_FRAME_RING_SIZE 32
+
+struct msm_frame_ring_entry {
+	struct timespec ts;
+	unsigned long buffer;
+	uint32_t y_off;
+	uint32_t cbcr_off;
+	int fd;
+	int path;
+	uint32_t frame_id;
+	uint32_t error_code;
+};
+
+struct msm_frame_ring {
+	uint32_t done_head;	/* written by the driver */
+	uint32_t done_tail;	/* written by userspace */
+	uint32_t rel_head;	/* written by userspace */
+	uint32_t rel_tail;	/* written by the driver */
+	struct msm_frame_ring_entry done[MSM_FRAME_RING_SIZE];
+	struct msm_frame_ring_entry rel[MSM_FRAME_RING_SIZE];
+};
+
+struct msm_frame_ring_cfg {
+	int eventfd;
+};
+
 enum msm_st_frame_packing {
 	SIDE_BY_SIDE_HALF,
 	SIDE_BY_SIDE_FULL,
@@ -28,13 +28,13 @@
 #include <linux/init.h>
 #include <asm/atomic.h>
 #include "crc32defs.h"
-#if CRC_LE_BITS == 8
+#if CRC_LE_BITS > 8
 # define tole(x) __constant_cpu_to_le32(x)
 #else
 # define tole(x) (x)
 #endif
 
-#if CRC_BE_BITS == 8
+#if CRC_BE_BITS > 8
 # define tobe(x) __constant_cpu_to_be32(x)
 #else
 # define tobe(x) (x)
@@ -45,26 +45,41 @@ MODULE_AUTHOR("Matt Domsch <Matt_Domsch@dell.com>");
 MODULE_DESCRIPTION("Ethernet CRC32 calculations");
 MODULE_LICENSE("GPL");
 
-#if CRC_LE_BITS == 8 || CRC_BE_BITS == 8
+#if CRC_LE_BITS > 8 || CRC_BE_BITS > 8
 
+#ifdef CONFIG_HAVE_ARCH_CRC32_SLICEBY8
+/*
+ * The architecture's version of the slice-by-8 loop below: @words8 is
+ * the number of 8 byte chunks at @buf, which is word aligned.
+ */
+extern u32 crc32_sliceby8_arch(u32 crc, unsigned char const *buf,
+			       size_t words8, const u32 (*tab)[256]);
+#endif
+
+/* implements slicing-by-4 or slicing-by-8 algorithm */
 static inline u32
 crc32_body(u32 crc, unsigned char const *buf, size_t len, const u32 (*tab)[256])
 {
 # ifdef __LITTLE_ENDIAN
-#  define DO_CRC(x) crc = tab[0][(crc ^ (x)) & 255] ^ (crc >> 8)
-#  define DO_CRC4 crc = tab[3][(crc) & 255] ^ \
-		tab[2][(crc >> 8) & 255] ^ \
-		tab[1][(crc >> 16) & 255] ^ \
-		tab[0][(crc >> 24) & 255]
+#  define DO_CRC(x) crc = t0[(crc ^ (x)) & 255] ^ (crc >> 8)
+#  define DO_CRC4 (t3[(q) & 255] ^ t2[(q >> 8) & 255] ^ \
+		   t1[(q >> 16) & 255] ^ t0[(q >> 24) & 255])
+#  define DO_CRC8 (t7[(q) & 255] ^ t6[(q >> 8) & 255] ^ \
+		   t5[(q >> 16) & 255] ^ t4[(q >> 24) & 255])
 # else
-#  define DO_CRC(x) crc = tab[0][((crc >> 24) ^ (x)) & 255] ^ (crc << 8)
-#  define DO_CRC4 crc = tab[0][(crc) & 255] ^ \
-		tab[1][(crc >> 8) & 255] ^ \
-		tab[2][(crc >> 16) & 255] ^ \
-		tab[3][(crc >> 24) & 255]
+#  define DO_CRC(x) crc = t0[((crc >> 24) ^ (x)) & 255] ^ (crc << 8)
+#  define DO_CRC4 (t0[(q) & 255] ^ t1[(q >> 8) & 255] ^ \
+		   t2[(q >> 16) & 255] ^ t3[(q >> 24) & 255])
+#  define DO_CRC8 (t4[(q) & 255] ^ t5[(q >> 8) & 255] ^ \
+		   t6[(q >> 16) & 255] ^ t7[(q >> 24) & 255])
 # endif
 	const u32 *b;
 	size_t    rem_len;
+	const u32 *t0 = tab[0], *t1 = tab[1], *t2 = tab[2], *t3 = tab[3];
+# if CRC_LE_BITS == 64
+	const u32 *t4 = tab[4], *t5 = tab[5], *t6 = tab[6], *t7 = tab[7];
+# endif
+	u32 q;
 
 	/* Align it */
 	if (unlikely((long)buf & 3 && len)) {
@@ -72,13 +87,34 @@ crc32_body(u32 crc, unsigned char const *buf, size_t len, const u32 (*tab)[256])
 			DO_CRC(*buf++);
 		} while ((--len) && ((long)buf)&3);
 	}
+
+# if CRC_LE_BITS == 64 && defined(CONFIG_HAVE_ARCH_CRC32_SLICEBY8)
+	if (len >= 8) {
+		crc = crc32_sliceby8_arch(crc, buf, len >> 3, tab);
+		buf += len & ~7;
+		len &= 7;
+	}
+# endif
+
+# if CRC_LE_BITS == 32
 	rem_len = len & 3;
-	/* load data 32 bits wide, xor data 32 bits wide. */
 	len = len >> 2;
+# else
+	rem_len = len & 7;
+	len = len >> 3;
+# endif
+
+	/* load data 32 bits wide, xor data 32 bits wide. */
 	b = (const u32 *)buf;
 	for (--b; len; --len) {
-		crc ^= *++b; /* use pre increment for speed */
-		DO_CRC4;
+		q = crc ^ *++b; /* use pre increment for speed */
+# if CRC_LE_BITS == 32
+		crc = DO_CRC4;
+# else
+		crc = DO_CRC8;
+		q = *++b;
+		crc ^= DO_CRC4;
+# endif
 	}
 	len = rem_len;
 	/* And the last few bytes */
@@ -91,80 +127,180 @@ crc32_body(u32 crc, unsigned char const *buf, size_t len, const u32 (*tab)[256])
 	return crc;
 #undef DO_CRC
 #undef DO_CRC4
+#undef DO_CRC8
 }
 #endif
+
 /**
- * crc32_le() - Calculate bitwise little-endian Ethernet AUTODIN II CRC32
- * @crc: seed value for computation.  ~0 for Ethernet, sometimes 0 for
- *	other uses, or the previous crc32 value if computing incrementally.
+ * crc32_le_generic() - Calculate bitwise little-endian CRC32 of any
+ *	polynomial, using the table built for it by gen_crc32table
+ * @crc: seed value for computation.
  * @p: pointer to buffer over which CRC is run
  * @len: length of buffer @p
+ * @tab: little-endian table for @polynomial
+ * @polynomial: CRC32 polynomial, bit reversed (only used bit-at-a-time)
  */
-u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len);
-
-#if CRC_LE_BITS == 1
-/*
- * In fact, the table-based code will work in this case, but it can be
- * simplified by inlining the table in ?: form.
- */
-
-u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+static inline u32 __pure crc32_le_generic(u32 crc, unsigned char const *p,
+					  size_t len, const u32 (*tab)[256],
+					  u32 polynomial)
 {
+#if CRC_LE_BITS == 1
+	/*
+	 * In fact, the table-based code will work in this case, but it can be
+	 * simplified by inlining the table in ?: form.
+	 */
 	int i;
 	while (len--) {
 		crc ^= *p++;
 		for (i = 0; i < 8; i++)
-			crc = (crc >> 1) ^ ((crc & 1) ? CRCPOLY_LE : 0);
+			crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
+	}
+# elif CRC_LE_BITS == 2
+	while (len--) {
+		crc ^= *p++;
+		crc = (crc >> 2) ^ tab[0][crc & 3];
+		crc = (crc >> 2) ^ tab[0][crc & 3];
+		crc = (crc >> 2) ^ tab[0][crc & 3];
+		crc = (crc >> 2) ^ tab[0][crc & 3];
 	}
-	return crc;
-}
-#else				/* Table-based approach */
-
-u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
-{
-# if CRC_LE_BITS == 8
-	const u32      (*tab)[] = crc32table_le;
-
-	crc = __cpu_to_le32(crc);
-	crc = crc32_body(crc, p, len, tab);
-	return __le32_to_cpu(crc);
 # elif CRC_LE_BITS == 4
 	while (len--) {
 		crc ^= *p++;
-		crc = (crc >> 4) ^ crc32table_le[crc & 15];
-		crc = (crc >> 4) ^ crc32table_le[crc & 15];
+		crc = (crc >> 4) ^ tab[0][crc & 15];
+		crc = (crc >> 4) ^ tab[0][crc & 15];
 	}
-	return crc;
-# elif CRC_LE_BITS == 2
+# elif CRC_LE_BITS == 8
+	/* aka Sarwate algorithm */
 	while (len--) {
 		crc ^= *p++;
-		crc = (crc >> 2) ^ crc32table_le[crc & 3];
-		crc = (crc >> 2) ^ crc32table_le[crc & 3];
-		crc = (crc >> 2) ^ crc32table_le[crc & 3];
-		crc = (crc >> 2) ^ crc32table_le[crc & 3];
+		crc = (crc >> 8) ^ tab[0][crc & 255];
 	}
+# else
+	crc = __cpu_to_le32(crc);
+	crc = crc32_body(crc, p, len, tab);
+	crc = __le32_to_cpu(crc);
+#endif
 	return crc;
-# endif
 }
-#endif
 
 /**
- * crc32_be() - Calculate bitwise big-endian Ethernet AUTODIN II CRC32
+ * crc32_le() - Calculate bitwise little-endian Ethernet AUTODIN II CRC32
  * @crc: seed value for computation.  ~0 for Ethernet, sometimes 0 for
  *	other uses, or the previous crc32 value if computing incrementally.
  * @p: pointer to buffer over which CRC is run
  * @len: length of buffer @p
  */
-u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len);
+#if CRC_LE_BITS == 1
+u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_le_generic(crc, p, len, NULL, CRCPOLY_LE);
+}
+
+u32 __pure __crc32c_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_le_generic(crc, p, len, NULL, CRC32C_POLY_LE);
+}
+#else
+u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_le_generic(crc, p, len, crc32table_le, CRCPOLY_LE);
+}
+
+/**
+ * __crc32c_le() - Calculate bitwise little-endian CRC32c (Castagnoli),
+ *	as used by crypto/crc32c.c
+ * @crc: seed value for computation, or the previous value
+ * @p: pointer to buffer over which CRC is run
+ * @len: length of buffer @p
+ */
+u32 __pure __crc32c_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_le_generic(crc, p, len, crc32ctable_le, CRC32C_POLY_LE);
+}
+#endif
+
+/*
+ * Multiplies @x by @y modulo @modulus, all three in the bit reversed
+ * form crc32_le() works in: bit 31 holds the x^0 coefficient, and the
+ * x^32 term of @modulus is implied.
+ */
+static u32 __attribute_const__ gf2_multiply(u32 x, u32 y, u32 modulus)
+{
+	u32 product = x & 1 ? y : 0;
+	int i;
+
+	/* Horner's rule, from the x^31 coefficient of x down to x^0 */
+	for (i = 0; i < 31; i++) {
+		product = (product >> 1) ^ (product & 1 ? modulus : 0);
+		x >>= 1;
+		product ^= x & 1 ? y : 0;
+	}
+
+	return product;
+}
 
-#if CRC_BE_BITS == 1
 /*
- * In fact, the table-based code will work in this case, but it can be
- * simplified by inlining the table in ?: form.
+ * Returns what crc32_le_generic() would return for @crc followed by @len
+ * zero bytes, in O(log(len)) time: that is @crc times x^(8 * len).
  */
+static u32 __attribute_const__ crc32_generic_shift(u32 crc, size_t len,
+						   u32 polynomial)
+{
+	u32 power = polynomial;		/* x^32 mod polynomial */
+	int i;
+
+	/* The odd bytes bit by bit */
+	for (i = 0; i < 8 * (int)(len & 3); i++)
+		crc = (crc >> 1) ^ (crc & 1 ? polynomial : 0);
 
+	/* Then whole words, squaring power through x^(32 * 2^n) */
+	for (len >>= 2; len; len >>= 1) {
+		if (len & 1)
+			crc = gf2_multiply(crc, power, polynomial);
+		if (len > 1)
+			power = gf2_multiply(power, power, polynomial);
+	}
+
+	return crc;
+}
+
+/**
+ * crc32_le_shift() - Advance a crc32_le() value over @len zero bytes
+ * @crc: value returned by crc32_le()
+ * @len: number of zero bytes
+ *
+ * This is crc32_le(@crc, <@len zeros>, @len) without touching memory,
+ * and is the building block of crc32_le_combine().
+ */
+u32 __attribute_const__ crc32_le_shift(u32 crc, size_t len)
+{
+	return crc32_generic_shift(crc, len, CRCPOLY_LE);
+}
+
+u32 __attribute_const__ __crc32c_le_shift(u32 crc, size_t len)
+{
+	return crc32_generic_shift(crc, len, CRC32C_POLY_LE);
+}
+
+EXPORT_SYMBOL(crc32_le);
+EXPORT_SYMBOL(__crc32c_le);
+EXPORT_SYMBOL(crc32_le_shift);
+EXPORT_SYMBOL(__crc32c_le_shift);
+
+/**
+ * crc32_be() - Calculate bitwise big-endian Ethernet AUTODIN II CRC32
+ * @crc: seed value for computation.  ~0 for Ethernet, sometimes 0 for
+ *	other uses, or the previous crc32 value if computing incrementally.
+ * @p: pointer to buffer over which CRC is run
+ * @len: length of buffer @p
+ */
 u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len)
 {
+#if CRC_BE_BITS == 1
+	/*
+	 * In fact, the table-based code will work in this case, but it can be
+	 * simplified by inlining the table in ?: form.
+	 */
 	int i;
 	while (len--) {
 		crc ^= *p++ << 24;
@@ -173,39 +309,32 @@ u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len)
 			    (crc << 1) ^ ((crc & 0x80000000) ? CRCPOLY_BE :
 					  0);
 	}
-	return crc;
-}
-
-#else				/* Table-based approach */
-u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len)
-{
-# if CRC_BE_BITS == 8
-	const u32      (*tab)[] = crc32table_be;
-
-	crc = __cpu_to_be32(crc);
-	crc = crc32_body(crc, p, len, tab);
-	return __be32_to_cpu(crc);
+# elif CRC_BE_BITS == 2
+	while (len--) {
+		crc ^= *p++ << 24;
+		crc = (crc << 2) ^ crc32table_be[0][crc >> 30];
+		crc = (crc << 2) ^ crc32table_be[0][crc >> 30];
+		crc = (crc << 2) ^ crc32table_be[0][crc >> 30];
+		crc = (crc << 2) ^ crc32table_be[0][crc >> 30];
+	}
 # elif CRC_BE_BITS == 4
 	while (len--) {
 		crc ^= *p++ << 24;
-		crc = (crc << 4) ^ crc32table_be[crc >> 28];
-		crc = (crc << 4) ^ crc32table_be[crc >> 28];
+		crc = (crc << 4) ^ crc32table_be[0][crc >> 28];
+		crc = (crc << 4) ^ crc32table_be[0][crc >> 28];
 	}
-	return crc;
-# elif CRC_BE_BITS == 2
+# elif CRC_BE_BITS == 8
 	while (len--) {
 		crc ^= *p++ << 24;
-		crc = (crc << 2) ^ crc32table_be[crc >> 30];
-		crc = (crc << 2) ^ crc32table_be[crc >> 30];
-		crc = (crc << 2) ^ crc32table_be[crc >> 30];
-		crc = (crc << 2) ^ crc32table_be[crc >> 30];
+		crc = (crc << 8) ^ crc32table_be[0][crc >> 24];
 	}
-	return crc;
+# else
+	crc = __cpu_to_be32(crc);
+	crc = crc32_body(crc, p, len, crc32table_be);
+	crc = __be32_to_cpu(crc);
 # endif
+	return crc;
 }
-#endif
-
-EXPORT_SYMBOL(crc32_le);
 EXPORT_SYMBOL(crc32_be);
 
 /*
@@ -335,6 +464,156 @@ EXPORT_SYMBOL(crc32_be);
  * the same way on decoding, it doesn't make a difference.
  */
 
+#ifdef CONFIG_CRC32_SELFTEST
+
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+#if CRC_LE_BITS == 64
+# define CRC32_IMPL "slice-by-8"
+#elif CRC_LE_BITS == 32
+# define CRC32_IMPL "slice-by-4"
+#elif CRC_LE_BITS == 8
+# define CRC32_IMPL "sarwate"
+#else
+# define CRC32_IMPL "bitwise"
+#endif
+
+#define CRC32_TEST_SIZE		4096
+#define CRC32_TEST_NSEC		(100 * NSEC_PER_MSEC)
+
+/* Bit at a time references, straight from the definition */
+static u32 __init crc32_le_ref(u32 crc, unsigned char const *p, size_t len,
+			       u32 polynomial)
+{
+	int i;
+
+	while (len--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
+	}
+	return crc;
+}
+
+static u32 __init crc32_be_ref(u32 crc, unsigned char const *p, size_t len)
+{
+	int i;
+
+	while (len--) {
+		crc ^= *p++ << 24;
+		for (i = 0; i < 8; i++)
+			crc = (crc << 1) ^
+			      ((crc & 0x80000000) ? CRCPOLY_BE : 0);
+	}
+	return crc;
+}
+
+/*
+ * Checks one (offset, len) window of @buf: each table driven function
+ * against its reference, that appending the big-endian crc cancels it,
+ * and that the crcs of two halves combine to the crc of the whole.
+ */
+static int __init crc32_test_one(unsigned char *buf, size_t off, size_t len)
+{
+	unsigned char const *p = buf + off;
+	size_t split = len ? random32() % (len + 1) : 0;
+	u32 seed = random32();
+	u32 crc, ref;
+	int errors = 0;
+
+	crc = crc32_le(seed, p, len);
+	ref = crc32_le_ref(seed, p, len, CRCPOLY_LE);
+	if (crc != ref)
+		errors++;
+	if (crc32_le_combine(crc32_le(seed, p, split),
+			     crc32_le(0, p + split, len - split),
+			     len - split) != ref)
+		errors++;
+
+	crc = __crc32c_le(seed, p, len);
+	ref = crc32_le_ref(seed, p, len, CRC32C_POLY_LE);
+	if (crc != ref)
+		errors++;
+	if (__crc32c_le_combine(__crc32c_le(seed, p, split),
+				__crc32c_le(0, p + split, len - split),
+				len - split) != ref)
+		errors++;
+
+	crc = crc32_be(seed, p, len);
+	if (crc != crc32_be_ref(seed, p, len))
+		errors++;
+
+	/* CRC(buf + CRC(buf)) = 0; this clobbers the four bytes past len */
+	buf[off + len] = crc >> 24;
+	buf[off + len + 1] = crc >> 16;
+	buf[off + len + 2] = crc >> 8;
+	buf[off + len + 3] = crc;
+	if (crc32_be(seed, p, len + 4))
+		errors++;
+
+	if (errors)
+		pr_err("crc32: self test failed, offset %zu length %zu\n",
+		       off, len);
+	return errors;
+}
+
+/* Runs @fn over the buffer for CRC32_TEST_NSEC and reports MB/s */
+static void __init crc32_test_speed(unsigned char const *buf, const char *name,
+				    u32 (*fn)(u32, unsigned char const *,
+					      size_t))
+{
+	unsigned long iters = 0;
+	ktime_t start;
+	u32 crc = 0;
+	s64 ns;
+
+	start = ktime_get();
+	do {
+		crc = fn(crc, buf, CRC32_TEST_SIZE);
+		iters++;
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	} while (ns < CRC32_TEST_NSEC);
+
+	/* bytes per microsecond is MB/s */
+	pr_info("crc32: %s %llu MB/s (" CRC32_IMPL ", crc %08x)\n", name,
+		(unsigned long long)div64_u64((u64)iters * CRC32_TEST_SIZE *
+					      NSEC_PER_USEC, ns), crc);
+}
+
+static int __init crc32_test_init(void)
+{
+	unsigned char *buf;
+	size_t off, len;
+	int errors = 0;
+
+	buf = kmalloc(CRC32_TEST_SIZE + 8 + 4, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	for (len = 0; len < 300 && !errors; len++) {
+		for (off = 0; off < 8 && !errors; off++) {
+			get_random_bytes(buf, len + off);
+			errors += crc32_test_one(buf, off, len);
+		}
+	}
+	if (!errors)
+		pr_info("crc32: self tests passed (" CRC32_IMPL ")\n");
+
+	get_random_bytes(buf, CRC32_TEST_SIZE);
+	crc32_test_speed(buf, "crc32_le", crc32_le);
+	crc32_test_speed(buf, "crc32_be", crc32_be);
+	crc32_test_speed(buf, "crc32c", __crc32c_le);
+
+	kfree(buf);
+	return 0;
+}
+module_init(crc32_test_init);
+
+#endif				/* CONFIG_CRC32_SELFTEST */
+
 #ifdef UNITTEST
 
 #include <stdlib.h>
@@ -366,7 +645,6 @@ static void random_garbage(unsigned char *buf, size_t len)
 		*buf++ = (unsigned char) random();
 }
 
-#if 0				/* Not used at present */
 static void store_le(u32 x, unsigned char *buf)
 {
 	buf[0] = (unsigned char) x;
@@ -374,7 +652,6 @@ static void store_le(u32 x, unsigned char *buf)
 	buf[2] = (unsigned char) (x >> 16);
 	buf[3] = (unsigned char) (x >> 24);
 }
-#endif
 
 static void store_be(u32 x, unsigned char *buf)
 {
@@ -433,9 +710,44 @@ static u32 test_step(u32 init, unsigned char *buf, size_t len)
 			printf("\nCRC split fail: 0x%08x\n", crc2);
 	}
 
+	/* crc32_le_combine() must match the split computation */
+	for (i = 0; i <= len; i++) {
+		crc2 = crc32_le_combine(crc32_le(init, buf, i),
+					crc32_le(0, buf + i, len - i), len - i);
+		if (crc2 != crc1)
+			printf("\nCRC combine fail: 0x%08x != 0x%08x\n",
+			       crc2, crc1);
+	}
+
 	return crc1;
 }
 
+/*
+ * The same cancellation and combine checks for crc32c, which has its
+ * own table.  This overwrites the 4 bytes after the buffer.
+ */
+static void test_step_c(u32 init, unsigned char *buf, size_t len)
+{
+	u32 crc1, crc2;
+	size_t i;
+
+	crc1 = __crc32c_le(init, buf, len);
+	store_le(crc1, buf + len);
+	crc2 = __crc32c_le(init, buf, len + 4);
+	if (crc2)
+		printf("\nCRC32C cancellation fail: 0x%08x should be 0\n",
+		       crc2);
+
+	for (i = 0; i <= len; i++) {
+		crc2 = __crc32c_le_combine(__crc32c_le(init, buf, i),
+					   __crc32c_le(0, buf + i, len - i),
+					   len - i);
+		if (crc2 != crc1)
+			printf("\nCRC32C combine fail: 0x%08x != 0x%08x\n",
+			       crc2, crc1);
+	}
+}
+
 #define SIZE 64
 #define INIT1 0
 #define INIT2 0
@@ -463,6 +775,9 @@ int main(void)
 		if (crc3 != (crc1 ^ crc2))
 			printf("CRC XOR fail: 0x%08x != 0x%08x ^ 0x%08x\n",
 			       crc3, crc1, crc2);
+
+		random_garbage(buf1, i);
+		test_step_c(INIT1, buf1, i);
 	}
 	printf("\nAll test complete.  No failures expected.\n");
 	return 0;
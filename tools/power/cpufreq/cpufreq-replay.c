@@ -0,0 +1,251 @@
+/*
+ * cpufreq-replay -- replay a recorded frame workload and report how the
+ * active cpufreq governor handled it.
+ *
+ * The trace is a text file with one frame per line:
+ *
+ *	<idle_us> <work> <deadline_us>
+ *
+ * For every frame the tool sleeps for idle_us, then runs <work> units of
+ * a fixed busy loop and counts the frame as missed if the work did not
+ * finish within deadline_us of waking up.  Lines starting with '#' are
+ * ignored.  "cpufreq-replay -c" prints how many work units the CPU gets
+ * through per millisecond at its current speed, which is what recorded
+ * frame costs should be scaled by.
+ *
+ * Time spent at each speed is taken from cpufreq_stats before and after
+ * the run.  With a power table ("<freq_khz> <mW>" per line, -p) the
+ * energy used is estimated from it; otherwise MHz * seconds is reported
+ * as a proxy.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+
+#define MAX_FREQS	32
+#define STATS_PATH	"/sys/devices/system/cpu/cpu%d/cpufreq/stats/time_in_state"
+
+struct freq_time {
+	unsigned int freq;		/* kHz */
+	unsigned long long time;	/* 10 ms units, as in cpufreq_stats */
+};
+
+static int cpu;
+static int verbose;
+
+static volatile unsigned int sink;
+
+static void do_work(unsigned long units)
+{
+	unsigned long i;
+	unsigned int j, acc = sink;
+
+	for (i = 0; i < units; i++)
+		for (j = 0; j < 64; j++)
+			acc = acc * 1103515245 + 12345;
+	sink = acc;
+}
+
+static unsigned long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int read_time_in_state(struct freq_time *ft)
+{
+	char path[128];
+	FILE *fp;
+	int n = 0;
+
+	snprintf(path, sizeof(path), STATS_PATH, cpu);
+	fp = fopen(path, "r");
+	if (!fp) {
+		perror(path);
+		return -1;
+	}
+
+	while (n < MAX_FREQS &&
+	       fscanf(fp, "%u %llu", &ft[n].freq, &ft[n].time) == 2)
+		n++;
+
+	fclose(fp);
+	return n;
+}
+
+static unsigned int power_mw(unsigned int *table, int entries,
+			     unsigned int freq)
+{
+	int i;
+
+	for (i = 0; i < entries; i++)
+		if (table[2 * i] == freq)
+			return table[2 * i + 1];
+	return 0;
+}
+
+static int read_power_table(const char *file, unsigned int *table)
+{
+	FILE *fp;
+	int n = 0;
+
+	fp = fopen(file, "r");
+	if (!fp) {
+		perror(file);
+		return -1;
+	}
+
+	while (n < MAX_FREQS &&
+	       fscanf(fp, "%u %u", &table[2 * n], &table[2 * n + 1]) == 2)
+		n++;
+
+	fclose(fp);
+	return n;
+}
+
+static void calibrate(void)
+{
+	unsigned long long start, elapsed;
+	unsigned long units = 1000;
+
+	/* grow the run until it is long enough to time reliably */
+	for (;;) {
+		start = now_us();
+		do_work(units);
+		elapsed = now_us() - start;
+		if (elapsed >= 100000)
+			break;
+		units *= 2;
+	}
+
+	printf("%llu units/ms\n", (unsigned long long)units * 1000 / elapsed);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: cpufreq-replay [-v] [-C cpu] [-p power_table] trace\n"
+		"       cpufreq-replay -c\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct freq_time before[MAX_FREQS], after[MAX_FREQS];
+	unsigned int power[2 * MAX_FREQS];
+	int npower = 0;
+	int nbefore, nafter;
+	unsigned long long start, wake, total_lateness = 0;
+	unsigned long long idle_us, work, deadline_us, done;
+	unsigned long frames = 0, missed = 0;
+	double energy = 0;
+	char line[256];
+	FILE *trace;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "cC:p:v")) != -1) {
+		switch (opt) {
+		case 'c':
+			calibrate();
+			return 0;
+		case 'C':
+			cpu = atoi(optarg);
+			break;
+		case 'p':
+			npower = read_power_table(optarg, power);
+			if (npower < 0)
+				return 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind != argc - 1)
+		usage();
+
+	trace = fopen(argv[optind], "r");
+	if (!trace) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	nbefore = read_time_in_state(before);
+	if (nbefore < 0)
+		return 1;
+
+	start = now_us();
+	while (fgets(line, sizeof(line), trace)) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (sscanf(line, "%llu %llu %llu",
+			   &idle_us, &work, &deadline_us) != 3) {
+			fprintf(stderr, "bad trace line: %s", line);
+			continue;
+		}
+
+		if (idle_us)
+			usleep(idle_us);
+		wake = now_us();
+		do_work(work);
+		done = now_us() - wake;
+
+		frames++;
+		if (done > deadline_us) {
+			missed++;
+			total_lateness += done - deadline_us;
+			if (verbose)
+				printf("frame %lu: missed by %llu us\n",
+				       frames, done - deadline_us);
+		}
+	}
+	fclose(trace);
+
+	nafter = read_time_in_state(after);
+	if (nafter != nbefore) {
+		fprintf(stderr, "frequency table changed during the run\n");
+		return 1;
+	}
+
+	printf("frames: %lu missed: %lu (%.1f%%) avg lateness: %llu us\n",
+	       frames, missed, frames ? 100.0 * missed / frames : 0.0,
+	       missed ? total_lateness / missed : 0);
+	printf("run time: %.2f s\n", (now_us() - start) / 1000000.0);
+	printf("%10s %10s\n", "freq_khz", "time_ms");
+
+	for (i = 0; i < nafter; i++) {
+		unsigned long long ms = (after[i].time - before[i].time) * 10;
+
+		printf("%10u %10llu\n", after[i].freq, ms);
+		if (npower)
+			energy += power_mw(power, npower, after[i].freq) *
+				  ms / 1000.0;
+		else
+			energy += after[i].freq / 1000.0 * ms / 1000.0;
+	}
+
+	if (npower)
+		printf("energy: %.1f mJ\n", energy);
+	else
+		printf("energy proxy: %.1f MHz*s\n", energy);
+
+	return 0;
+}
@@ -305,6 +305,23 @@ usbdev_ioctl (int fd, int ifno, unsigned request, void *param)
 	return ioctl (fd, USBDEVFS_IOCTL, &wrapper);
 }
 
+/* bytes moved by the fixed-size bulk tests, for a throughput figure */
+static unsigned long long bulk_bytes (struct usbtest_param *param)
+{
+	unsigned long long bytes;
+
+	bytes = (unsigned long long) param->iterations * param->length;
+	switch (param->test_num) {
+	case 1:		/* bulk OUT */
+	case 2:		/* bulk IN */
+		return bytes;
+	case 5:		/* bulk OUT, scatterlist */
+	case 6:		/* bulk IN, scatterlist */
+		return bytes * param->sglen;
+	}
+	return 0;
+}
+
 static void *handle_testdev (void *arg)
 {
 	struct testdev		*dev = arg;
@@ -340,10 +357,24 @@ restart:
 			}
 			printf ("%s test %d --> %d (%s)\n",
 				dev->name, i, errno, buf);
-		} else
-			printf ("%s test %d, %4d.%.06d secs\n", dev->name, i,
-				(int) dev->param.duration.tv_sec,
-				(int) dev->param.duration.tv_usec);
+		} else {
+			unsigned long long	bytes = bulk_bytes (&dev->param);
+			double			secs;
+
+			secs = dev->param.duration.tv_sec
+				+ dev->param.duration.tv_usec / 1e6;
+			if (bytes && secs > 0)
+				printf ("%s test %d, %4d.%.06d secs, "
+					"%.2f MB/s\n", dev->name, i,
+					(int) dev->param.duration.tv_sec,
+					(int) dev->param.duration.tv_usec,
+					bytes / secs / (1024 * 1024));
+			else
+				printf ("%s test %d, %4d.%.06d secs\n",
+					dev->name, i,
+					(int) dev->param.duration.tv_sec,
+					(int) dev->param.duration.tv_usec);
+		}
 
 		fflush (stdout);
 	}